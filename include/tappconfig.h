@@ -0,0 +1 @@
+#include "../src/tappconfig.h"
@@ -76,6 +76,8 @@ isEmpty( use_gui ) {
 
 HEADERS += twebapplication.h
 SOURCES += twebapplication.cpp
+HEADERS += tappconfig.h
+SOURCES += tappconfig.cpp
 HEADERS += tapplicationserverbase.h
 SOURCES += tapplicationserverbase.cpp
 HEADERS += tthreadapplicationserver.h
@@ -92,8 +94,14 @@ HEADERS += thttpsocket.h
 SOURCES += thttpsocket.cpp
 HEADERS += thttpbuffer.h
 SOURCES += thttpbuffer.cpp
+HEADERS += thttprequestparser.h
+SOURCES += thttprequestparser.cpp
 HEADERS += thttpsendbuffer.h
 SOURCES += thttpsendbuffer.cpp
+HEADERS += thttpcompression.h
+SOURCES += thttpcompression.cpp
+HEADERS += thttprangefile.h
+SOURCES += thttprangefile.cpp
 HEADERS += tabstractcontroller.h
 SOURCES += tabstractcontroller.cpp
 HEADERS += tactioncontroller.h
@@ -125,7 +133,7 @@ SOURCES += tcriteria.cpp
 HEADERS += tcriteriaconverter.h
 SOURCES += tcriteriaconverter.cpp
 HEADERS += tdispatcher.h
-#SOURCES += tdispatcher.cpp
+SOURCES += tdispatcher.cpp
 HEADERS += thttprequest.h
 SOURCES += thttprequest.cpp
 HEADERS += thttpresponse.h
@@ -234,6 +242,7 @@ HEADERS += tatomicset.h
 SOURCES += tatomicset.cpp
 HEADERS += tatomicqueue.h
 SOURCES += tatomicqueue.cpp
+HEADERS += tboundedqueue.h
 
 !isEmpty( use_mongo ) {
   INCLUDEPATH += ../3rdparty/mongo-c-driver/src
@@ -291,6 +300,12 @@ unix:!macx {
   SOURCES += tmultiplexingserver_linux.cpp
   HEADERS += tactionworker.h
   SOURCES += tactionworker.cpp
+  HEADERS += tstaticfilecache.h
+  SOURCES += tstaticfilecache_linux.cpp
+  HEADERS += teventbackend.h
+  SOURCES += teventbackend_linux.cpp
+  HEADERS += tiouring.h
+  SOURCES += tiouring_linux.cpp
 }
 
 # Qt5
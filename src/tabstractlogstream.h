@@ -13,7 +13,7 @@ class TAbstractLogStream : public QObject
     Q_OBJECT
 public:
     TAbstractLogStream(const QList<TLogger *> &loggers, QObject *parent);
-    virtual ~TAbstractLogStream() { }
+    virtual ~TAbstractLogStream() { loggerClose(); }
     virtual void writeLog(const TLog &log) = 0;
     virtual void flush() = 0;
 
@@ -11,6 +11,7 @@
 #include <QHostAddress>
 #include <TActionContext>
 #include <TWebApplication>
+#include <TAppConfig>
 #include <THttpRequest>
 #include <THttpResponse>
 #include <THttpUtility>
@@ -23,15 +24,14 @@
 #include "thttpsocket.h"
 #include "tsessionmanager.h"
 #include "turlroute.h"
+#include "thttpcompression.h"
+#include "thttprangefile.h"
 #ifdef Q_OS_UNIX
 # include "tfcore_unix.h"
 #endif
 
-#define AUTO_ID_REGENERATION  "Session.AutoIdRegeneration"
-#define DIRECT_VIEW_RENDER_MODE  "DirectViewRenderMode"
-#define ENABLE_CSRF_PROTECTION_MODULE "EnableCsrfProtectionModule"
-#define SESSION_COOKIE_PATH  "Session.CookiePath"
-#define LISTEN_PORT  "ListenPort"
+
+const int STREAM_CHUNK_SIZE = 16 * 1024;
 
 /*!
   \class TActionContext
@@ -47,14 +47,29 @@ TActionContext::TActionContext()
       stopped(false),
       socketDesc(0),
       currController(0),
-      httpReq(0)
+      httpReq(0),
+      streaming(false),
+      streamChunked(false),
+      streamBytes(0),
+      streamBuffer()
 { }
 
 
 TActionContext::~TActionContext()
 {
-    if (httpReq)
+    release();
+}
+
+/*!
+  Releases the resources of the current request, so that this context
+  can process the next request.
+*/
+void TActionContext::release()
+{
+    if (httpReq) {
         delete httpReq;
+        httpReq = 0;
+    }
 
     // Releases all SQL database sessions
     TActionContext::releaseSqlDatabases();
@@ -65,10 +80,18 @@ TActionContext::~TActionContext()
     for (QListIterator<TTemporaryFile *> i(tempFiles); i.hasNext(); ) {
         delete i.next();
     }
+    tempFiles.clear();
 
     for (QStringListIterator i(autoRemoveFiles); i.hasNext(); ) {
         QFile(i.next()).remove();
     }
+    autoRemoveFiles.clear();
+
+    currController = 0;
+    streaming = false;
+    streamChunked = false;
+    streamBytes = 0;
+    streamBuffer.clear();
 }
 
 
@@ -142,7 +165,7 @@ void TActionContext::execute()
         QByteArray firstLine = hdr.method() + ' ' + hdr.path();
         firstLine += QString(" HTTP/%1.%2").arg(hdr.majorVersion()).arg(hdr.minorVersion()).toLatin1();
         accessLogger.setRequest(firstLine);
-        accessLogger.setRemoteHost( (Tf::app()->appSettings().value(LISTEN_PORT).toUInt() > 0) ? clientAddress().toString().toLatin1() : QByteArray("(unix)") );
+        accessLogger.setRemoteHost( (Tf::app()->appConfig().listenPort() > 0) ? clientAddress().toString().toLatin1() : QByteArray("(unix)") );
 
         tSystemDebug("method : %s", hdr.method().data());
         tSystemDebug("path : %s", hdr.path().data());
@@ -166,7 +189,7 @@ void TActionContext::execute()
             }
 
             // Direct view render mode?
-            if (Tf::app()->appSettings().value(DIRECT_VIEW_RENDER_MODE).toBool()) {
+            if (Tf::app()->appConfig().directViewRenderMode()) {
                 // Direct view setting
                 rt.controller = "directcontroller";
                 rt.action = "show";
@@ -209,7 +232,7 @@ void TActionContext::execute()
             }
 
             // Verify authenticity token
-            if (Tf::app()->appSettings().value(ENABLE_CSRF_PROTECTION_MODULE, true).toBool()
+            if (Tf::app()->appConfig().enableCsrfProtectionModule()
                 && currController->csrfProtectionEnabled() && !currController->exceptionActionsOfCsrfProtection().contains(rt.action)) {
 
                 if (method == Tf::Post || method == Tf::Put || method == Tf::Delete) {
@@ -220,7 +243,7 @@ void TActionContext::execute()
             }
 
             if (currController->sessionEnabled()) {
-                if (currController->session().id().isEmpty() || Tf::app()->appSettings().value(AUTO_ID_REGENERATION).toBool()) {
+                if (currController->session().id().isEmpty() || Tf::app()->appConfig().sessionAutoIdRegeneration()) {
                     TSessionManager::instance().remove(currController->session().sessionId); // Removes the old session
                     // Re-generate session ID
                     currController->session().sessionId = TSessionManager::instance().generateId();
@@ -254,36 +277,25 @@ void TActionContext::execute()
                     // Session store
                     if (currController->sessionEnabled()) {
                         bool stored = TSessionManager::instance().store(currController->session());
-                        if (stored) {
-                            QDateTime expire;
-                            if (TSessionManager::sessionLifeTime() > 0) {
-                                expire = QDateTime::currentDateTime().addSecs(TSessionManager::sessionLifeTime());
-                            }
-
-                            // Sets the path in the session cookie
-                            QString cookiePath = Tf::app()->appSettings().value(SESSION_COOKIE_PATH).toString();
-                            currController->addCookie(TSession::sessionName(), currController->session().id(), expire, cookiePath);
+                        if (stored && !streaming) {
+                            addSessionCookie();
                         }
                     }
                 }
             }
 
-            // Sets charset to the content-type
-            QByteArray ctype = currController->response.header().contentType().toLower();
-            if (ctype.startsWith("text") && !ctype.contains("charset")) {
-                ctype += "; charset=";
-                ctype += Tf::app()->codecForHttpOutput()->name();
-                currController->response.header().setContentType(ctype);
-            }
-
-            // Sets the default status code of HTTP response
-            accessLogger.setStatusCode( (!currController->response.isBodyNull()) ? currController->statusCode() : Tf::InternalServerError );
-            currController->response.header().setStatusLine(accessLogger.statusCode(), THttpUtility::getResponseReasonPhrase(accessLogger.statusCode()));
+            if (streaming) {
+                // Sends the rest of the streamed response
+                finishStream();
+            } else {
+                // Sets the default status code of HTTP response
+                setResponseStatus( (!currController->response.isBodyNull()) ? currController->statusCode() : Tf::InternalServerError );
 
-            // Writes a response and access log
-            int bytes = writeResponse(currController->response.header(), currController->response.bodyIODevice(),
-                                      currController->response.bodyLength());
-            accessLogger.setResponseBytes(bytes);
+                // Writes a response and access log
+                int bytes = writeResponse(currController->response.header(), currController->response.bodyIODevice(),
+                                          currController->response.bodyLength());
+                accessLogger.setResponseBytes(bytes);
+            }
 
             // Session GC
             TSessionManager::instance().collectGarbage();
@@ -292,31 +304,66 @@ void TActionContext::execute()
             accessLogger.setStatusCode( Tf::BadRequest );
 
             if (method == Tf::Get) {  // GET Method
+                QString filePath = path;
                 path.remove(0, 1);
                 QFile reqPath(Tf::app()->publicPath() + path);
                 QFileInfo fi(reqPath);
 
                 if (fi.isFile() && fi.isReadable()) {
-                    // Check "If-Modified-Since" header for caching
+                    QByteArray lastModified = THttpUtility::toHttpDateTimeString(fi.lastModified());
+                    QByteArray etag = THttpUtility::toEntityTag(fi.lastModified(), fi.size());
+                    QByteArray type = Tf::app()->internetMediaType(fi.suffix());
+
+                    // Precompressed file, if any
+                    QFile gzFile(THttpCompression::gzipVariantPath(reqPath.fileName(), type));
+                    bool hasGzip = !gzFile.fileName().isEmpty();
+                    bool gzip = hasGzip && THttpCompression::accepts(hdr.rawHeader("Accept-Encoding"), "gzip");
+                    QFile *file = (gzip) ? &gzFile : &reqPath;
+
+                    // Check "If-None-Match" header for caching, and
+                    // "If-Modified-Since" header if it's absent
                     bool sendfile = true;
+                    QByteArray ifNoneMatch = hdr.rawHeader("If-None-Match");
                     QByteArray ifModifiedSince = hdr.rawHeader("If-Modified-Since");
 
-                    if (!ifModifiedSince.isEmpty()) {
+                    if (!ifNoneMatch.isEmpty()) {
+                        sendfile = !THttpUtility::matchesEntityTag(ifNoneMatch, etag);
+                    } else if (!ifModifiedSince.isEmpty()) {
                         QDateTime dt = THttpUtility::fromHttpDateTimeString(ifModifiedSince);
                         sendfile = (!dt.isValid() || dt != fi.lastModified());
                     }
 
+                    responseHeader.setRawHeader("Last-Modified", lastModified);
                     if (sendfile) {
                         // Sends a request file
-                        responseHeader.setRawHeader("Last-Modified", THttpUtility::toHttpDateTimeString(fi.lastModified()));
-                        QByteArray type = Tf::app()->internetMediaType(fi.suffix());
-                        int bytes = writeResponse(Tf::OK, responseHeader, type, &reqPath, reqPath.size());
+                        THttpCompression::setVariantHeader(responseHeader, Tf::OK, hasGzip, gzip, etag);
+                        responseHeader.setRawHeader("Accept-Ranges", "bytes");
+
+                        // Range request; the ranges of the file sent, encoded or not
+                        QList<QPair<qint64, qint64> > ranges;
+                        int status = THttpRangeFile::evaluate(hdr, file->size(), lastModified,
+                                                              THttpCompression::variantEntityTag(etag, gzip), ranges);
+                        int bytes;
+                        if (status == Tf::PartialContent) {
+                            THttpRangeFile rangeFile(file->fileName(), ranges, type, file->size());
+                            if (!rangeFile.contentRange().isEmpty()) {
+                                responseHeader.setRawHeader("Content-Range", rangeFile.contentRange());
+                            }
+                            bytes = writeResponse(status, responseHeader, rangeFile.contentType(), &rangeFile, rangeFile.size());
+                        } else if (status == Tf::RequestedRangeNotSatisfiable) {
+                            responseHeader.setRawHeader("Content-Range", "bytes */" + QByteArray::number(file->size()));
+                            bytes = writeResponse(status, responseHeader);
+                        } else {
+                            bytes = writeResponse(Tf::OK, responseHeader, type, file, file->size());
+                        }
                         accessLogger.setResponseBytes( bytes );
                     } else {
                         // Not send the data
+                        THttpCompression::setVariantHeader(responseHeader, Tf::NotModified, hasGzip, gzip, etag);
                         int bytes = writeResponse(Tf::NotModified, responseHeader);
                         accessLogger.setResponseBytes( bytes );
                     }
+                    staticFileServed(filePath);
                 } else {
                     int bytes = writeResponse(Tf::NotFound, responseHeader);
                     accessLogger.setResponseBytes( bytes );
@@ -332,9 +379,13 @@ void TActionContext::execute()
 
     } catch (ClientErrorException &e) {
         tWarn("Caught ClientErrorException: status code:%d", e.statusCode());
-        int bytes = writeResponse(e.statusCode(), responseHeader);
-        accessLogger.setResponseBytes( bytes );
-        accessLogger.setStatusCode( e.statusCode() );
+        if (streaming) {
+            closeHttpSocket();  // the response has been sent partly
+        } else {
+            int bytes = writeResponse(e.statusCode(), responseHeader);
+            accessLogger.setResponseBytes( bytes );
+            accessLogger.setStatusCode( e.statusCode() );
+        }
     } catch (SqlException &e) {
         tError("Caught SqlException: %s  [%s:%d]", qPrintable(e.message()), qPrintable(e.fileName()), e.lineNumber());
         tSystemError("Caught SqlException: %s  [%s:%d]", qPrintable(e.message()), qPrintable(e.fileName()), e.lineNumber());
@@ -406,6 +457,31 @@ qint64 TActionContext::writeResponse(THttpResponseHeader &header, QIODevice *bod
 {
     T_TRACEFUNC("length:%s", qPrintable(QString::number(length)));
 
+    // Compresses the body in memory if the client accepts
+    QByteArray compressed;
+    QBuffer compressedBuffer(&compressed);
+    QBuffer *buffer = qobject_cast<QBuffer *>(body);
+    int statusCode = header.statusCode();
+
+    if (buffer && httpReq && THttpCompression::isEnabled() && length >= THttpCompression::minLength()
+        && statusCode >= 200 && statusCode != Tf::NoContent && statusCode != Tf::NotModified
+        && header.rawHeader("Content-Encoding").isEmpty() && THttpCompression::isCompressible(header.contentType())) {
+        QByteArray vary = header.rawHeader("Vary");
+        if (!vary.toLower().contains("accept-encoding")) {
+            header.setRawHeader("Vary", (vary.isEmpty()) ? QByteArray("Accept-Encoding") : vary + ", Accept-Encoding");
+        }
+
+        QByteArray coding = THttpCompression::negotiate(httpReq->header().rawHeader("Accept-Encoding"));
+        if (!coding.isEmpty()) {
+            compressed = THttpCompression::compress(buffer->data(), coding, THttpCompression::level());
+            if (!compressed.isEmpty() && compressed.length() < length) {
+                header.setRawHeader("Content-Encoding", coding);
+                body = &compressedBuffer;
+                length = compressed.length();
+            }
+        }
+    }
+
     header.setContentLength(length);
     header.setRawHeader("Server", "TreeFrog server");
 # if QT_VERSION >= 0x040700
@@ -420,12 +496,157 @@ qint64 TActionContext::writeResponse(THttpResponseHeader &header, QIODevice *bod
 }
 
 
+/*!
+  Writes the \a data to the body of the response streamed by the
+  current controller. The data is buffered, and sent as a chunk when
+  the buffer gets full or flushStream() is called. Returns false if
+  the response can not be sent.
+*/
+bool TActionContext::writeStream(const QByteArray &data)
+{
+    if (!currController || streamBytes < 0)
+        return false;
+
+    streaming = true;
+    streamBuffer += data;
+    return (streamBuffer.length() < STREAM_CHUNK_SIZE) ? true : flushStream();
+}
+
+/*!
+  Sends the data buffered by writeStream() to the client. The header of
+  the response is sent with the first data; the body is sent in the
+  chunked transfer-coding for HTTP/1.1, or delimited by closing the
+  connection for HTTP/1.0. Returns false if the response can not be
+  sent.
+*/
+bool TActionContext::flushStream()
+{
+    if (!currController || streamBytes < 0)
+        return false;
+
+    streaming = true;
+    THttpResponseHeader *header = 0;
+
+    if (streamBytes == 0) {
+        // Header of the response
+        const THttpRequestHeader &reqHeader = httpReq->header();
+        header = &currController->response.header();
+        streamChunked = (reqHeader.majorVersion() > 1 || (reqHeader.majorVersion() == 1 && reqHeader.minorVersion() > 0));
+
+        if (currController->sessionEnabled()) {
+            addSessionCookie();
+        }
+        setResponseStatus(currController->statusCode());
+        header->removeRawHeader("Content-Length");
+        if (streamChunked) {
+            header->setRawHeader("Transfer-Encoding", "chunked");
+        } else {
+            header->setRawHeader("Connection", "close");
+        }
+        header->setRawHeader("Server", "TreeFrog server");
+# if QT_VERSION >= 0x040700
+        QDateTime utc = QDateTime::currentDateTimeUtc();
+#else
+        QDateTime utc = QDateTime::currentDateTime().toUTC();
+#endif
+        header->setRawHeader("Date", QLocale(QLocale::C).toString(utc, QLatin1String("ddd, dd MMM yyyy hh:mm:ss 'GMT'")).toLatin1());
+    } else if (streamBuffer.isEmpty()) {
+        return true;
+    }
+
+    QByteArray data;
+    if (httpReq->method() != Tf::Head && !streamBuffer.isEmpty()) {
+        if (streamChunked) {
+            data = QByteArray::number(streamBuffer.length(), 16) + "\r\n" + streamBuffer + "\r\n";
+        } else {
+            data = streamBuffer;
+        }
+    }
+    streamBuffer.clear();
+
+    qint64 len = writeStreamData(header, data, false);
+    if (len < 0) {
+        tWarn("Failed to stream the response: %s", qPrintable(currController->className() + '#' + currController->activeAction()));
+        streamBytes = -1;
+        return false;
+    }
+    streamBytes += len;
+    return true;
+}
+
+/*
+  Sends the rest of the streamed response and the last chunk.
+*/
+bool TActionContext::finishStream()
+{
+    if (!flushStream()) {
+        closeHttpSocket();
+        return false;
+    }
+
+    QByteArray data = (streamChunked && httpReq->method() != Tf::Head) ? QByteArray("0\r\n\r\n") : QByteArray();
+    accessLogger.setResponseBytes(streamBytes);  // the last data is added by the server
+    qint64 len = writeStreamData(0, data, true);
+    if (len < 0) {
+        streamBytes = -1;
+        closeHttpSocket();
+        return false;
+    }
+    streamBytes += len;
+    accessLogger.setResponseBytes(streamBytes);
+    return true;
+}
+
+/*
+  Adds the session cookie of the current controller to the response.
+*/
+void TActionContext::addSessionCookie()
+{
+    QDateTime expire;
+    if (TSessionManager::sessionLifeTime() > 0) {
+        expire = QDateTime::currentDateTime().addSecs(TSessionManager::sessionLifeTime());
+    }
+
+    // Sets the path in the session cookie
+    const QString &cookiePath = Tf::app()->appConfig().sessionCookiePath();
+    currController->addCookie(TSession::sessionName(), currController->session().id(), expire, cookiePath);
+}
+
+/*
+  Sets the status line with the \a statusCode, and the charset of the
+  text content-type, to the response of the current controller.
+*/
+void TActionContext::setResponseStatus(int statusCode)
+{
+    THttpResponseHeader &header = currController->response.header();
+
+    // Sets charset to the content-type
+    QByteArray ctype = header.contentType().toLower();
+    if (ctype.startsWith("text") && !ctype.contains("charset")) {
+        ctype += "; charset=";
+        ctype += Tf::app()->codecForHttpOutput()->name();
+        header.setContentType(ctype);
+    }
+
+    accessLogger.setStatusCode(statusCode);
+    header.setStatusLine(statusCode, THttpUtility::getResponseReasonPhrase(statusCode));
+}
+
+
 void TActionContext::setHttpRequest(const THttpRequest &request)
+{
+    setHttpRequest(new THttpRequest(request));
+}
+
+/*
+  Sets the \a request, which is deleted by this context.
+*/
+void TActionContext::setHttpRequest(THttpRequest *request)
 {
     if (httpReq)
         delete httpReq;
 
-    httpReq = new THttpRequest(request);
+    httpReq = request;
 }
 
 
@@ -35,6 +35,9 @@ public:
     const TActionController *currentController() const { return currController; }
     THttpRequest &httpRequest() { return *httpReq; }
     const THttpRequest &httpRequest() const { return *httpReq; }
+    bool writeStream(const QByteArray &data);
+    bool flushStream();
+    bool isStreaming() const { return streaming; }
 
 protected:
     void execute();
@@ -48,11 +51,15 @@ protected:
     qint64 writeResponse(int statusCode, THttpResponseHeader &header, const QByteArray &contentType, QIODevice *body, qint64 length);
     qint64 writeResponse(THttpResponseHeader &header, QIODevice *body, qint64 length);
     void setHttpRequest(const THttpRequest &request);
+    void setHttpRequest(THttpRequest *request);
+    void release();
 
     virtual bool readRequest() { return true; }
     virtual qint64 writeResponse(THttpResponseHeader &, QIODevice *) { return 0; }
+    virtual qint64 writeStreamData(THttpResponseHeader *, const QByteArray &, bool) { return -1; }
     virtual void closeHttpSocket() { }
     virtual void releaseHttpSocket() { }
+    virtual void staticFileServed(const QString &) { }
 
     QMap<int, QSqlDatabase> sqlDatabases;
     TSqlTransaction transactions;
@@ -63,9 +70,17 @@ protected:
     TAccessLogger accessLogger;
 
 private:
+    void addSessionCookie();
+    void setResponseStatus(int statusCode);
+    bool finishStream();
+
     TActionController *currController;
     QList<TTemporaryFile *> tempFiles;
     THttpRequest *httpReq;
+    bool streaming;         // the response is being streamed
+    bool streamChunked;     // in the chunked transfer-coding
+    qint64 streamBytes;     // bytes written, or -1 on error
+    QByteArray streamBuffer;
 
     Q_DISABLE_COPY(TActionContext)
 };
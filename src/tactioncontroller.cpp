@@ -7,6 +7,7 @@
 
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QTextStream>
 #include <QMetaMethod>
 #include <QMetaType>
@@ -16,19 +17,20 @@
 #include <QDomDocument>
 #include <TActionController>
 #include <TWebApplication>
+#include <TAppConfig>
 #include <TDispatcher>
 #include <TActionView>
 #include <TSession>
 #include <TAbstractUser>
 #include <TActionContext>
+#include <THttpUtility>
 #include <TFormValidator>
 #include "tsessionmanager.h"
+#include "thttprangefile.h"
 #include "ttextview.h"
 
-#define STORE_TYPE              "Session.StoreType"
 #define FLASH_VARS_SESSION_KEY  "_flashVariants"
 #define LOGIN_USER_NAME_KEY     "_loginUserName"
-#define CSRF_PROTECTION_KEY     "Session.CsrfProtectionKey"
 
 /*!
   \class TActionController
@@ -213,8 +215,8 @@ bool TActionController::addCookie(const QByteArray &name, const QByteArray &valu
  */
 QByteArray TActionController::authenticityToken() const
 {
-    if (Tf::app()->appSettings().value(STORE_TYPE).toString().toLower() == QLatin1String("cookie")) {
-        QString key = Tf::app()->appSettings().value(CSRF_PROTECTION_KEY).toString();
+    if (Tf::app()->appConfig().sessionStoreType() == QLatin1String("cookie")) {
+        QString key = Tf::app()->appConfig().sessionCsrfProtectionKey();
         QByteArray csrfId = session().value(key).toByteArray();
 
         if (csrfId.isEmpty()) {
@@ -222,7 +224,7 @@ QByteArray TActionController::authenticityToken() const
         }
         return csrfId;
     } else {
-        return QCryptographicHash::hash(session().id() + Tf::app()->appSettings().value("Session.Secret").toByteArray(), QCryptographicHash::Sha1).toHex();
+        return QCryptographicHash::hash(session().id() + Tf::app()->appConfig().sessionSecret(), QCryptographicHash::Sha1).toHex();
     }
 }
 
@@ -248,8 +250,8 @@ void TActionController::setSession(const TSession &session)
 */
 void TActionController::setCsrfProtectionInto(TSession &session)
 {
-    if (Tf::app()->appSettings().value(STORE_TYPE).toString().toLower() == QLatin1String("cookie")) {
-        QString key = Tf::app()->appSettings().value(CSRF_PROTECTION_KEY).toString();
+    if (Tf::app()->appConfig().sessionStoreType() == QLatin1String("cookie")) {
+        QString key = Tf::app()->appConfig().sessionCsrfProtectionKey();
         session.insert(key, TSessionManager::instance().generateId());  // it's just a random value
     }
 }
@@ -290,7 +292,7 @@ bool TActionController::verifyRequest(const THttpRequest &request) const
         return true;
     }
 
-    if (Tf::app()->appSettings().value(STORE_TYPE).toString().toLower() != QLatin1String("cookie")) {
+    if (Tf::app()->appConfig().sessionStoreType() != QLatin1String("cookie")) {
         if (session().id().isEmpty()) {
             throw SecurityException("Request Forgery Protection requires a valid session", __FILE__, __LINE__);
         }
@@ -624,10 +626,12 @@ void TActionController::redirect(const QUrl &url, int statusCode)
 
 /*!
   \~english
-  Sends the file \a filePath as HTTP response.
+  Sends the file \a filePath as HTTP response. The byte ranges of the
+  Range header of a GET request are sent as 206 Partial Content.
 
   \~japanese
-  HTTPレスポンスとして、ファイル \a filePath の内容を送信する
+  HTTPレスポンスとして、ファイル \a filePath の内容を送信する。
+  GETリクエストのRangeヘッダのバイト範囲は 206 Partial Content として送信する
 */
 bool TActionController::sendFile(const QString &filePath, const QByteArray &contentType, const QString &name, bool autoRemove)
 {
@@ -646,8 +650,29 @@ bool TActionController::sendFile(const QString &filePath, const QByteArray &cont
         response.header().setRawHeader("Content-Disposition", filename);
     }
 
-    response.setBodyFile(filePath);
+    QFileInfo fi(filePath);
+    QByteArray lastModified = THttpUtility::toHttpDateTimeString(fi.lastModified());
     response.header().setContentType(contentType);
+    response.header().setRawHeader("Last-Modified", lastModified);
+    response.header().setRawHeader("Accept-Ranges", "bytes");
+
+    // Range request
+    QList<QPair<qint64, qint64> > ranges;
+    int status = Tf::OK;
+    if (httpRequest().method() == Tf::Get && fi.isFile()) {
+        status = THttpRangeFile::evaluate(httpRequest().header(), fi.size(), lastModified, QByteArray(), ranges);
+    }
+
+    if (status == Tf::PartialContent) {
+        setStatusCode(status);
+        response.setBodyFile(filePath, ranges);
+    } else if (status == Tf::RequestedRangeNotSatisfiable) {
+        setStatusCode(status);
+        response.header().setRawHeader("Content-Range", "bytes */" + QByteArray::number(fi.size()));
+        response.setBody(QByteArray(""));
+    } else {
+        response.setBodyFile(filePath);
+    }
 
     if (autoRemove)
         setAutoRemove(filePath);
@@ -685,6 +710,66 @@ bool TActionController::sendData(const QByteArray &data, const QByteArray &conte
     return true;
 }
 
+/*!
+  \~english
+  Writes the \a data to the body of the response, which is streamed
+  while the action is running. The data is sent in chunks of the
+  chunked transfer-coding for HTTP/1.1, and the connection is closed
+  after the response for HTTP/1.0. The status code, headers and
+  cookies must be set before the first data is sent. The response can
+  not be rendered by the other functions with this.
+
+  \~japanese
+  データ \a data をレスポンスのボディに書き込む。アクションの実行中に
+  ストリーミングで送信される。HTTP/1.1 ではチャンク形式で送信され、
+  HTTP/1.0 ではレスポンス後に接続が閉じられる。ステータスコード、ヘッダ
+  およびクッキーは最初のデータが送信される前に設定すること
+*/
+bool TActionController::write(const QByteArray &data)
+{
+    TActionContext *context = Tf::currentContext();
+    if (rendered && !context->isStreaming()) {
+        tWarn("Has rendered already: %s", qPrintable(className() + '#' + activeAction()));
+        return false;
+    }
+    rendered = true;
+    return context->writeStream(data);
+}
+
+/*!
+  \~english
+  Writes the \a text to the body of the response, encoded by the codec
+  for the HTTP output.
+
+  \~japanese
+  テキスト \a text をHTTP出力用のコーデックでエンコードし、
+  レスポンスのボディに書き込む
+*/
+bool TActionController::write(const QString &text)
+{
+    return write(Tf::app()->codecForHttpOutput()->fromUnicode(text));
+}
+
+/*!
+  \~english
+  Sends the data written to the body of the response so far. The header
+  of the response is sent with the first data.
+
+  \~japanese
+  これまでにレスポンスのボディに書き込まれたデータを送信する。
+  レスポンスのヘッダは最初のデータとともに送信される
+*/
+bool TActionController::flush()
+{
+    TActionContext *context = Tf::currentContext();
+    if (rendered && !context->isStreaming()) {
+        tWarn("Has rendered already: %s", qPrintable(className() + '#' + activeAction()));
+        return false;
+    }
+    rendered = true;
+    return context->flushStream();
+}
+
 /*!
   \~english
   Exports the all flash variants.
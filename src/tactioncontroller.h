@@ -88,6 +88,10 @@ protected:
     void redirect(const QUrl &url, int statusCode = Tf::Found);
     bool sendFile(const QString &filePath, const QByteArray &contentType, const QString &name = QString(), bool autoRemove = false);
     bool sendData(const QByteArray &data, const QByteArray &contentType, const QString &name = QString());
+    bool write(const QByteArray &data);
+    bool write(const QString &text);
+    bool write(const char *data) { return write(QByteArray(data)); }
+    bool flush();
     void rollbackTransaction() { rollback = true; }
     void setAutoRemove(const QString &filePath);
     bool validateAccess(const TAbstractUser *user);
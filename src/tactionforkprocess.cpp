@@ -5,7 +5,6 @@
  * the New BSD License, which is incorporated herein by reference.
  */
 
-#include <iostream>
 #include <TActionForkProcess>
 #include <TWebApplication>
 #include <TActionThread>
@@ -36,7 +35,8 @@ TActionForkProcess::~TActionForkProcess()
     if (TActionContext::socketDesc > 0)
         TF_CLOSE(TActionContext::socketDesc);
 
-    currentActionContext = 0;
+    if (currentActionContext == this)
+        currentActionContext = 0;
 }
 
 
@@ -58,15 +58,14 @@ void TActionForkProcess::start()
         return;
 
     currentActionContext = this;
-    std::cerr << "_accepted" << std::flush;  // send to tfmanager
     execute();
 
     // For cleanup
     QEventLoop eventLoop;
     while (eventLoop.processEvents()) {}
 
+    currentActionContext = 0;  // ready for the next connection
     emit finished();
-    QCoreApplication::exit(1);
 }
 
 
@@ -102,6 +101,18 @@ qint64 TActionForkProcess::writeResponse(THttpResponseHeader &header, QIODevice
 }
 
 
+qint64 TActionForkProcess::writeStreamData(THttpResponseHeader *header, const QByteArray &data, bool)
+{
+    QList<QByteArray> segments;
+    if (header) {
+        header->setRawHeader("Connection", "close");
+        segments << header->toByteArray();
+    }
+    segments << data;
+    return httpSocket->writeRawData(segments);
+}
+
+
 void TActionForkProcess::closeHttpSocket()
 {
     httpSocket->close();
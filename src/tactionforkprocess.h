@@ -22,6 +22,7 @@ protected:
 
     virtual bool readRequest();
     virtual qint64 writeResponse(THttpResponseHeader &header, QIODevice *body);
+    virtual qint64 writeStreamData(THttpResponseHeader *header, const QByteArray &data, bool last);
     virtual void closeHttpSocket();
     virtual void releaseHttpSocket();
 
@@ -110,6 +110,18 @@ qint64 TActionThread::writeResponse(THttpResponseHeader &header, QIODevice *body
 }
 
 
+qint64 TActionThread::writeStreamData(THttpResponseHeader *header, const QByteArray &data, bool)
+{
+    QList<QByteArray> segments;
+    if (header) {
+        header->setRawHeader("Connection", "close");
+        segments << header->toByteArray();
+    }
+    segments << data;
+    return httpSocket->writeRawData(segments);
+}
+
+
 void TActionThread::closeHttpSocket()
 {
     httpSocket->close();
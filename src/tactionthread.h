@@ -25,6 +25,7 @@ protected:
 
     bool readRequest();
     qint64 writeResponse(THttpResponseHeader &header, QIODevice *body);
+    qint64 writeStreamData(THttpResponseHeader *header, const QByteArray &data, bool last);
     void closeHttpSocket();
     void releaseHttpSocket();
 
@@ -5,28 +5,156 @@
  * the New BSD License, which is incorporated herein by reference.
  */
 
+#include <QSemaphore>
 #include <TActionWorker>
 #include <THttpRequest>
 #include <TMultiplexingServer>
 #include "thttpsocket.h"
+#include "thttprangefile.h"
+#include "thttpsendbuffer.h"
+#include "tboundedqueue.h"
 #include "tsystemglobal.h"
 
+static QList<TActionWorker *> workers;
+static TBoundedQueue<void *, true> *requestQueue = 0;
+static QSemaphore requestSemaphore;
+
+const int MAX_STREAM_BUFFERS = 4;
+
 /*!
   \class TActionWorker
   \brief The TActionWorker class provides a thread context.
+  The worker threads are started once and pooled; each of them takes
+  the requests from the queue one by one.
 */
 
-TActionWorker::TActionWorker(int socket, const THttpRequest &request, QObject *parent)
-    : QThread(parent), TActionContext()
+TActionWorker::TActionWorker(QObject *parent)
+    : QThread(parent), TActionContext(), server(0), keepAlive(false), socketReleased(true),
+      streamClose(false), streamSemaphore(new QSemaphore(MAX_STREAM_BUFFERS))
+{ }
+
+
+TActionWorker::~TActionWorker()
+{
+    tSystemDebug("TActionWorker::~TActionWorker");
+}
+
+/*!
+  Starts the \a num worker threads.
+*/
+void TActionWorker::startWorkers(int num)
 {
-    TActionContext::socketDesc = socket;
-    setHttpRequest(request);
+    if (!workers.isEmpty())
+        return;
+
+    requestQueue = new TBoundedQueue<void *, true>(num);
+    for (int i = 0; i < num; ++i) {
+        TActionWorker *worker = new TActionWorker();
+        workers << worker;
+        worker->start();
+    }
+    tSystemDebug("Worker threads started: %d", num);
 }
 
+/*!
+  Stops all the worker threads after processing the current requests.
+*/
+void TActionWorker::stopWorkers()
+{
+    if (workers.isEmpty())
+        return;
 
-TActionWorker::~TActionWorker()
+    // A null request means stop
+    for (int i = 0; i < workers.count(); ++i) {
+        while (!requestQueue->enqueue(0)) {
+            Tf::msleep(1);
+        }
+        requestSemaphore.release();
+    }
+
+    for (QListIterator<TActionWorker *> it(workers); it.hasNext(); ) {
+        TActionWorker *worker = it.next();
+        worker->wait();
+        delete worker;
+    }
+    workers.clear();
+
+    delete requestQueue;
+    requestQueue = 0;
+}
+
+/*!
+  Posts the request received on the socket \a fd to the worker
+  threads. The body is the \a data from the position \a bodyOffset,
+  which is shared, not copied. If \a bodyFilePath is not empty, the
+  body is read from the file, which is removed after the request is
+  processed. The reactor must reserve a worker before calling this
+  function, so the queue never gets full.
+*/
+bool TActionWorker::postRequest(int fd, const THttpRequestHeader &header, const QByteArray &data, int bodyOffset, const QString &bodyFilePath, const QHostAddress &address, TMultiplexingServer *reactor, bool keepAlive)
+{
+    RequestData *req = new RequestData;
+    req->fd = fd;
+    req->header = header;
+    req->data = data;
+    req->bodyOffset = bodyOffset;
+    req->bodyFilePath = bodyFilePath;
+    req->address = address;
+    req->reactor = reactor;
+    req->keepAlive = keepAlive;
+
+    if (!requestQueue || !requestQueue->enqueue(req)) {
+        tSystemError("Request queue full  fd:%d", fd);
+        delete req;
+        return false;
+    }
+    requestSemaphore.release();
+    return true;
+}
+
+
+void TActionWorker::run()
 {
-    tSystemDebug("TActionWorker::~TActionWorker  fd:%d", socketDesc);
+    for (;;) {
+        void *ptr = 0;
+        requestSemaphore.acquire();
+        while (!requestQueue->dequeue(ptr)) {
+            // Being enqueued by another thread
+            QThread::yieldCurrentThread();
+        }
+
+        RequestData *data = static_cast<RequestData *>(ptr);
+        if (!data) {
+            break;  // stop
+        }
+
+        TActionContext::socketDesc = data->fd;
+        server = data->reactor;
+        keepAlive = data->keepAlive;
+        socketReleased = false;
+        if (data->bodyFilePath.isEmpty()) {
+            // Parses the body in the received data, not copying it
+            QByteArray body = QByteArray::fromRawData(data->data.constData() + data->bodyOffset, data->data.length() - data->bodyOffset);
+            setHttpRequest(new THttpRequest(data->header, body, data->address));
+        } else {
+            TActionContext::autoRemoveFiles << data->bodyFilePath;  // removed after processing
+            setHttpRequest(new THttpRequest(data->header, data->bodyFilePath, data->address));
+        }
+        delete data;
+
+        TActionContext::execute();
+
+        if (!socketReleased) {
+            // No response, the connection can not be reused
+            closeHttpSocket();
+        }
+
+        // Reuses this context
+        TActionContext::release();
+        TActionContext::socketDesc = 0;
+        server->releaseWorker();
+        server = 0;
+    }
 }
 
 
@@ -34,24 +162,86 @@ qint64 TActionWorker::writeResponse(THttpResponseHeader &header, QIODevice *body
 {
     accessLogger.setStatusCode(header.statusCode());
 
+    // Persistent connection
+    if (keepAlive) {
+        const THttpRequestHeader &reqHeader = httpRequest().header();
+        if (reqHeader.majorVersion() == 1 && reqHeader.minorVersion() == 0) {
+            header.setRawHeader("Connection", "Keep-Alive");
+        }
+    } else {
+        header.setRawHeader("Connection", "close");
+    }
+
     // Check auto-remove
     bool autoRemove = false;
     QFile *f = qobject_cast<QFile *>(body);
-    if (f) {
-        QString filePath = f->fileName();
+    THttpRangeFile *rf = qobject_cast<THttpRangeFile *>(body);
+    if (f || rf) {
+        QString filePath = (f) ? f->fileName() : rf->fileName();
         if (TActionContext::autoRemoveFiles.contains(filePath)) {
             TActionContext::autoRemoveFiles.removeAll(filePath);
             autoRemove = true;  // To remove after sent
         }
     }
 
-    TMultiplexingServer::instance()->setSendRequest(socketDesc, static_cast<THttpHeader*>(&header), body, autoRemove, accessLogger);
+    server->setSendRequest(socketDesc, static_cast<THttpHeader*>(&header), body, autoRemove, accessLogger);
+    socketReleased = true;
     accessLogger.close();  // not write in this thread
     return 0;
 }
 
 
+/*!
+  Queues the \a data of the response streamed, following the \a header
+  if it's not null, to the reactor. If the client is slow to receive,
+  waits for the data queued before to be sent. If \a last is true, the
+  connection is released.
+*/
+qint64 TActionWorker::writeStreamData(THttpResponseHeader *header, const QByteArray &data, bool last)
+{
+    QByteArray response;
+    if (header) {
+        accessLogger.setStatusCode(header->statusCode());
+        streamClose = !keepAlive || header->rawHeader("Connection").toLower().contains("close");
+        if (streamClose) {
+            header->setRawHeader("Connection", "close");
+        }
+        response = header->toByteArray();
+    }
+    qint64 len = response.length() + data.length();
+
+    if (last) {
+        server->setSendRequest(socketDesc, new THttpSendBuffer(response, data, accessLogger), streamClose, false);
+        socketReleased = true;
+        accessLogger.close();  // not write in this thread
+        return len;
+    }
+
+    if (!streamSemaphore->tryAcquire(1, qMax(server->sendTimeoutSecs(), 1) * 1000)) {
+        tSystemWarn("Stream send timeout  fd:%d", socketDesc);
+        return -1;
+    }
+
+    THttpSendBuffer *buffer = new THttpSendBuffer(response, data, TAccessLogger());
+    buffer->setSemaphore(streamSemaphore);
+    server->setSendRequest(socketDesc, buffer, streamClose, true);
+    return len;
+}
+
+
+/*!
+  Reads the static file served into the cache of the reactors.
+*/
+void TActionWorker::staticFileServed(const QString &path)
+{
+    TMultiplexingServer::loadStaticFile(path);
+}
+
+
 void TActionWorker::closeHttpSocket()
 {
-    TMultiplexingServer::instance()->setDisconnectRequest(socketDesc);
+    if (!socketReleased) {
+        server->setDisconnectRequest(socketDesc);
+        socketReleased = true;
+    }
 }
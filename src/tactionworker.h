@@ -2,28 +2,60 @@
 #define TACTIONWORKER_H
 
 #include <QThread>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QSemaphore>
+#include <QSharedPointer>
 #include <TActionContext>
+#include <THttpRequestHeader>
 
 class THttpRequest;
 class THttpResponseHeader;
 class QIODevice;
+class TMultiplexingServer;
 
 
 class T_CORE_EXPORT TActionWorker : public QThread, public TActionContext
 {
     Q_OBJECT
 public:
-    TActionWorker(int socket, const THttpRequest &request, QObject *parent = 0);
+    TActionWorker(QObject *parent = 0);
     virtual ~TActionWorker();
 
+    TMultiplexingServer *reactor() const { return server; }
+
+    static void startWorkers(int num);
+    static void stopWorkers();
+    static bool postRequest(int fd, const THttpRequestHeader &header, const QByteArray &data, int bodyOffset, const QString &bodyFilePath, const QHostAddress &address, TMultiplexingServer *reactor, bool keepAlive);
+
 protected:
-    void run() { TActionContext::execute(); }
+    void run();
     bool readRequest() { return true; }
     qint64 writeResponse(THttpResponseHeader &header, QIODevice *body);
+    qint64 writeStreamData(THttpResponseHeader *header, const QByteArray &data, bool last);
     void closeHttpSocket();
     void releaseHttpSocket() { }
+    void staticFileServed(const QString &path);
 
 private:
+    struct RequestData
+    {
+        int fd;
+        THttpRequestHeader header;
+        QByteArray data;  // the body from the bodyOffset
+        int bodyOffset;
+        QString bodyFilePath;
+        QHostAddress address;
+        TMultiplexingServer *reactor;
+        bool keepAlive;
+    };
+
+    TMultiplexingServer *server;
+    bool keepAlive;
+    bool socketReleased;
+    bool streamClose;  // closes the connection after the streamed response
+    QSharedPointer<QSemaphore> streamSemaphore;  // limits the buffers of the stream queued
+
     Q_DISABLE_COPY(TActionWorker)
 };
 
@@ -0,0 +1,69 @@
+/* Copyright (c) 2013, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QSettings>
+#include <TAppConfig>
+
+/*!
+  \class TAppConfig
+  \brief The TAppConfig class holds the values of the application.ini
+  read on every request, converted to their types.
+  It's created at the startup and never modified, so that it's read
+  from any threads without locking the QSettings.
+  \sa TWebApplication::appConfig()
+*/
+
+/*!
+  Constructs the configuration from the \a settings of the
+  application.ini.
+*/
+TAppConfig::TAppConfig(const QSettings &settings)
+    : port(settings.value("ListenPort").toUInt()),
+      directViewRender(settings.value("DirectViewRenderMode").toBool()),
+      csrfProtectionModule(settings.value("EnableCsrfProtectionModule", true).toBool()),
+      requestBodyLimit(settings.value("LimitRequestBody", "0").toLongLong()),
+      sesName(settings.value("Session.Name").toByteArray()),
+      sesStoreType(settings.value("Session.StoreType").toString().toLower()),
+      sesCookiePath(settings.value("Session.CookiePath").toString()),
+      sesSecret(settings.value("Session.Secret").toByteArray()),
+      sesCsrfProtectionKey(settings.value("Session.CsrfProtectionKey").toString()),
+      sesAutoIdRegeneration(settings.value("Session.AutoIdRegeneration").toBool()),
+      compressionEnabled(settings.value("HttpCompression.Enable", false).toBool()),
+      compressionLevel(qBound(-1, settings.value("HttpCompression.Level", 6).toInt(), 9)),
+      compressionMinLength(settings.value("HttpCompression.MinLength", 1024).toInt()),
+      compressionTypes()
+{
+    QList<QByteArray> types = settings.value("HttpCompression.Types", "text/,application/json,application/javascript,application/xml").toByteArray().split(',');
+    for (QListIterator<QByteArray> it(types); it.hasNext(); ) {
+        QByteArray type = it.next().trimmed().toLower();
+        if (!type.isEmpty()) {
+            compressionTypes << type;
+        }
+    }
+}
+
+/*!
+  \fn quint16 TAppConfig::listenPort() const
+  Returns the port number of the ListenPort, or 0 if it's a UNIX
+  domain socket.
+*/
+
+/*!
+  \fn const QString &TAppConfig::sessionStoreType() const
+  Returns the Session.StoreType in lowercase.
+*/
+
+/*!
+  \fn int TAppConfig::httpCompressionLevel() const
+  Returns the HttpCompression.Level, bounded to -1 (default) to 9.
+*/
+
+/*!
+  \fn const QList<QByteArray> &TAppConfig::httpCompressionTypes() const
+  Returns the prefixes of the media types of HttpCompression.Types,
+  trimmed and in lowercase.
+*/
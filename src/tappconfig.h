@@ -0,0 +1,51 @@
+#ifndef TAPPCONFIG_H
+#define TAPPCONFIG_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <TGlobal>
+
+class QSettings;
+
+
+class T_CORE_EXPORT TAppConfig
+{
+public:
+    TAppConfig(const QSettings &settings);
+
+    quint16 listenPort() const { return port; }
+    bool directViewRenderMode() const { return directViewRender; }
+    bool enableCsrfProtectionModule() const { return csrfProtectionModule; }
+    qint64 limitRequestBody() const { return requestBodyLimit; }
+    const QByteArray &sessionName() const { return sesName; }
+    const QString &sessionStoreType() const { return sesStoreType; }
+    const QString &sessionCookiePath() const { return sesCookiePath; }
+    const QByteArray &sessionSecret() const { return sesSecret; }
+    const QString &sessionCsrfProtectionKey() const { return sesCsrfProtectionKey; }
+    bool sessionAutoIdRegeneration() const { return sesAutoIdRegeneration; }
+    bool httpCompressionEnabled() const { return compressionEnabled; }
+    int httpCompressionLevel() const { return compressionLevel; }
+    int httpCompressionMinLength() const { return compressionMinLength; }
+    const QList<QByteArray> &httpCompressionTypes() const { return compressionTypes; }
+
+private:
+    Q_DISABLE_COPY(TAppConfig)
+
+    quint16 port;
+    bool directViewRender;
+    bool csrfProtectionModule;
+    qint64 requestBodyLimit;
+    QByteArray sesName;
+    QString sesStoreType;
+    QString sesCookiePath;
+    QByteArray sesSecret;
+    QString sesCsrfProtectionKey;
+    bool sesAutoIdRegeneration;
+    bool compressionEnabled;
+    int compressionLevel;
+    int compressionMinLength;
+    QList<QByteArray> compressionTypes;
+};
+
+#endif // TAPPCONFIG_H
@@ -22,6 +22,7 @@ public:
     static void nativeSocketCleanup();
     static int nativeListen(const QHostAddress &address, quint16 port, OpenFlag flag = CloseOnExec);
     static int nativeListen(const QString &fileDomain, OpenFlag flag = CloseOnExec);
+    static int nativeListenSameAddress(int socket, OpenFlag flag = CloseOnExec);
     static void nativeClose(int socket);
     static void invokeStaticInitialize();
 
@@ -8,14 +8,162 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <QTcpServer>
 #include <QFile>
+#include <TWebApplication>
 #include <TSystemGlobal>
 #include "tapplicationserverbase.h"
 #include "tfcore_unix.h"
 
+#ifdef Q_OS_LINUX
+# ifndef TCP_FASTOPEN
+#  define TCP_FASTOPEN  23
+# endif
+# ifndef SO_BUSY_POLL
+#  define SO_BUSY_POLL  46
+# endif
+#endif
+
+
+/*
+  Options of the listening sockets; the accepted sockets inherit
+  the buffer sizes and TCP_NODELAY on Linux.
+*/
+struct ListenOptions
+{
+    int backlog;
+    bool reusePort;
+    int deferAccept;
+    int fastOpen;
+    int busyPoll;
+    bool noDelay;
+    int sendBufferSize;
+    int receiveBufferSize;
+
+    ListenOptions()
+    {
+        const QSettings &settings = Tf::app()->appSettings();
+        backlog = settings.value("ListenBacklog", 511).toInt();
+        reusePort = settings.value("Socket.ReusePort", false).toBool();
+        deferAccept = settings.value("Socket.DeferAccept", 0).toInt();
+        fastOpen = settings.value("Socket.FastOpen", 0).toInt();
+        busyPoll = settings.value("Socket.BusyPoll", 0).toInt();
+        noDelay = settings.value("Socket.NoDelay", true).toBool();
+        sendBufferSize = settings.value("Socket.SendBufferSize", 0).toInt();
+        receiveBufferSize = settings.value("Socket.ReceiveBufferSize", 0).toInt();
+
+        // The kernel truncates the backlog silently
+        QFile somaxconn("/proc/sys/net/core/somaxconn");
+        if (somaxconn.open(QIODevice::ReadOnly)) {
+            int max = somaxconn.readAll().trimmed().toInt();
+            if (max > 0 && (backlog <= 0 || backlog > max)) {
+                tSystemWarn("ListenBacklog truncated to net.core.somaxconn: %d", max);
+                backlog = max;
+            }
+        }
+        if (backlog <= 0) {
+            backlog = SOMAXCONN;
+        }
+    }
+};
+
+
+static const ListenOptions &listenOptions()
+{
+    static const ListenOptions options;
+    return options;
+}
+
+
+static void setIntOption(int sd, int level, int name, int value, const char *optname)
+{
+    if (::setsockopt(sd, level, name, &value, sizeof(value)) < 0) {
+        tSystemWarn("setsockopt error [%s] fd:%d errno:%d", optname, sd, errno);
+    }
+}
+
+
+static int intOption(int sd, int level, int name)
+{
+    int value = 0;
+    socklen_t len = sizeof(value);
+    return (::getsockopt(sd, level, name, &value, &len) < 0) ? -1 : value;
+}
+
+/*
+  Sets the options to the socket \a sd before it's bound.
+*/
+static void setListenOptions(int sd, int domain)
+{
+    const ListenOptions &opt = listenOptions();
+
+    if (opt.sendBufferSize > 0)
+        setIntOption(sd, SOL_SOCKET, SO_SNDBUF, opt.sendBufferSize, "SO_SNDBUF");
+    if (opt.receiveBufferSize > 0)
+        setIntOption(sd, SOL_SOCKET, SO_RCVBUF, opt.receiveBufferSize, "SO_RCVBUF");
+
+    if (domain == AF_UNIX)
+        return;
+
+    setIntOption(sd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+    setIntOption(sd, IPPROTO_TCP, TCP_NODELAY, opt.noDelay, "TCP_NODELAY");
+#ifdef SO_REUSEPORT
+    if (opt.reusePort)
+        setIntOption(sd, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT");
+#endif
+#ifdef Q_OS_LINUX
+    if (opt.deferAccept > 0)
+        setIntOption(sd, IPPROTO_TCP, TCP_DEFER_ACCEPT, opt.deferAccept, "TCP_DEFER_ACCEPT");
+    if (opt.fastOpen > 0)
+        setIntOption(sd, IPPROTO_TCP, TCP_FASTOPEN, opt.fastOpen, "TCP_FASTOPEN");
+    if (opt.busyPoll > 0)
+        setIntOption(sd, SOL_SOCKET, SO_BUSY_POLL, opt.busyPoll, "SO_BUSY_POLL");
+#endif
+}
+
+/*
+  Outputs the effective options of the listening socket \a sd.
+*/
+static void logListenOptions(int sd, int domain)
+{
+    const ListenOptions &opt = listenOptions();
+    int sndbuf = intOption(sd, SOL_SOCKET, SO_SNDBUF);
+    int rcvbuf = intOption(sd, SOL_SOCKET, SO_RCVBUF);
+
+    if (domain == AF_UNIX) {
+        tSystemInfo("Listening socket options  fd:%d backlog:%d sndbuf:%d rcvbuf:%d",
+                    sd, opt.backlog, sndbuf, rcvbuf);
+        return;
+    }
+
+    int reusePort = 0, deferAccept = 0, fastOpen = 0, busyPoll = 0;
+#ifdef SO_REUSEPORT
+    reusePort = intOption(sd, SOL_SOCKET, SO_REUSEPORT);
+#endif
+#ifdef Q_OS_LINUX
+    deferAccept = intOption(sd, IPPROTO_TCP, TCP_DEFER_ACCEPT);
+    fastOpen = intOption(sd, IPPROTO_TCP, TCP_FASTOPEN);
+    busyPoll = intOption(sd, SOL_SOCKET, SO_BUSY_POLL);
+#endif
+    tSystemInfo("Listening socket options  fd:%d backlog:%d reuseport:%d deferaccept:%d fastopen:%d busypoll:%d nodelay:%d sndbuf:%d rcvbuf:%d",
+                sd, opt.backlog, reusePort, deferAccept, fastOpen, busyPoll,
+                intOption(sd, IPPROTO_TCP, TCP_NODELAY), sndbuf, rcvbuf);
+}
+
+
+static void setDescriptorFlags(int sd, TApplicationServerBase::OpenFlag flag)
+{
+    if (flag == TApplicationServerBase::CloseOnExec) {
+        ::fcntl(sd, F_SETFD, ::fcntl(sd, F_GETFD) | FD_CLOEXEC);
+    } else {
+        ::fcntl(sd, F_SETFD, 0);  // clear
+    }
+    ::fcntl(sd, F_SETFL, ::fcntl(sd, F_GETFL) | O_NONBLOCK);  // non-block
+}
+
 
 void TApplicationServerBase::nativeSocketInit()
 { }
@@ -26,29 +174,123 @@ void TApplicationServerBase::nativeSocketCleanup()
 
 /*!
   Listen a port for connections on a socket.
-  This function must be called in a tfmanager process.
+  The options of the socket are set by the values of ListenBacklog
+  and Socket.* in the application.ini.
  */
 int TApplicationServerBase::nativeListen(const QHostAddress &address, quint16 port, OpenFlag flag)
 {
-    int sd = 0;
-    QTcpServer server;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    int domain;
+    bool dualStack = false;
 
-    if (!server.listen(address, port)) {
-        tSystemError("Listen failed  port:%d", port);
-        return sd;
-    }
+    memset(&addr, 0, sizeof(addr));
+    if (address.protocol() == QAbstractSocket::IPv6Protocol
+#if QT_VERSION >= 0x050000
+        || address.protocol() == QAbstractSocket::AnyIPProtocol
+#endif
+        ) {
+        // Any address of Qt5 accepts both IPv4 and IPv6
+        struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)&addr;
+        sa6->sin6_family = AF_INET6;
+        sa6->sin6_port = htons(port);
+        if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+            Q_IPV6ADDR ipv6 = address.toIPv6Address();
+            memcpy(&sa6->sin6_addr, &ipv6, sizeof(ipv6));
+        } else {
+            sa6->sin6_addr = in6addr_any;
+            dualStack = true;
+        }
+        addrlen = sizeof(struct sockaddr_in6);
+        domain = AF_INET6;
 
-    sd = ::fcntl(server.socketDescriptor(), F_DUPFD, 0); // duplicate
+    } else if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        struct sockaddr_in *sa = (struct sockaddr_in *)&addr;
+        sa->sin_family = AF_INET;
+        sa->sin_port = htons(port);
+        sa->sin_addr.s_addr = htonl(address.toIPv4Address());
+        addrlen = sizeof(struct sockaddr_in);
+        domain = AF_INET;
 
-    if (flag == CloseOnExec) {
-        ::fcntl(sd, F_SETFD, ::fcntl(sd, F_GETFD) | FD_CLOEXEC);
     } else {
-        ::fcntl(sd, F_SETFD, 0);  // clear
+        tSystemError("Invalid address to listen  port:%d", port);
+        return -1;
     }
-    ::fcntl(sd, F_SETFL, ::fcntl(sd, F_GETFL) | O_NONBLOCK);  // non-block
 
-    server.close();
+    int sd = ::socket(domain, SOCK_STREAM, 0);
+    if (sd < 0 && dualStack) {
+        // IPv6 not available
+        struct sockaddr_in *sa = (struct sockaddr_in *)&addr;
+        memset(&addr, 0, sizeof(addr));
+        sa->sin_family = AF_INET;
+        sa->sin_port = htons(port);
+        sa->sin_addr.s_addr = htonl(INADDR_ANY);
+        addrlen = sizeof(struct sockaddr_in);
+        domain = AF_INET;
+        dualStack = false;
+        sd = ::socket(domain, SOCK_STREAM, 0);
+    }
+    if (sd < 0) {
+        tSystemError("Socket create failed  [%s:%d]", __FILE__, __LINE__);
+        return -1;
+    }
+
+    setDescriptorFlags(sd, flag);
+    if (dualStack) {
+        setIntOption(sd, IPPROTO_IPV6, IPV6_V6ONLY, 0, "IPV6_V6ONLY");
+    }
+    setListenOptions(sd, domain);
+
+    if (::bind(sd, (sockaddr *)&addr, addrlen) < 0) {
+        tSystemError("Bind failed  port:%d errno:%d", port, errno);
+        goto socket_error;
+    }
+
+    if (::listen(sd, listenOptions().backlog) < 0) {
+        tSystemError("Listen failed  port:%d errno:%d", port, errno);
+        goto socket_error;
+    }
+
+    logListenOptions(sd, domain);
     return sd;
+
+socket_error:
+    nativeClose(sd);
+    return -1;
+}
+
+/*!
+  Listen for connections on another socket bound to the same address
+  as the listening socket \a socket, which SO_REUSEPORT must be set to.
+  The kernel distributes the incoming connections among the sockets.
+ */
+int TApplicationServerBase::nativeListenSameAddress(int socket, OpenFlag flag)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+
+    if (::getsockname(socket, (sockaddr *)&addr, &addrlen) < 0) {
+        tSystemError("getsockname error  fd:%d", socket);
+        return -1;
+    }
+
+    quint16 port;
+    if (addr.ss_family == AF_INET6) {
+        port = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+    } else if (addr.ss_family == AF_INET) {
+        port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+    } else {
+        return -1;  // UNIX domain
+    }
+
+    QHostAddress address((sockaddr *)&addr);
+#if QT_VERSION >= 0x050000
+    if (addr.ss_family == AF_INET6 && address == QHostAddress::AnyIPv6
+        && intOption(socket, IPPROTO_IPV6, IPV6_V6ONLY) == 0) {
+        address = QHostAddress::Any;
+    }
+#endif
+    return nativeListen(address, port, flag);
 }
 
 /*!
@@ -74,10 +316,8 @@ int TApplicationServerBase::nativeListen(const QString &fileDomain, OpenFlag fla
         return sd;
     }
 
-    if (flag == CloseOnExec) {
-        ::fcntl(sd, F_SETFD, FD_CLOEXEC); // set close-on-exec flag
-    }
-    ::fcntl(sd, F_SETFL, ::fcntl(sd, F_GETFL) | O_NONBLOCK);  // non-block
+    setDescriptorFlags(sd, flag);
+    setListenOptions(sd, AF_UNIX);
 
     QFile file(fileDomain);
     if (file.exists()) {
@@ -93,11 +333,12 @@ int TApplicationServerBase::nativeListen(const QString &fileDomain, OpenFlag fla
     file.setPermissions((QFile::Permissions)0x777);
 
     // Listen
-    if (::listen(sd, 50) < 0) {
+    if (::listen(sd, listenOptions().backlog) < 0) {
         tSystemError("Listen failed  [%s:%d]", __FILE__, __LINE__);
         goto socket_error;
     }
 
+    logListenOptions(sd, AF_UNIX);
     return sd;
 
 socket_error:
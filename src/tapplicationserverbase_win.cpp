@@ -104,6 +104,13 @@ int TApplicationServerBase::nativeListen(const QString &, OpenFlag)
 }
 
 
+int TApplicationServerBase::nativeListenSameAddress(int, OpenFlag)
+{
+    // SO_REUSEPORT not supported
+    return -1;
+}
+
+
 void TApplicationServerBase::nativeClose(int socket)
 {
     if (socket != (int)INVALID_SOCKET)
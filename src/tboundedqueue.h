@@ -0,0 +1,136 @@
+#ifndef TBOUNDEDQUEUE_H
+#define TBOUNDEDQUEUE_H
+
+#include <QAtomicInt>
+#include <TGlobal>
+
+#if QT_VERSION >= 0x050000
+# define T_ATOMIC_LOAD_ACQUIRE(a)       (a).loadAcquire()
+# define T_ATOMIC_LOAD_RELAXED(a)       (a).load()
+# define T_ATOMIC_STORE_RELEASE(a, v)   (a).storeRelease(v)
+#else
+# define T_ATOMIC_LOAD_ACQUIRE(a)       (a).fetchAndAddAcquire(0)
+# define T_ATOMIC_LOAD_RELAXED(a)       (int)(a)
+# define T_ATOMIC_STORE_RELEASE(a, v)   (a).fetchAndStoreRelease(v)
+#endif
+
+
+/*
+ * Bounded lock-free queue for multiple producers, and a single consumer
+ * or multiple consumers if MultiConsumer is true. The capacity is
+ * rounded up to a power of two.
+ */
+template <class T, bool MultiConsumer = false>
+class TBoundedQueue
+{
+public:
+    TBoundedQueue(int capacity = 4096);
+    ~TBoundedQueue();
+
+    int capacity() const { return mask + 1; }
+    bool enqueue(const T &t);
+    bool dequeue(T &t);
+
+private:
+    struct Cell
+    {
+        QAtomicInt sequence;
+        T data;
+    };
+
+    Cell *cells;
+    int mask;
+    QAtomicInt enqueuePos;
+    QAtomicInt dequeuePos;
+
+    static int diff(int a, int b) { return (int)((uint)a - (uint)b); }
+    static int next(int a) { return (int)((uint)a + 1); }
+
+    Q_DISABLE_COPY(TBoundedQueue)
+};
+
+
+template <class T, bool MultiConsumer>
+inline TBoundedQueue<T, MultiConsumer>::TBoundedQueue(int capacity)
+    : cells(0), mask(0), enqueuePos(0), dequeuePos(0)
+{
+    int size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    cells = new Cell[size];
+    mask = size - 1;
+    for (int i = 0; i < size; ++i) {
+        T_ATOMIC_STORE_RELEASE(cells[i].sequence, i);
+    }
+}
+
+
+template <class T, bool MultiConsumer>
+inline TBoundedQueue<T, MultiConsumer>::~TBoundedQueue()
+{
+    delete[] cells;
+}
+
+/*
+ * Returns false if the queue is full. This function is thread-safe.
+ */
+template <class T, bool MultiConsumer>
+inline bool TBoundedQueue<T, MultiConsumer>::enqueue(const T &t)
+{
+    Cell *cell;
+    int pos = T_ATOMIC_LOAD_RELAXED(enqueuePos);
+
+    for (;;) {
+        cell = &cells[pos & mask];
+        int dif = diff(T_ATOMIC_LOAD_ACQUIRE(cell->sequence), pos);
+        if (dif == 0) {
+            if (enqueuePos.testAndSetRelaxed(pos, next(pos)))
+                break;
+            pos = T_ATOMIC_LOAD_RELAXED(enqueuePos);
+        } else if (dif < 0) {
+            return false;  // full
+        } else {
+            pos = T_ATOMIC_LOAD_RELAXED(enqueuePos);
+        }
+    }
+
+    cell->data = t;
+    T_ATOMIC_STORE_RELEASE(cell->sequence, next(pos));
+    return true;
+}
+
+/*
+ * Returns false if the queue is empty. Unless MultiConsumer is true,
+ * this function must be called by only one consumer thread.
+ */
+template <class T, bool MultiConsumer>
+inline bool TBoundedQueue<T, MultiConsumer>::dequeue(T &t)
+{
+    Cell *cell;
+    int pos = T_ATOMIC_LOAD_RELAXED(dequeuePos);
+
+    for (;;) {
+        cell = &cells[pos & mask];
+        int dif = diff(T_ATOMIC_LOAD_ACQUIRE(cell->sequence), next(pos));
+        if (dif < 0) {
+            return false;  // empty, or being enqueued
+        }
+
+        if (!MultiConsumer) {
+            T_ATOMIC_STORE_RELEASE(dequeuePos, next(pos));  // no contention
+            break;
+        }
+        if (dif == 0 && dequeuePos.testAndSetRelaxed(pos, next(pos))) {
+            break;
+        }
+        pos = T_ATOMIC_LOAD_RELAXED(dequeuePos);
+    }
+
+    t = cell->data;
+    T_ATOMIC_STORE_RELEASE(cell->sequence, (int)((uint)pos + mask + 1));
+    return true;
+}
+
+#endif // TBOUNDEDQUEUE_H
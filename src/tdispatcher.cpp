@@ -0,0 +1,120 @@
+/* Copyright (c) 2013, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QHash>
+#include <QVector>
+#include <QReadWriteLock>
+#include <TDispatcher>
+
+// Indexes of the slots by the name and the number of the QString params
+typedef QHash<QByteArray, QVector<int> > MethodTable;
+
+static QHash<QString, int> typeIdHash;
+static QReadWriteLock typeIdLock;
+static QHash<const QMetaObject *, MethodTable> methodTableHash;
+static QReadWriteLock methodTableLock;
+
+
+static MethodTable createMethodTable(const QMetaObject *metaObject)
+{
+    MethodTable table;
+
+    // From the most derived class, which takes precedence
+    for (int i = metaObject->methodCount() - 1; i >= 0; --i) {
+        QMetaMethod mm = metaObject->method(i);
+        if (mm.methodType() != QMetaMethod::Slot)
+            continue;
+
+        QList<QByteArray> types = mm.parameterTypes();
+        bool valid = true;
+        for (QListIterator<QByteArray> it(types); it.hasNext(); ) {
+            if (it.next() != "QString") {
+                valid = false;
+                break;
+            }
+        }
+        if (!valid)
+            continue;
+
+#if QT_VERSION >= 0x050000
+        QByteArray name = mm.name();
+#else
+        QByteArray name = mm.signature();
+        name.truncate(name.indexOf('('));
+#endif
+        QVector<int> &indexes = table[name];
+        while (indexes.count() <= types.count()) {
+            indexes << -1;
+        }
+        if (indexes[types.count()] < 0) {
+            indexes[types.count()] = i;
+        }
+    }
+    return table;
+}
+
+/*!
+  \class TDispatchTable
+  \brief The TDispatchTable class caches the type IDs of the controllers
+  and views, and the tables of the slots of the controllers, for
+  TDispatcher. The table of a class is created by its first dispatch,
+  so that an action is looked up by a hash.
+*/
+
+/*!
+  Returns the type ID of the meta type \a metaTypeName, or 0 if
+  it's not registered.
+*/
+int TDispatchTable::typeId(const QString &metaTypeName)
+{
+    typeIdLock.lockForRead();
+    int id = typeIdHash.value(metaTypeName);
+    typeIdLock.unlock();
+
+    if (id <= 0) {
+        id = QMetaType::type(metaTypeName.toLatin1().constData());
+        if (id > 0) {
+            QWriteLocker locker(&typeIdLock);
+            typeIdHash.insert(metaTypeName, id);
+        }
+    }
+    return id;
+}
+
+/*!
+  Returns the index of the slot \a method of the \a metaObject which
+  has the most QString parameters up to \a maxParams, and sets the
+  number of them to \a paramCount. Returns -1 if no such slot.
+*/
+int TDispatchTable::methodIndex(const QMetaObject *metaObject, const QByteArray &method, int maxParams, int &paramCount)
+{
+    QVector<int> indexes;
+
+    methodTableLock.lockForRead();
+    QHash<const QMetaObject *, MethodTable>::const_iterator it = methodTableHash.constFind(metaObject);
+    bool found = (it != methodTableHash.constEnd());
+    if (found) {
+        indexes = it.value().value(method);
+    }
+    methodTableLock.unlock();
+
+    if (!found) {
+        MethodTable table = createMethodTable(metaObject);
+        indexes = table.value(method);
+
+        QWriteLocker locker(&methodTableLock);
+        methodTableHash.insert(metaObject, table);
+    }
+
+    for (int i = qMin(maxParams, indexes.count() - 1); i >= 0; --i) {
+        if (indexes[i] >= 0) {
+            paramCount = i;
+            return indexes[i];
+        }
+    }
+    return -1;
+}
@@ -5,10 +5,19 @@
 #include <QMetaMethod>
 #include <QMetaObject>
 #include <QStringList>
+#include <QVarLengthArray>
 #include <TGlobal>
 #include "tsystemglobal.h"
 
 
+class T_CORE_EXPORT TDispatchTable
+{
+public:
+    static int typeId(const QString &metaTypeName);
+    static int methodIndex(const QMetaObject *metaObject, const QByteArray &method, int maxParams, int &paramCount);
+};
+
+
 template <class T>
 class TDispatcher
 {
@@ -56,88 +65,22 @@ inline bool TDispatcher<T>::invoke(const QString &method, const QStringList &arg
     }
 
     int argcnt = 0;
-    int idx = -1;
-    for (int i = args.count(); i >= 0; --i) {
-        // Find method
-        QByteArray mtd = method.toLatin1() + '(';
-        for (int j = 0; j < i; ++j) {
-            if (j > 0) mtd += ',';
-            mtd += "QString";
-        }
-        mtd += ')';
-        mtd = QMetaObject::normalizedSignature(mtd);
-        idx = ptr->metaObject()->indexOfSlot(mtd.constData());
-        if (idx >= 0) {
-            argcnt = i;
-            tSystemDebug("Found method: %s", mtd.constData());
-            break;
-        }
-    }
-
-    bool res = false;
+    int idx = TDispatchTable::methodIndex(ptr->metaObject(), method.toLatin1(), args.count(), argcnt);
     if (idx < 0) {
         tSystemDebug("No such method: %s", qPrintable(method));
         return false;
-    } else {
-        QMetaMethod mm = ptr->metaObject()->method(idx);
-        tSystemDebug("Invoke method: %s", qPrintable(metaType + "#" + method));
-        switch (argcnt) {
-        case 0:
-            res = mm.invoke(ptr, Qt::AutoConnection);
-            break;
-        case 1:
-            res = mm.invoke(ptr, Qt::AutoConnection, Q_ARG(QString, args[0]));
-            break;
-        case 2:
-            res = mm.invoke(ptr, Qt::AutoConnection, Q_ARG(QString, args[0]), Q_ARG(QString, args[1]));
-            break;
-        case 3:
-            res = mm.invoke(ptr, Qt::AutoConnection,
-                            Q_ARG(QString, args[0]), Q_ARG(QString, args[1]), Q_ARG(QString, args[2]));
-            break;
-        case 4:
-            res = mm.invoke(ptr, Qt::AutoConnection,
-                            Q_ARG(QString, args[0]), Q_ARG(QString, args[1]), Q_ARG(QString, args[2]),
-                            Q_ARG(QString, args[3]));
-            break;
-        case 5:
-            res = mm.invoke(ptr, Qt::AutoConnection,
-                            Q_ARG(QString, args[0]), Q_ARG(QString, args[1]), Q_ARG(QString, args[2]),
-                            Q_ARG(QString, args[3]), Q_ARG(QString, args[4]));
-            break;
-        case 6:
-            res = mm.invoke(ptr, Qt::AutoConnection,
-                            Q_ARG(QString, args[0]), Q_ARG(QString, args[1]), Q_ARG(QString, args[2]),
-                            Q_ARG(QString, args[3]), Q_ARG(QString, args[4]), Q_ARG(QString, args[5]));
-            break;
-        case 7:
-            res = mm.invoke(ptr, Qt::AutoConnection,
-                            Q_ARG(QString, args[0]), Q_ARG(QString, args[1]), Q_ARG(QString, args[2]),
-                            Q_ARG(QString, args[3]), Q_ARG(QString, args[4]), Q_ARG(QString, args[5]),
-                            Q_ARG(QString, args[6]));
-            break;
-        case 8:
-            res = mm.invoke(ptr, Qt::AutoConnection,
-                            Q_ARG(QString, args[0]), Q_ARG(QString, args[1]), Q_ARG(QString, args[2]),
-                            Q_ARG(QString, args[3]), Q_ARG(QString, args[4]), Q_ARG(QString, args[5]),
-                            Q_ARG(QString, args[6]), Q_ARG(QString, args[7]));
-            break;
-        case 9:
-            res = mm.invoke(ptr, Qt::AutoConnection,
-                            Q_ARG(QString, args[0]), Q_ARG(QString, args[1]), Q_ARG(QString, args[2]),
-                            Q_ARG(QString, args[3]), Q_ARG(QString, args[4]), Q_ARG(QString, args[5]),
-                            Q_ARG(QString, args[6]), Q_ARG(QString, args[7]), Q_ARG(QString, args[8]));
-            break;
-        default:
-            res = mm.invoke(ptr, Qt::AutoConnection,
-                            Q_ARG(QString, args[0]), Q_ARG(QString, args[1]), Q_ARG(QString, args[2]),
-                            Q_ARG(QString, args[3]), Q_ARG(QString, args[4]), Q_ARG(QString, args[5]),
-                            Q_ARG(QString, args[6]), Q_ARG(QString, args[7]), Q_ARG(QString, args[8]),
-                            Q_ARG(QString, args[9]));
-            break;
-        }
     }
-    return res;
+
+    // Calls the slot directly with the QString arguments
+    QVarLengthArray<void *, 16> argv(argcnt + 1);
+    argv[0] = 0;  // return value, ignored
+    for (int i = 0; i < argcnt; ++i) {
+        argv[i + 1] = const_cast<QString *>(&args[i]);
+    }
+
+    tSystemDebug("Invoke method: %s", qPrintable(metaType + "#" + method));
+    QMetaObject::metacall(ptr, QMetaObject::InvokeMetaMethod, idx, argv.data());
+    return true;
 }
 
 template <class T>
@@ -147,7 +90,7 @@ inline T *TDispatcher<T>::object()
 
     if (!ptr) {
         if (typeId <= 0 && !metaType.isEmpty()) {
-            typeId = QMetaType::type(metaType.toLatin1().constData());
+            typeId = TDispatchTable::typeId(metaType);
             if (typeId > 0) {
 #if QT_VERSION >= 0x050000
                 ptr = static_cast<T *>(QMetaType::create(typeId));
@@ -0,0 +1,150 @@
+#include <TfTest/TfTest>
+#include <THttpResponseHeader>
+#include "thttpcompression.h"
+
+
+class TestHttpCompression : public QObject
+{
+    Q_OBJECT
+private slots:
+    void crc32();
+    void deflate();
+    void gzip();
+    void negotiate_data();
+    void negotiate();
+    void variantHeader();
+    void benchGzip();
+};
+
+
+static QByteArray sampleData()
+{
+    QByteArray data;
+    for (int i = 0; i < 200; ++i) {
+        data += "<tr><td>" + QByteArray::number(i) + "</td><td>TreeFrog Framework</td></tr>\n";
+    }
+    return data;
+}
+
+
+static quint32 uint32LE(const QByteArray &array, int pos)
+{
+    const uchar *p = (const uchar *)array.constData() + pos;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((quint32)p[3] << 24);
+}
+
+
+void TestHttpCompression::crc32()
+{
+    QCOMPARE(THttpCompression::crc32("", 0), (quint32)0);
+    QCOMPARE(THttpCompression::crc32("123456789", 9), (quint32)0xcbf43926);
+
+    // Updated incrementally
+    quint32 crc = THttpCompression::crc32("12345", 5);
+    QCOMPARE(THttpCompression::crc32("6789", 4, crc), (quint32)0xcbf43926);
+}
+
+
+void TestHttpCompression::deflate()
+{
+    QByteArray data = sampleData();
+    QByteArray compressed = THttpCompression::deflate(data);
+    QVERIFY(!compressed.isEmpty());
+    QVERIFY(compressed.length() < data.length());
+    QCOMPARE((uchar)compressed[0] & 0x0f, 8);  // zlib header, deflate
+
+    // qUncompress() needs the length ahead
+    QByteArray length(4, 0);
+    length[0] = (data.length() >> 24) & 0xff;
+    length[1] = (data.length() >> 16) & 0xff;
+    length[2] = (data.length() >> 8) & 0xff;
+    length[3] = data.length() & 0xff;
+    QCOMPARE(qUncompress(length + compressed), data);
+}
+
+
+void TestHttpCompression::gzip()
+{
+    QByteArray data = sampleData();
+    QByteArray gz = THttpCompression::gzip(data);
+    QVERIFY(gz.length() > 18);
+    QCOMPARE((uchar)gz[0], (uchar)0x1f);
+    QCOMPARE((uchar)gz[1], (uchar)0x8b);
+    QCOMPARE((int)gz[2], 8);
+
+    // Raw deflate data of the zlib stream
+    QByteArray zlib = THttpCompression::deflate(data);
+    QCOMPARE(gz.mid(10, gz.length() - 18), zlib.mid(2, zlib.length() - 6));
+
+    QCOMPARE(uint32LE(gz, gz.length() - 8), THttpCompression::crc32(data.constData(), data.length()));
+    QCOMPARE(uint32LE(gz, gz.length() - 4), (quint32)data.length());
+}
+
+
+void TestHttpCompression::negotiate_data()
+{
+    QTest::addColumn<QByteArray>("acceptEncoding");
+    QTest::addColumn<QByteArray>("coding");
+
+    QTest::newRow("1") << QByteArray("gzip, deflate") << QByteArray("gzip");
+    QTest::newRow("2") << QByteArray("deflate") << QByteArray("deflate");
+    QTest::newRow("3") << QByteArray("gzip;q=0, deflate;q=0.5") << QByteArray("deflate");
+    QTest::newRow("4") << QByteArray("identity") << QByteArray();
+    QTest::newRow("5") << QByteArray("*") << QByteArray("gzip");
+    QTest::newRow("6") << QByteArray("*;q=0") << QByteArray();
+    QTest::newRow("7") << QByteArray("br, x-gzip") << QByteArray("gzip");
+    QTest::newRow("8") << QByteArray("GZIP ; q=1.0") << QByteArray("gzip");
+    QTest::newRow("9") << QByteArray() << QByteArray();
+}
+
+
+void TestHttpCompression::negotiate()
+{
+    QFETCH(QByteArray, acceptEncoding);
+    QFETCH(QByteArray, coding);
+
+    QCOMPARE(THttpCompression::negotiate(acceptEncoding), coding);
+}
+
+
+void TestHttpCompression::variantHeader()
+{
+    QByteArray etag = "\"51a9e2c0-3e8\"";
+
+    THttpResponseHeader identity;
+    THttpCompression::setVariantHeader(identity, Tf::OK, false, false, etag);
+    QVERIFY(!identity.hasRawHeader("Vary"));
+    QVERIFY(!identity.hasRawHeader("Content-Encoding"));
+    QCOMPARE(identity.rawHeader("ETag"), etag);
+
+    THttpResponseHeader plain;
+    THttpCompression::setVariantHeader(plain, Tf::OK, true, false, etag);
+    QCOMPARE(plain.rawHeader("Vary"), QByteArray("Accept-Encoding"));
+    QVERIFY(!plain.hasRawHeader("Content-Encoding"));
+    QCOMPARE(plain.rawHeader("ETag"), etag);
+
+    THttpResponseHeader gzip;
+    THttpCompression::setVariantHeader(gzip, Tf::OK, true, true, etag);
+    QCOMPARE(gzip.rawHeader("Vary"), QByteArray("Accept-Encoding"));
+    QCOMPARE(gzip.rawHeader("Content-Encoding"), QByteArray("gzip"));
+    QCOMPARE(gzip.rawHeader("ETag"), "W/" + etag);
+
+    THttpResponseHeader notModified;
+    THttpCompression::setVariantHeader(notModified, Tf::NotModified, true, true, etag);
+    QVERIFY(!notModified.hasRawHeader("Content-Encoding"));
+    QCOMPARE(notModified.rawHeader("ETag"), "W/" + etag);
+}
+
+
+void TestHttpCompression::benchGzip()
+{
+    QByteArray data = sampleData();
+
+    QBENCHMARK {
+        THttpCompression::gzip(data, 6);
+    }
+}
+
+
+TF_TEST_MAIN(TestHttpCompression)
+#include "main.moc"
@@ -0,0 +1,190 @@
+#include <TfTest/TfTest>
+#include <QTemporaryFile>
+#include <THttpRequestHeader>
+#include <THttpUtility>
+#include "thttprangefile.h"
+
+
+class TestHttpRange : public QObject
+{
+    Q_OBJECT
+private slots:
+    void parseRange_data();
+    void parseRange();
+    void ifRange();
+    void ifNoneMatch_data();
+    void ifNoneMatch();
+    void readSingleRange();
+    void readMultipleRanges();
+};
+
+
+static QByteArray toString(const QList<QPair<qint64, qint64> > &ranges)
+{
+    QByteArray str;
+    for (int i = 0; i < ranges.count(); ++i) {
+        if (i > 0)
+            str += ',';
+        str += QByteArray::number(ranges[i].first) + '-' + QByteArray::number(ranges[i].second);
+    }
+    return str;
+}
+
+
+void TestHttpRange::parseRange_data()
+{
+    QTest::addColumn<QByteArray>("range");
+    QTest::addColumn<int>("status");
+    QTest::addColumn<QByteArray>("ranges");
+
+    // File of 1000 bytes
+    QTest::newRow("1") << QByteArray("bytes=0-499") << (int)Tf::PartialContent << QByteArray("0-499");
+    QTest::newRow("2") << QByteArray("bytes=500-") << (int)Tf::PartialContent << QByteArray("500-999");
+    QTest::newRow("3") << QByteArray("bytes=-200") << (int)Tf::PartialContent << QByteArray("800-999");
+    QTest::newRow("4") << QByteArray("bytes=900-2000") << (int)Tf::PartialContent << QByteArray("900-999");
+    QTest::newRow("5") << QByteArray("bytes=-2000") << (int)Tf::PartialContent << QByteArray("0-999");
+    QTest::newRow("6") << QByteArray("bytes=0-0, 10-19 ,-1") << (int)Tf::PartialContent << QByteArray("0-0,10-19,999-999");
+    QTest::newRow("7") << QByteArray("Bytes=1-2") << (int)Tf::PartialContent << QByteArray("1-2");
+    QTest::newRow("8") << QByteArray("bytes=1000-") << (int)Tf::RequestedRangeNotSatisfiable << QByteArray();
+    QTest::newRow("9") << QByteArray("bytes=-0") << (int)Tf::RequestedRangeNotSatisfiable << QByteArray();
+    QTest::newRow("10") << QByteArray("bytes=2000-3000,5-4000") << (int)Tf::PartialContent << QByteArray("5-999");
+    QTest::newRow("11") << QByteArray("bytes=5-4") << (int)Tf::OK << QByteArray();
+    QTest::newRow("12") << QByteArray("bytes=a-b") << (int)Tf::OK << QByteArray();
+    QTest::newRow("13") << QByteArray("bytes=+1-2") << (int)Tf::OK << QByteArray();
+    QTest::newRow("14") << QByteArray("items=0-1") << (int)Tf::OK << QByteArray();
+    QTest::newRow("15") << QByteArray("bytes=") << (int)Tf::OK << QByteArray();
+    QTest::newRow("16") << QByteArray("bytes=0-599,400-999") << (int)Tf::OK << QByteArray();  // overlapping
+}
+
+
+void TestHttpRange::parseRange()
+{
+    QFETCH(QByteArray, range);
+    QFETCH(int, status);
+    QFETCH(QByteArray, ranges);
+
+    QList<QPair<qint64, qint64> > list;
+    QCOMPARE(THttpRangeFile::parseRange(range, 1000, list), status);
+    QCOMPARE(toString(list), ranges);
+}
+
+
+void TestHttpRange::ifRange()
+{
+    QByteArray lastModified = "Sat, 01 Jun 2013 12:00:00 GMT";
+    QByteArray etag = "\"51a9e2c0-3e8\"";
+    QList<QPair<qint64, qint64> > ranges;
+
+    THttpRequestHeader header;
+    QCOMPARE(THttpRangeFile::evaluate(header, 1000, lastModified, etag, ranges), (int)Tf::OK);
+
+    header.setRawHeader("Range", "bytes=0-9");
+    QCOMPARE(THttpRangeFile::evaluate(header, 1000, lastModified, etag, ranges), (int)Tf::PartialContent);
+
+    header.setRawHeader("If-Range", etag);
+    QCOMPARE(THttpRangeFile::evaluate(header, 1000, lastModified, etag, ranges), (int)Tf::PartialContent);
+    header.setRawHeader("If-Range", "\"51a9e2c0-3e9\"");
+    QCOMPARE(THttpRangeFile::evaluate(header, 1000, lastModified, etag, ranges), (int)Tf::OK);
+    header.setRawHeader("If-Range", "W/" + etag);
+    QCOMPARE(THttpRangeFile::evaluate(header, 1000, lastModified, "W/" + etag, ranges), (int)Tf::OK);
+
+    header.setRawHeader("If-Range", lastModified);
+    QCOMPARE(THttpRangeFile::evaluate(header, 1000, lastModified, etag, ranges), (int)Tf::PartialContent);
+    header.setRawHeader("If-Range", "Sat, 01 Jun 2013 12:00:01 GMT");
+    QCOMPARE(THttpRangeFile::evaluate(header, 1000, lastModified, etag, ranges), (int)Tf::OK);
+}
+
+
+void TestHttpRange::ifNoneMatch_data()
+{
+    QTest::addColumn<QByteArray>("ifNoneMatch");
+    QTest::addColumn<bool>("match");
+
+    QTest::newRow("1") << QByteArray("\"51a9e2c0-3e8\"") << true;
+    QTest::newRow("2") << QByteArray("W/\"51a9e2c0-3e8\"") << true;
+    QTest::newRow("3") << QByteArray("*") << true;
+    QTest::newRow("4") << QByteArray("\"51a9e2c0-3e9\"") << false;
+    QTest::newRow("5") << QByteArray("\"a\", \"51a9e2c0-3e8\"") << true;
+    QTest::newRow("6") << QByteArray("\"a\",W/\"51a9e2c0-3e8\" ,\"b\"") << true;
+    QTest::newRow("7") << QByteArray("\"a\", \"b\"") << false;
+    QTest::newRow("8") << QByteArray("\"a,\"51a9e2c0-3e8\"\"") << false;
+    QTest::newRow("9") << QByteArray("51a9e2c0-3e8") << false;
+    QTest::newRow("10") << QByteArray("\"51a9e2c0-3e8") << false;
+}
+
+
+void TestHttpRange::ifNoneMatch()
+{
+    QFETCH(QByteArray, ifNoneMatch);
+    QFETCH(bool, match);
+
+    QByteArray etag = "\"51a9e2c0-3e8\"";
+    QCOMPARE(THttpUtility::matchesEntityTag(ifNoneMatch, etag), match);
+    QCOMPARE(THttpUtility::matchesEntityTag(ifNoneMatch, "W/" + etag), match);
+}
+
+
+void TestHttpRange::readSingleRange()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write("0123456789abcdefghij");
+    file.flush();
+
+    QList<QPair<qint64, qint64> > ranges;
+    ranges << qMakePair(Q_INT64_C(5), Q_INT64_C(14));
+    THttpRangeFile rangeFile(file.fileName(), ranges, "text/plain", 20);
+    QCOMPARE(rangeFile.contentType(), QByteArray("text/plain"));
+    QCOMPARE(rangeFile.contentRange(), QByteArray("bytes 5-14/20"));
+    QCOMPARE(rangeFile.size(), Q_INT64_C(10));
+    QCOMPARE(rangeFile.extract("0123456789abcdefghij"), QByteArray("56789abcde"));
+
+    QVERIFY(rangeFile.open(QIODevice::ReadOnly));
+    QCOMPARE(rangeFile.readAll(), QByteArray("56789abcde"));
+    QVERIFY(rangeFile.atEnd());
+}
+
+
+void TestHttpRange::readMultipleRanges()
+{
+    QByteArray data = "0123456789abcdefghij";
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(data);
+    file.flush();
+
+    QList<QPair<qint64, qint64> > ranges;
+    ranges << qMakePair(Q_INT64_C(0), Q_INT64_C(1)) << qMakePair(Q_INT64_C(18), Q_INT64_C(19));
+    THttpRangeFile rangeFile(file.fileName(), ranges, "text/plain", 20);
+    QVERIFY(rangeFile.contentType().startsWith("multipart/byteranges; boundary="));
+    QVERIFY(rangeFile.contentRange().isEmpty());
+
+    QByteArray boundary = rangeFile.contentType().mid(rangeFile.contentType().indexOf('=') + 1);
+    QByteArray expected = "--" + boundary + "\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Range: bytes 0-1/20\r\n"
+        "\r\n"
+        "01\r\n"
+        "--" + boundary + "\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Range: bytes 18-19/20\r\n"
+        "\r\n"
+        "ij\r\n"
+        "--" + boundary + "--\r\n";
+    QCOMPARE(rangeFile.size(), (qint64)expected.length());
+    QCOMPARE(rangeFile.extract(data), expected);
+
+    // Read in small pieces
+    QVERIFY(rangeFile.open(QIODevice::ReadOnly));
+    QByteArray body;
+    char buf[7];
+    qint64 len;
+    while ((len = rangeFile.read(buf, sizeof(buf))) > 0) {
+        body.append(buf, len);
+    }
+    QCOMPARE(body, expected);
+}
+
+
+TF_TEST_MAIN(TestHttpRange)
+#include "main.moc"
@@ -0,0 +1,301 @@
+#include <TfTest/TfTest>
+#include <THttpRequestHeader>
+#include "thttprequestparser.h"
+
+
+class TestHttpRequestParser : public QObject
+{
+    Q_OBJECT
+private slots:
+    void parse_data();
+    void parse();
+    void parseIncrementally_data();
+    void parseIncrementally();
+    void keepAlive_data();
+    void keepAlive();
+    void invalidRequest_data();
+    void invalidRequest();
+    void limitBody();
+    void requestLine();
+    void fuzz();
+    void benchParse();
+    void benchHeaderConstructor();
+};
+
+
+static const char sampleRequest[] =
+    "GET /blog/index?page=2 HTTP/1.1\r\n"
+    "Host: localhost:8800\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:24.0) Gecko/20100101 Firefox/24.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: ja,en-us;q=0.7,en;q=0.3\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Cookie: TFSESSION=d6c6bdbc5fa4b65d8f5e1fc6c4bbcf3c3d6f8c08\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+
+void TestHttpRequestParser::parse_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("1") << QByteArray(sampleRequest);
+    QTest::newRow("2") << QByteArray(
+        "POST /blog/create HTTP/1.0\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: 13\r\n"
+        "\r\n"
+        "title=foo&a=b");
+    QTest::newRow("3") << QByteArray(
+        "GET / HTTP/1.1\r\n"
+        "Received: fr\r\n"
+        " by hoge.hoge.123.com\r\n"
+        "\tby hoge.hoga.com\r\n"
+        "X-Empty:\r\n"
+        "X-Spaces :   a  b   \r\n"
+        "\r\n");
+    QTest::newRow("4") << QByteArray(
+        "PUT /foo%20bar?x=1 HTTP/1.1\r\n"
+        "content-length: 0\r\n"
+        "\r\n");
+}
+
+
+void TestHttpRequestParser::parse()
+{
+    QFETCH(QByteArray, data);
+
+    THttpRequestParser parser(0);
+    QVERIFY(parser.parse(data));
+
+    int idx = data.indexOf("\r\n\r\n");
+    QCOMPARE(parser.headerLength(), idx + 4);
+    QCOMPARE(parser.requestLength(), (qint64)data.length());
+
+    // Compares with the header parsed by THttpRequestHeader
+    THttpRequestHeader expected(data.left(idx + 4));
+    THttpRequestHeader actual = parser.header(data);
+    QCOMPARE(actual.method(), expected.method());
+    QCOMPARE(actual.path(), expected.path());
+    QCOMPARE(actual.majorVersion(), expected.majorVersion());
+    QCOMPARE(actual.minorVersion(), expected.minorVersion());
+    QCOMPARE(actual.rawHeaderList(), expected.rawHeaderList());
+    QCOMPARE(actual.toByteArray(), expected.toByteArray());
+    QCOMPARE(parser.contentLength(), (qint64)expected.contentLength());
+}
+
+
+void TestHttpRequestParser::parseIncrementally_data()
+{
+    parse_data();
+}
+
+/*
+  Feeds the data in chunks of random size; the result must be the same
+  as the one parsed at once.
+*/
+void TestHttpRequestParser::parseIncrementally()
+{
+    QFETCH(QByteArray, data);
+
+    THttpRequestParser whole(0);
+    QVERIFY(whole.parse(data));
+    QByteArray expected = whole.header(data).toByteArray();
+
+    qsrand(1);
+    for (int n = 0; n < 100; ++n) {
+        THttpRequestParser parser(0);
+        QByteArray buffer;
+        int pos = 0;
+        bool completed = false;
+
+        while (pos < data.length()) {
+            int len = qMin(qrand() % 16 + 1, data.length() - pos);
+            buffer.append(data.constData() + pos, len);
+            pos += len;
+
+            completed = parser.parse(buffer);
+            if (completed) {
+                QVERIFY(pos >= parser.headerLength());
+                break;
+            }
+        }
+
+        QVERIFY(completed);
+        buffer.append(data.mid(pos));
+        QCOMPARE(parser.requestLength(), whole.requestLength());
+        QCOMPARE(parser.header(buffer).toByteArray(), expected);
+    }
+}
+
+
+void TestHttpRequestParser::keepAlive_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("keepAlive");
+
+    QTest::newRow("1") << QByteArray("GET / HTTP/1.1\r\n\r\n") << true;
+    QTest::newRow("2") << QByteArray("GET / HTTP/1.1\r\nConnection: close\r\n\r\n") << false;
+    QTest::newRow("3") << QByteArray("GET / HTTP/1.0\r\n\r\n") << false;
+    QTest::newRow("4") << QByteArray("GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n") << true;
+    QTest::newRow("5") << QByteArray("\r\nGET / HTTP/1.1\nConnection: Close\n\n") << false;
+}
+
+
+void TestHttpRequestParser::keepAlive()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, keepAlive);
+
+    THttpRequestParser parser(0);
+    QVERIFY(parser.parse(data));
+    QCOMPARE(parser.isKeepAliveRequested(), keepAlive);
+}
+
+
+void TestHttpRequestParser::invalidRequest_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("statusCode");
+
+    QTest::newRow("1") << QByteArray("GET\r\n\r\n") << 400;
+    QTest::newRow("2") << QByteArray(" / HTTP/1.1\r\n\r\n") << 400;
+    QTest::newRow("3") << QByteArray("GET / HTTP/1.1\r\nContent-Length: abc\r\n\r\n") << 400;
+    QTest::newRow("4") << QByteArray("GET / HTTP/1.1\r\nContent-Length: -1\r\n\r\n") << 400;
+    QTest::newRow("5") << QByteArray("GET / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n") << 400;
+    QTest::newRow("6") << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n") << 501;
+    QTest::newRow("7") << QByteArray("POST / HTTP/1.1\r\nContent-Length: 5\r\ntransfer-encoding: chunked\r\n\r\n0\r\n\r\n") << 400;
+    QTest::newRow("8") << QByteArray("GET /" + QByteArray(9000, 'a') + " HTTP/1.1\r\n\r\n") << 414;
+    QTest::newRow("9") << QByteArray("GET / HTTP/1.1\r\nX-Foo: " + QByteArray(9000, 'a') + "\r\n\r\n") << 431;
+    QTest::newRow("10") << QByteArray("GET / HTTP/1.1\r\n" + QByteArray("X-Foo: a\r\n").repeated(101) + "\r\n") << 431;
+    QTest::newRow("11") << QByteArray("GET / HTTP/1.1\r\n" + QByteArray("X-Foo: " + QByteArray(8000, 'a') + "\r\n").repeated(9)) << 431;
+    QTest::newRow("12") << QByteArray("GET /" + QByteArray(9000, 'a')) << 414;  // not terminated
+}
+
+
+void TestHttpRequestParser::invalidRequest()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, statusCode);
+
+    THttpRequestParser parser(0);
+    int actual = 0;
+    try {
+        parser.parse(data);
+    } catch (ClientErrorException &e) {
+        actual = e.statusCode();
+    }
+    QCOMPARE(actual, statusCode);
+}
+
+/*
+  An oversize body must be rejected as soon as the header is complete.
+*/
+void TestHttpRequestParser::limitBody()
+{
+    QByteArray data("POST / HTTP/1.1\r\nContent-Length: 1025\r\n\r\n");
+    THttpRequestParser parser(1024);
+    int statusCode = 0;
+    try {
+        parser.parse(data);
+    } catch (ClientErrorException &e) {
+        statusCode = e.statusCode();
+    }
+    QCOMPARE(statusCode, 413);
+
+    THttpRequestParser parser2(1025);
+    QVERIFY(parser2.parse(data));
+    QCOMPARE(parser2.contentLength(), (qint64)1025);
+}
+
+
+void TestHttpRequestParser::requestLine()
+{
+    QByteArray data("\r\nGET /blog/index?page=2 HTTP/1.1\r\nHost: localhost\r\n");
+    THttpRequestParser parser(0);
+    QVERIFY(parser.requestLine(data).isEmpty());
+
+    QVERIFY(!parser.parse(data));
+    QCOMPARE(parser.requestLine(data), QByteArray("GET /blog/index?page=2 HTTP/1.1"));
+    QCOMPARE(parser.path(data), QByteArray("/blog/index"));
+
+    data = "PUT /foo HTTP/1.0\n\n";
+    parser.reset();
+    QVERIFY(parser.parse(data));
+    QCOMPARE(parser.requestLine(data), QByteArray("PUT /foo HTTP/1.0"));
+    QCOMPARE(parser.path(data), QByteArray("/foo"));
+}
+
+/*
+  Random data must be parsed or rejected without crashing.
+*/
+void TestHttpRequestParser::fuzz()
+{
+    static const char chars[] = "GET / HTTP/1.1:\r\n\t abcContent-Length0123456789";
+    QByteArray base(sampleRequest);
+
+    qsrand(2);
+    for (int n = 0; n < 20000; ++n) {
+        QByteArray data;
+        if (n % 2) {
+            // Random bytes
+            data.resize(qrand() % 256);
+            for (int i = 0; i < data.length(); ++i) {
+                data[i] = chars[qrand() % (sizeof(chars) - 1)];
+            }
+        } else {
+            // Mutated request
+            data = base;
+            for (int i = 0; i < 8; ++i) {
+                data[qrand() % data.length()] = chars[qrand() % (sizeof(chars) - 1)];
+            }
+        }
+
+        THttpRequestParser parser(0);
+        QByteArray buffer;
+        try {
+            for (int pos = 0; pos < data.length(); ) {
+                int len = qMin(qrand() % 32 + 1, data.length() - pos);
+                buffer.append(data.constData() + pos, len);
+                pos += len;
+                if (parser.parse(buffer)) {
+                    QVERIFY(parser.headerLength() <= buffer.length());
+                    parser.header(buffer);
+                    break;
+                }
+            }
+        } catch (ClientErrorException &e) {
+            QCOMPARE(e.statusCode(), 400);
+        }
+    }
+}
+
+
+void TestHttpRequestParser::benchParse()
+{
+    QByteArray data(sampleRequest);
+
+    QBENCHMARK {
+        THttpRequestParser parser(0);
+        parser.parse(data);
+        THttpRequestHeader header = parser.header(data);
+    }
+}
+
+/*
+  The way used before the parser, for comparison
+*/
+void TestHttpRequestParser::benchHeaderConstructor()
+{
+    QByteArray data(sampleRequest);
+
+    QBENCHMARK {
+        int idx = data.indexOf("\r\n\r\n");
+        THttpRequestHeader header(data.left(idx + 4));
+        header.contentLength();
+    }
+}
+
+
+TF_TEST_MAIN(TestHttpRequestParser)
+#include "main.moc"
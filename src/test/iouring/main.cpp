@@ -0,0 +1,398 @@
+#include <TfTest/TfTest>
+#include <QHash>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include "tiouring.h"
+
+#if QT_VERSION >= 0x050000
+# define SKIP_TEST(msg)  QSKIP(msg)
+#else
+# define SKIP_TEST(msg)  QSKIP(msg, SkipSingle)
+#endif
+
+static const QByteArray request = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+static const QByteArray response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+
+enum Operation {
+    Ignored = 0,
+    Accept,
+    Recv,
+};
+
+/*
+  Both the backends of the reactors respond the requests of the clients
+  on the loopback in the same way: the requests are received by recv()
+  or the multishot recv into the buffers provided, and the responses are
+  sent by send() directly.
+*/
+class TestIoUring : public QObject
+{
+    Q_OBJECT
+private slots:
+    void init();
+    void cleanup();
+    void acceptAndRecv();
+    void recvMoreThanBuffer();
+    void linkedClose();
+    void benchRequests_data();
+    void benchRequests();
+
+private:
+    bool listenLoopback();
+    bool connectClients(int count);
+    bool acceptByUring(int count);
+    bool acceptByEpoll(int count);
+    bool respondByUring(int count);
+    bool respondByEpoll(int count);
+    bool readResponses();
+
+    TIoUring *uring;
+    int epollFd;
+    int listenSocket;
+    struct sockaddr_in address;
+    QList<int> clients;
+    QList<int> servers;
+    QHash<int, int> received;  // bytes of the request received, by fd
+};
+
+
+void TestIoUring::init()
+{
+    uring = 0;
+    epollFd = -1;
+    listenSocket = -1;
+    clients.clear();
+    servers.clear();
+    received.clear();
+}
+
+
+void TestIoUring::cleanup()
+{
+    delete uring;
+    uring = 0;
+    for (int i = 0; i < clients.count(); ++i) {
+        ::close(clients[i]);
+    }
+    for (int i = 0; i < servers.count(); ++i) {
+        ::close(servers[i]);
+    }
+    if (epollFd >= 0) {
+        ::close(epollFd);
+    }
+    if (listenSocket >= 0) {
+        ::close(listenSocket);
+    }
+}
+
+
+bool TestIoUring::listenLoopback()
+{
+    listenSocket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t len = sizeof(address);
+    return listenSocket >= 0 && ::bind(listenSocket, (sockaddr *)&address, sizeof(address)) == 0
+        && ::listen(listenSocket, 1024) == 0 && ::getsockname(listenSocket, (sockaddr *)&address, &len) == 0;
+}
+
+
+bool TestIoUring::connectClients(int count)
+{
+    for (int i = 0; i < count; ++i) {
+        int sd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sd < 0)
+            return false;
+
+        clients << sd;
+        if (::connect(sd, (sockaddr *)&address, sizeof(address)) < 0)
+            return false;
+    }
+    return true;
+}
+
+
+bool TestIoUring::acceptByUring(int count)
+{
+    if (!uring->prepareAccept(listenSocket, Accept))
+        return false;
+
+    while (servers.count() < count) {
+        if (uring->submitAndWait(1000) < 0)
+            return false;
+
+        quint64 data;
+        int res;
+        uint flags;
+        bool completed = false;
+        while (uring->nextCompletion(data, res, flags)) {
+            completed = true;
+            if (data != Accept || res < 0)
+                return false;
+
+            servers << res;
+            if (!uring->prepareRecv(res, 0, ((quint64)Recv << 32) | res))
+                return false;
+        }
+        if (!completed)
+            return false;  // timed out
+    }
+    return true;
+}
+
+
+bool TestIoUring::acceptByEpoll(int count)
+{
+    epollFd = ::epoll_create(1);
+    while (servers.count() < count) {
+        int sd = ::accept4(listenSocket, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sd < 0)
+            return false;
+
+        servers << sd;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = sd;
+        if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, sd, &ev) < 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+  Responds the \a count requests received by the multishot recv.
+*/
+bool TestIoUring::respondByUring(int count)
+{
+    int responded = 0;
+    while (responded < count) {
+        if (uring->submitAndWait(1000) < 0)
+            return false;
+
+        quint64 data;
+        int res;
+        uint flags;
+        bool completed = false;
+        while (uring->nextCompletion(data, res, flags)) {
+            completed = true;
+            int fd = (int)(uint)data;
+            int bid = TIoUring::bufferId(flags);
+            if ((data >> 32) != Recv || (res <= 0 && res != -ENOBUFS))
+                return false;
+
+            if (res > 0) {
+                int &len = received[fd];
+                len += res;
+                for (; len >= request.length(); len -= request.length()) {
+                    if (::send(fd, response.constData(), response.length(), 0) != response.length())
+                        return false;
+                    ++responded;
+                }
+                uring->recycleBuffer(bid);
+            }
+            if (!TIoUring::hasMore(flags)) {
+                uring->prepareRecv(fd, 0, data);
+            }
+        }
+        if (!completed)
+            return false;  // timed out
+    }
+    return true;
+}
+
+/*
+  Responds the \a count requests received by recv() on the epoll events.
+*/
+bool TestIoUring::respondByEpoll(int count)
+{
+    const int MaxEvents = 128;
+    struct epoll_event events[MaxEvents];
+    char buffer[16384];
+
+    int responded = 0;
+    while (responded < count) {
+        int nfd = ::epoll_wait(epollFd, events, MaxEvents, 1000);
+        if (nfd <= 0)
+            return false;
+
+        for (int i = 0; i < nfd; ++i) {
+            int fd = events[i].data.fd;
+            int res = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (res < 0 && errno == EAGAIN)
+                continue;
+            if (res <= 0)
+                return false;
+
+            int &len = received[fd];
+            len += res;
+            for (; len >= request.length(); len -= request.length()) {
+                if (::send(fd, response.constData(), response.length(), 0) != response.length())
+                    return false;
+                ++responded;
+            }
+        }
+    }
+    return true;
+}
+
+
+bool TestIoUring::readResponses()
+{
+    char buffer[256];
+    for (int i = 0; i < clients.count(); ++i) {
+        int len = 0;
+        while (len < response.length()) {
+            int res = ::recv(clients[i], buffer + len, response.length() - len, 0);
+            if (res <= 0)
+                return false;
+            len += res;
+        }
+        if (QByteArray(buffer, len) != response)
+            return false;
+    }
+    return true;
+}
+
+
+void TestIoUring::acceptAndRecv()
+{
+    if (!TIoUring::isSupported())
+        SKIP_TEST("io_uring not supported");
+
+    uring = new TIoUring;
+    QVERIFY(uring->setup(64, 256));
+    QVERIFY(uring->setupBuffers(0, 16, 1024));
+    QVERIFY(listenLoopback());
+    QVERIFY(connectClients(3));
+    QVERIFY(acceptByUring(3));
+
+    for (int i = 0; i < clients.count(); ++i) {
+        QCOMPARE((int)::send(clients[i], request.constData(), request.length(), 0), request.length());
+    }
+    QVERIFY(respondByUring(3));
+    QVERIFY(readResponses());
+}
+
+
+void TestIoUring::recvMoreThanBuffer()
+{
+    if (!TIoUring::isSupported())
+        SKIP_TEST("io_uring not supported");
+
+    // The requests are received into the buffers of 16 bytes
+    uring = new TIoUring;
+    QVERIFY(uring->setup(64, 256));
+    QVERIFY(uring->setupBuffers(0, 4, 16));
+    QVERIFY(listenLoopback());
+    QVERIFY(connectClients(1));
+    QVERIFY(acceptByUring(1));
+
+    QByteArray requests = request + request + request;
+    QCOMPARE((int)::send(clients[0], requests.constData(), requests.length(), 0), requests.length());
+    QVERIFY(respondByUring(3));
+
+    char buffer[256];
+    int len = 0;
+    while (len < response.length() * 3) {
+        int res = ::recv(clients[0], buffer + len, sizeof(buffer) - len, 0);
+        QVERIFY(res > 0);
+        len += res;
+    }
+    QCOMPARE(QByteArray(buffer, len), response + response + response);
+}
+
+
+void TestIoUring::linkedClose()
+{
+    if (!TIoUring::isSupported())
+        SKIP_TEST("io_uring not supported");
+
+    uring = new TIoUring;
+    QVERIFY(uring->setup(64, 256));
+    QVERIFY(uring->setupBuffers(0, 16, 1024));
+    QVERIFY(listenLoopback());
+    QVERIFY(connectClients(1));
+    QVERIFY(acceptByUring(1));
+
+    // Cancels the recv, and then closes the socket
+    int fd = servers.takeFirst();
+    QVERIFY(uring->prepareCancel(fd, true, Ignored));
+    QVERIFY(uring->prepareClose(fd, Ignored));
+    QVERIFY(uring->submit() >= 2);
+
+    char c;
+    QCOMPARE((int)::recv(clients[0], &c, 1, 0), 0);  // closed by the peer
+
+    bool cancelled = false;
+    for (int i = 0; i < 10 && !cancelled; ++i) {
+        quint64 data;
+        int res;
+        uint flags;
+        while (uring->nextCompletion(data, res, flags)) {
+            if ((data >> 32) == Recv) {
+                QCOMPARE(res, -ECANCELED);
+                cancelled = true;
+            }
+        }
+        uring->submitAndWait(100);
+    }
+    QVERIFY(cancelled);
+}
+
+
+void TestIoUring::benchRequests_data()
+{
+    QTest::addColumn<bool>("useUring");
+    QTest::addColumn<int>("connections");
+
+    QTest::newRow("epoll 1") << false << 1;
+    QTest::newRow("io_uring 1") << true << 1;
+    QTest::newRow("epoll 16") << false << 16;
+    QTest::newRow("io_uring 16") << true << 16;
+    QTest::newRow("epoll 256") << false << 256;
+    QTest::newRow("io_uring 256") << true << 256;
+}
+
+/*
+  A request on each connection, and the response; compares the backends
+  on the same hardware.
+*/
+void TestIoUring::benchRequests()
+{
+    QFETCH(bool, useUring);
+    QFETCH(int, connections);
+
+    if (useUring && !TIoUring::isSupported())
+        SKIP_TEST("io_uring not supported");
+
+    QVERIFY(listenLoopback());
+    QVERIFY(connectClients(connections));
+    if (useUring) {
+        uring = new TIoUring;
+        QVERIFY(uring->setup(1024, 8192));
+        QVERIFY(uring->setupBuffers(0, 1024, 16384));
+        QVERIFY(acceptByUring(connections));
+    } else {
+        QVERIFY(acceptByEpoll(connections));
+    }
+
+    QBENCHMARK {
+        for (int i = 0; i < clients.count(); ++i) {
+            ::send(clients[i], request.constData(), request.length(), 0);
+        }
+        bool ok = (useUring) ? respondByUring(connections) : respondByEpoll(connections);
+        QVERIFY(ok);
+        QVERIFY(readResponses());
+    }
+}
+
+
+TF_TEST_MAIN(TestIoUring)
+#include "main.moc"
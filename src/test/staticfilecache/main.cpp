@@ -0,0 +1,164 @@
+#include <TfTest/TfTest>
+#include <QDir>
+#include <QFile>
+#include "tstaticfilecache.h"
+
+
+class TestStaticFileCache : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void load();
+    void largeFile();
+    void invalidPath();
+    void invalidate();
+    void invalidateDirectory();
+    void evict();
+
+private:
+    void writeFile(const QString &path, const QByteArray &data);
+
+    QString root;
+};
+
+
+void TestStaticFileCache::initTestCase()
+{
+    root = QDir::tempPath() + "/tf_staticfilecache_" + QString::number(QCoreApplication::applicationPid()) + "/";
+    QDir().mkpath(root + "css");
+}
+
+
+void TestStaticFileCache::cleanupTestCase()
+{
+    QFile::remove(root + "a.txt");
+    QFile::remove(root + "large.txt");
+    QFile::remove(root + "css/b.css");
+    QFile::remove(root + "moved/b.css");
+    QDir(root).rmdir("css");
+    QDir(root).rmdir("moved");
+    QDir().rmdir(root);
+}
+
+
+void TestStaticFileCache::writeFile(const QString &path, const QByteArray &data)
+{
+    QFile file(root + path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(data);
+    file.close();
+}
+
+
+void TestStaticFileCache::load()
+{
+    writeFile("a.txt", "hello");
+    TStaticFileCache cache(root, 1024 * 1024, 1024);
+    TStaticFileCache::Entry entry;
+
+    QVERIFY(!cache.find("/a.txt", entry));
+    QVERIFY(cache.load("/a.txt", entry));
+    QCOMPARE(entry.body, QByteArray("hello"));
+    QCOMPARE(entry.size, (qint64)5);
+    QVERIFY(entry.header.startsWith("HTTP/1.1 200 OK\r\n"));
+    QVERIFY(entry.header.endsWith("\r\n"));
+    QVERIFY(entry.header.contains("Content-Length: 5\r\n"));
+    QVERIFY(entry.header.contains("ETag: " + entry.etag + "\r\n"));
+    QVERIFY(entry.notModifiedHeader.startsWith("HTTP/1.1 304 Not Modified\r\n"));
+
+    TStaticFileCache::Entry found;
+    QVERIFY(cache.find("/a.txt", found));
+    QCOMPARE(found.body, entry.body);
+    QCOMPARE(cache.count(), 1);
+
+    QVERIFY(!cache.load("/none.txt", entry));
+    QCOMPARE(cache.count(), 1);
+}
+
+/*
+  A file larger than the maximum file size is sent from the disk.
+*/
+void TestStaticFileCache::largeFile()
+{
+    writeFile("large.txt", QByteArray(2048, 'x'));
+    TStaticFileCache cache(root, 1024 * 1024, 1024);
+    TStaticFileCache::Entry entry;
+
+    QVERIFY(cache.load("/large.txt", entry));
+    QVERIFY(entry.body.isNull());
+    QCOMPARE(entry.size, (qint64)2048);
+    QVERIFY(entry.header.contains("Content-Length: 2048\r\n"));
+    QVERIFY(QFile::exists(entry.filePath));
+}
+
+
+void TestStaticFileCache::invalidPath()
+{
+    TStaticFileCache cache(root + "css", 1024 * 1024, 1024);
+    TStaticFileCache::Entry entry;
+
+    QVERIFY(!cache.load("/../a.txt", entry));
+    QVERIFY(!cache.load("/./b.css", entry));
+    QVERIFY(!cache.load("//b.css", entry));
+    QVERIFY(!cache.load("b.css", entry));
+    QVERIFY(!cache.load("/", entry));
+}
+
+
+void TestStaticFileCache::invalidate()
+{
+    writeFile("a.txt", "hello");
+    TStaticFileCache cache(root, 1024 * 1024, 1024);
+    TStaticFileCache::Entry entry;
+    QVERIFY(cache.load("/a.txt", entry));
+
+    writeFile("a.txt", "hello, world");
+    cache.processEvents();
+    QVERIFY(!cache.find("/a.txt", entry));
+
+    QVERIFY(cache.load("/a.txt", entry));
+    QCOMPARE(entry.body, QByteArray("hello, world"));
+
+    QFile::remove(root + "a.txt");
+    cache.processEvents();
+    QVERIFY(!cache.find("/a.txt", entry));
+    QCOMPARE(cache.count(), 0);
+    QCOMPARE(cache.memoryUsage(), (qint64)0);
+}
+
+/*
+  Renaming a directory removes the entries of the files under it.
+*/
+void TestStaticFileCache::invalidateDirectory()
+{
+    writeFile("css/b.css", "body {}");
+    TStaticFileCache cache(root, 1024 * 1024, 1024);
+    TStaticFileCache::Entry entry;
+    QVERIFY(cache.load("/css/b.css", entry));
+
+    QVERIFY(QDir(root).rename("css", "moved"));
+    cache.processEvents();
+    QVERIFY(!cache.find("/css/b.css", entry));
+    QVERIFY(!cache.load("/css/b.css", entry));
+}
+
+
+void TestStaticFileCache::evict()
+{
+    writeFile("a.txt", QByteArray(600, 'a'));
+    writeFile("large.txt", QByteArray(600, 'b'));
+    TStaticFileCache cache(root, 1500, 1024);
+    TStaticFileCache::Entry entry;
+
+    QVERIFY(cache.load("/a.txt", entry));
+    QVERIFY(cache.load("/large.txt", entry));
+    QCOMPARE(cache.count(), 1);
+    QVERIFY(cache.find("/large.txt", entry));
+    QVERIFY(cache.memoryUsage() <= 1500);
+}
+
+
+TF_TEST_MAIN(TestStaticFileCache)
+#include "main.moc"
@@ -1,3 +1,6 @@
 TEMPLATE=subdirs
-SUBDIRS=htmlescape httpheader hmac sharedmemorylogstream htmlparser mailmessage  multipartformdata  smtpmailer viewhelper paginator fieldnametovariablename
+SUBDIRS=htmlescape httpheader hmac sharedmemorylogstream htmlparser mailmessage  multipartformdata  smtpmailer viewhelper paginator fieldnametovariablename httprequestparser httpcompression httprange urlroute
 
+unix:!macx {
+  SUBDIRS += staticfilecache iouring
+}
@@ -0,0 +1,142 @@
+#include <TfTest/TfTest>
+#include "turlroute.h"
+
+
+class TestUrlRoute : public QObject
+{
+    Q_OBJECT
+private slots:
+    void findRouting_data();
+    void findRouting();
+    void priority();
+    void benchFindRouting_data();
+    void benchFindRouting();
+};
+
+
+static void addRoutes(TUrlRoute &route)
+{
+    route.addRouteFromString("match  \"/Book\"  \"Book#view\"");
+    route.addRouteFromString("get    \"/\"  \"Blog#index\"");
+    route.addRouteFromString("post   \"/New/:params\"  \"Account#entry\"");
+    route.addRouteFromString("get    \"/Book/:int/edit\"  \"Book#edit\"");
+    route.addRouteFromString("get    \"/Blog/:param/comments/:params\"  \"Blog#comments\"");
+    route.addRouteFromString("get    \"/Items\"  \"Item#index\"");
+    route.addRouteFromString("post   \"/Items\"  \"Item#create\"");
+}
+
+
+void TestUrlRoute::findRouting_data()
+{
+    QTest::addColumn<int>("method");
+    QTest::addColumn<QString>("path");
+    QTest::addColumn<QString>("routing");
+
+    QTest::newRow("1") << (int)Tf::Get << "/Book" << "bookcontroller#view()";
+    QTest::newRow("2") << (int)Tf::Post << "/Book/" << "bookcontroller#view()";
+    QTest::newRow("3") << (int)Tf::Get << "/" << "blogcontroller#index()";
+    QTest::newRow("4") << (int)Tf::Post << "/New/1/a" << "accountcontroller#entry(1,a)";
+    QTest::newRow("5") << (int)Tf::Post << "/New/1/a/" << "accountcontroller#entry(1,a)";
+    QTest::newRow("6") << (int)Tf::Post << "/New/" << "accountcontroller#entry()";
+    QTest::newRow("7") << (int)Tf::Get << "/New/1" << "#()";  // rejected
+    QTest::newRow("8") << (int)Tf::Get << "/Book/12/edit" << "bookcontroller#edit(12)";
+    QTest::newRow("9") << (int)Tf::Get << "/Book/ab/edit" << "(none)";
+    QTest::newRow("10") << (int)Tf::Get << "/Blog/tf/comments/3/4" << "blogcontroller#comments(tf,3,4)";
+    QTest::newRow("11") << (int)Tf::Get << "/Items" << "itemcontroller#index()";
+    QTest::newRow("12") << (int)Tf::Post << "/Items" << "itemcontroller#create()";
+    QTest::newRow("13") << (int)Tf::Get << "/Bookx" << "(none)";
+    QTest::newRow("14") << (int)Tf::Get << "/Book/12" << "(none)";
+}
+
+
+void TestUrlRoute::findRouting()
+{
+    QFETCH(int, method);
+    QFETCH(QString, path);
+    QFETCH(QString, routing);
+
+    TUrlRoute route;
+    addRoutes(route);
+
+    TRouting rt = route.findRouting((Tf::HttpMethod)method, path);
+    QString str = (rt.isEmpty()) ? QString("(none)")
+        : QString(rt.controller + '#' + rt.action) + '(' + rt.params.join(",") + ')';
+    QCOMPARE(str, routing);
+}
+
+
+void TestUrlRoute::priority()
+{
+    TUrlRoute route;
+    route.addRouteFromString("get \"/Book/:param\" \"Book#show\"");
+    route.addRouteFromString("get \"/Book/new\" \"Book#entry\"");
+    route.addRouteFromString("get \"/Book/:params\" \"Book#other\"");
+
+    // The first created has the highest priority
+    QCOMPARE(route.findRouting(Tf::Get, "/Book/new").action, QByteArray("show"));
+    QCOMPARE(route.findRouting(Tf::Get, "/Book/1/2").action, QByteArray("other"));
+    QVERIFY(!route.addRouteFromString("put \"/Book\" \"Book#update\""));
+    QVERIFY(!route.addRouteFromString("get \"/Book\" \"Book\""));
+}
+
+
+void TestUrlRoute::benchFindRouting_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<int>("depth");
+
+    QTest::newRow("10") << 10 << 0;
+    QTest::newRow("100") << 100 << 0;
+    QTest::newRow("1000") << 1000 << 0;
+    QTest::newRow("overlapping 8") << 0 << 8;
+}
+
+
+void TestUrlRoute::benchFindRouting()
+{
+    QFETCH(int, count);
+    QFETCH(int, depth);
+
+    TUrlRoute route;
+    QString path;
+    QByteArray action;
+
+    if (depth > 0) {
+        // Overlapping routes of all the combinations of ":param", ":int"
+        // and a literal segment; all of them match the path, and the
+        // route of all ":param" added first has the highest priority
+        int routes = 1;
+        for (int i = 0; i < depth; ++i) {
+            routes *= 3;
+        }
+        for (int i = 0; i < routes; ++i) {
+            QString p;
+            for (int j = 0, n = i; j < depth; ++j, n /= 3) {
+                p += (n % 3 == 0) ? "/:param" : ((n % 3 == 1) ? "/:int" : "/1");
+            }
+            route.addRouteFromString("get \"" + p + "\" \"Foo#r" + QString::number(i) + "\"");
+        }
+        path = QString("/1").repeated(depth);
+        action = "r0";
+    } else {
+        for (int i = 0; i < count; ++i) {
+            QString n = QString::number(i);
+            route.addRouteFromString("get \"/Foo" + n + "/index\" \"Foo" + n + "#index\"");
+            route.addRouteFromString("get \"/Foo" + n + "/show/:int\" \"Foo" + n + "#show\"");
+            route.addRouteFromString("post \"/Foo" + n + "/save/:params\" \"Foo" + n + "#save\"");
+        }
+
+        // The route added last
+        path = "/Foo" + QString::number(count - 1) + "/save/1/2";
+        action = "save";
+    }
+    QCOMPARE(route.findRouting((depth > 0) ? Tf::Get : Tf::Post, path).action, action);
+
+    QBENCHMARK {
+        route.findRouting((depth > 0) ? Tf::Get : Tf::Post, path);
+    }
+}
+
+
+TF_TEST_MAIN(TestUrlRoute)
+#include "main.moc"
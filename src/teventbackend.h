@@ -0,0 +1,89 @@
+#ifndef TEVENTBACKEND_H
+#define TEVENTBACKEND_H
+
+#include <QVector>
+#include <TGlobal>
+
+class QHostAddress;
+class QString;
+
+
+/*
+ * Receiver of the events of the sockets and the notifiers watched by
+ * an event backend.
+ */
+class TEventHandler
+{
+public:
+    virtual ~TEventHandler() { }
+    virtual void acceptEvent(int fd, const QHostAddress &address) = 0;
+    virtual void receiveEvent(int fd, const char *data, int length) = 0;
+    virtual void disconnectEvent(int fd, int error) = 0;
+    virtual void sendEvent(int fd) = 0;
+    virtual void notifyEvent(int fd) = 0;
+};
+
+
+/*
+ * Event backend of the reactors of the hybrid MPM; the events are
+ * waited for by epoll or io_uring.
+ */
+class TEventBackend
+{
+public:
+    enum Type {
+        Listener = 0,  // accepts the connections
+        Connection,    // receives the data
+        Notifier,      // eventfd, timerfd or inotify; readable
+    };
+
+    enum Event {
+        Readable = 0x01,
+        Writable = 0x02,
+    };
+
+    virtual ~TEventBackend() { }
+    virtual bool add(int fd, int type) = 0;
+    virtual bool modify(int fd, int events) = 0;
+    virtual bool remove(int fd) = 0;
+    virtual void close(int fd) = 0;
+    virtual int wait(int timeout, TEventHandler *handler) = 0;
+
+    static TEventBackend *create(const QString &name, int readBufferSize);
+};
+
+
+class TEpollBackend : public TEventBackend
+{
+public:
+    TEpollBackend();
+    ~TEpollBackend();
+
+    bool setup(int readBufferSize);
+    bool add(int fd, int type);
+    bool modify(int fd, int events);
+    bool remove(int fd);
+    void close(int fd);
+    int wait(int timeout, TEventHandler *handler);
+
+private:
+    struct Watch
+    {
+        Watch() : type(0), events(0), active(false) { }
+        int type;
+        int events;  // registered in the epoll
+        bool active;
+    };
+
+    bool isWatched(int fd) const { return fd < watches.count() && watches[fd].active; }
+    void acceptConnections(int fd, TEventHandler *handler);
+
+    int epollFd;
+    QVector<Watch> watches;  // indexed by fd
+    char *readBuffer;
+    int readBufferSize;
+
+    Q_DISABLE_COPY(TEpollBackend)
+};
+
+#endif // TEVENTBACKEND_H
@@ -0,0 +1,270 @@
+/* Copyright (c) 2013, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include <string.h>
+#include <QHostAddress>
+#include <QString>
+#include "teventbackend.h"
+#include "tiouring.h"
+#include "tsystemglobal.h"
+#include "tfcore_unix.h"
+
+const int MAX_EVENTS = 128;
+
+#ifndef EPOLLEXCLUSIVE
+# define EPOLLEXCLUSIVE  (1u << 28)
+#endif
+
+
+static inline uint toEpollEvents(int events)
+{
+    return ((events & TEventBackend::Readable) ? EPOLLIN : 0) | ((events & TEventBackend::Writable) ? EPOLLOUT : 0);
+}
+
+/*!
+  \class TEventBackend
+  \brief The TEventBackend class is the interface of the event backends
+  of the reactors of the hybrid MPM, which watch the sockets and the
+  notifiers, and pass their events to a TEventHandler object.
+  A listening socket is added to accept the connections, and a
+  connection to receive the data; the received data is passed to the
+  handler. The writable event of a connection is one-shot; it's watched
+  again by modify() if the socket is still full.
+*/
+
+/*!
+  Creates the event backend of the \a name, "epoll" or "io_uring".
+  Falls back to epoll if io_uring is not available. The data is received
+  into the buffer of \a readBufferSize bytes on epoll. Returns 0 on error.
+*/
+TEventBackend *TEventBackend::create(const QString &name, int readBufferSize)
+{
+    if (name == QLatin1String("io_uring")) {
+        TIoUringBackend *uring = new TIoUringBackend;
+        if (uring->setup()) {
+            return uring;
+        }
+        tSystemWarn("io_uring not available, epoll used");
+        delete uring;
+    } else if (name != QLatin1String("epoll")) {
+        tSystemWarn("Invalid MPM.hybrid.EventBackend: %s", qPrintable(name));
+    }
+
+    TEpollBackend *epoll = new TEpollBackend;
+    if (!epoll->setup(readBufferSize)) {
+        tSystemError("Failed epoll_create()");
+        delete epoll;
+        return 0;
+    }
+    return epoll;
+}
+
+/*!
+  \class TEpollBackend
+  \brief The TEpollBackend class is the event backend by epoll. The
+  sockets are received by recv() when readable.
+*/
+
+TEpollBackend::TEpollBackend()
+    : epollFd(-1), watches(), readBuffer(0), readBufferSize(0)
+{ }
+
+
+TEpollBackend::~TEpollBackend()
+{
+    if (epollFd >= 0) {
+        TF_CLOSE(epollFd);
+    }
+    delete[] readBuffer;
+}
+
+/*!
+  Creates the epoll instance and the buffer of \a readBufferSize bytes
+  to receive the data.
+*/
+bool TEpollBackend::setup(int readBufferSize)
+{
+    epollFd = epoll_create(1);
+    if (epollFd < 0)
+        return false;
+
+    this->readBufferSize = qMax(readBufferSize, 4096);
+    readBuffer = new char[this->readBufferSize];
+    return true;
+}
+
+/*!
+  Watches the \a fd of the \a type for the input. Only one of the
+  reactors is woken up for an incoming connection of a listening socket.
+*/
+bool TEpollBackend::add(int fd, int type)
+{
+    if (fd >= watches.count()) {
+        watches.resize(qMax(fd + 1, watches.count() * 2));
+    }
+
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | ((type == Listener) ? EPOLLEXCLUSIVE : 0);
+    ev.data.fd = fd;
+
+    int ret = tf_epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    int err = errno;
+    if (ret < 0 && err != EEXIST) {
+        tSystemError("Failed epoll_ctl (EPOLL_CTL_ADD)  fd:%d errno:%d", fd, err);
+        return false;
+    }
+
+    Watch &w = watches[fd];
+    w.type = type;
+    w.events = Readable;
+    w.active = true;
+    return true;
+}
+
+/*!
+  Changes the \a events watched on the connection \a fd.
+*/
+bool TEpollBackend::modify(int fd, int events)
+{
+    if (!isWatched(fd) || watches[fd].events == events)
+        return true;  // not changed
+
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpollEvents(events);
+    ev.data.fd = fd;
+
+    int ret = tf_epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+    if (ret < 0) {
+        tSystemError("Failed epoll_ctl (EPOLL_CTL_MOD)  fd:%d errno:%d", fd, errno);
+        return false;
+    }
+    tSystemDebug("OK epoll_ctl (EPOLL_CTL_MOD)  fd:%d", fd);
+    watches[fd].events = events;
+    return true;
+}
+
+/*!
+  Stops watching the \a fd; it's not closed.
+*/
+bool TEpollBackend::remove(int fd)
+{
+    if (!isWatched(fd))
+        return true;
+
+    watches[fd].active = false;
+    int ret = tf_epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    int err = errno;
+    if (ret < 0 && err != ENOENT) {
+        tSystemError("Failed epoll_ctl (EPOLL_CTL_DEL)  fd:%d errno:%d", fd, err);
+        return false;
+    }
+    tSystemDebug("OK epoll_ctl (EPOLL_CTL_DEL)  fd:%d", fd);
+    return true;
+}
+
+/*!
+  Stops watching the \a fd, and closes it.
+*/
+void TEpollBackend::close(int fd)
+{
+    if (isWatched(fd)) {
+        watches[fd].active = false;
+        tf_epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    TF_CLOSE(fd);
+}
+
+/*!
+  Waits for the events up to \a timeout msecs, and passes them to the
+  \a handler. Returns the number of the events, or -1 on error.
+*/
+int TEpollBackend::wait(int timeout, TEventHandler *handler)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    int nfd = tf_epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+    int err = errno;
+    if (nfd < 0) {
+        tSystemError("Failed epoll_wait() : errno:%d", err);
+        return -1;
+    }
+
+    for (int i = 0; i < nfd; ++i) {
+        int fd = events[i].data.fd;
+        if (!isWatched(fd)) {
+            continue;  // closed in this loop
+        }
+
+        if (watches[fd].type == Listener) {
+            acceptConnections(fd, handler);
+            continue;
+        }
+
+        if (watches[fd].type == Notifier) {
+            handler->notifyEvent(fd);
+            continue;
+        }
+
+        if ( (events[i].events & EPOLLIN) ) {
+            // Receive data
+            int len = ::recv(fd, readBuffer, readBufferSize, 0);
+            err = errno;
+            if (len > 0) {
+                handler->receiveEvent(fd, readBuffer, len);
+                if (!isWatched(fd)) {
+                    continue;
+                }
+
+            } else if (len < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+                // Event of the former connection of the fd
+                continue;
+
+            } else {
+                // Disconnect
+                handler->disconnectEvent(fd, (len < 0) ? err : 0);
+                continue;
+            }
+        }
+
+        if ( (events[i].events & EPOLLOUT) ) {
+            // Send data
+            handler->sendEvent(fd);
+        }
+    }
+    return nfd;
+}
+
+/*
+  Accepts the connections queued on the listening socket \a fd at a
+  time. Even if all the workers are busy, accepts them not to leave
+  them in the backlog; the overload is shed by rejecting the requests.
+*/
+void TEpollBackend::acceptConnections(int fd, TEventHandler *handler)
+{
+    for (int n = 0; n < MAX_EVENTS; ++n) {
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+
+        int clt = ::accept4(fd, (sockaddr *)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clt < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                tSystemWarn("Failed accept  errno:%d", errno);
+            }
+            break;  // no more, or accepted by another reactor
+        }
+
+        // The peer of UNIX domain has no address
+        handler->acceptEvent(clt, (addr.ss_family != AF_UNIX) ? QHostAddress((sockaddr *)&addr) : QHostAddress());
+    }
+}
@@ -72,6 +72,7 @@ namespace Tf
         UnsupportedMediaType         = 415,
         RequestedRangeNotSatisfiable = 416,
         ExpectationFailed            = 417,
+        RequestHeaderFieldsTooLarge  = 431,
         // Server Error 5xx
         InternalServerError     = 500,
         NotImplemented          = 501,
@@ -57,6 +57,19 @@ void tSetupLoggers()
 }
 
 
+/*!
+  Re-creates the loggers in a process forked, not to share the loggers
+  opened and the timer of the log stream with the parent process.
+  This function is for internal use only.
+*/
+void tResetLoggers()
+{
+    delete stream;  // the log buffered is written
+    stream = 0;
+    tSetupLoggers();
+}
+
+
 static void tMessage(int priority, const char *msg, va_list ap)
 {
     TLog log(priority, QString().vsprintf(msg, ap).toLocal8Bit());
@@ -95,6 +95,7 @@ class TLogger;
 class TLog;
 
 T_CORE_EXPORT void tSetupLoggers();  // internal use
+T_CORE_EXPORT void tResetLoggers();  // internal use
 
 T_CORE_EXPORT void tFatal(const char *, ...) // output fatal message
 #if defined(Q_CC_GNU) && !defined(__INSURE__)
@@ -5,110 +5,161 @@
  * the New BSD License, which is incorporated herein by reference.
  */
 
-#include <TWebApplication>
-#include <THttpRequestHeader>
+#include <QFile>
+#include <TTemporaryFile>
 #include "thttpbuffer.h"
 #include "tsystemglobal.h"
 
+const qint64 READ_THRESHOLD_LENGTH = 2 * 1024 * 1024; // bytes
+
 
 THttpBuffer::THttpBuffer()
-    : lengthToRead(-1)
+    : httpBuffer(), parser(), bodyFile(0), bodyFileLength(0)
 {
     httpBuffer.reserve(1024);
 }
 
 
 THttpBuffer::~THttpBuffer()
-{ }
-
-
-THttpBuffer::THttpBuffer(const THttpBuffer &other)
-    : httpBuffer(other.httpBuffer),
-      lengthToRead(other.lengthToRead),
-      clientAddr(other.clientAddr)
-{ }
-
-
-THttpBuffer &THttpBuffer::operator=(const THttpBuffer &other)
 {
-    httpBuffer = other.httpBuffer;
-    lengthToRead = other.lengthToRead;
-    clientAddr = other.clientAddr;
-    return *this;
+    delete bodyFile;
 }
 
 
-QByteArray THttpBuffer::read(int maxSize)
+/*!
+  Reads the header and the body of the first HTTP request received
+  entirely, and removes it from the buffer. The body is set to \a data
+  from the position \a bodyOffset; if the buffer holds only the
+  request, it's handed over to \a data without copying the body. If
+  the body has been spooled to a file, \a bodyFilePath is set to the
+  path of it and the caller must remove the file. The following data,
+  such as a pipelined request, remain in the buffer; call parse() for
+  them.
+*/
+bool THttpBuffer::readHttpRequest(THttpRequestHeader &header, QByteArray &data, int &bodyOffset, QString &bodyFilePath)
 {
-    int size = qMin(httpBuffer.length(), maxSize);
-    QByteArray res = httpBuffer.left(size);
-    httpBuffer.remove(0, size);
-    return res;
-}
-
+    if (!canReadHttpRequest())
+        return false;
+
+    qint64 length;
+    header = parser.header(httpBuffer);
+    bodyOffset = 0;
+
+    if (bodyFile) {
+        // Hands over the file
+        bodyFile->setAutoRemove(false);
+        bodyFile->close();
+        bodyFilePath = bodyFile->absoluteFilePath();
+        delete bodyFile;
+        bodyFile = 0;
+        bodyFileLength = 0;
+        data.clear();
+        length = parser.headerLength();
+    } else {
+        bodyFilePath.clear();
+        length = parser.requestLength();
+
+        if (parser.contentLength() > 0 && httpBuffer.length() == length) {
+            // Hands over the buffer
+            data = httpBuffer;
+            bodyOffset = parser.headerLength();
+            httpBuffer = QByteArray();
+            httpBuffer.reserve(1024);
+            parser.reset();
+            return true;
+        }
+        data = httpBuffer.mid(parser.headerLength(), parser.contentLength());
+    }
 
-int THttpBuffer::read(char *data, int maxSize)
-{
-    int size = qMin(httpBuffer.length(), maxSize);
-    memcpy(data, httpBuffer.data(), size);
-    httpBuffer.remove(0, size);
-    return size;
+    if (httpBuffer.length() > length) {
+        httpBuffer.remove(0, length);
+    } else {
+        httpBuffer.resize(0);  // keeps the capacity
+    }
+    parser.reset();
+    return true;
 }
 
 
 int THttpBuffer::write(const char *data, int maxSize)
 {
-    httpBuffer.append(data, maxSize);
-    parse();
+    if (bodyFile) {
+        writeBodyFile(data, maxSize);
+    } else {
+        httpBuffer.append(data, maxSize);
+        parse();
+    }
     return maxSize;
 }
 
 
 int THttpBuffer::write(const QByteArray &byteArray)
 {
-    int len = byteArray.length();
-    httpBuffer += byteArray;
-    parse();
-    return len;
+    return write(byteArray.constData(), byteArray.length());
 }
 
-
-void THttpBuffer::parse()
+/*!
+  Writes the body to the file, and the bytes following it to the buffer.
+*/
+void THttpBuffer::writeBodyFile(const char *data, int maxSize)
 {
-    uint limitBodyBytes = Tf::app()->appSettings().value("LimitRequestBody", "0").toUInt();
-
-    if (lengthToRead > 0) {
-        int idx = httpBuffer.indexOf("\r\n\r\n") + 4;
-        int len = qMin(httpBuffer.length() - idx, (int)lengthToRead);
-        lengthToRead -= len;
-
-    } else if (lengthToRead < 0) {
-        int idx = httpBuffer.indexOf("\r\n\r\n");
-        if (idx > 0) {
-            THttpRequestHeader header(httpBuffer.left(idx + 4));
-            tSystemDebug("content-length: %d", header.contentLength());
+    qint64 len = qMin((qint64)maxSize, parser.contentLength() - bodyFileLength);
+    if (len > 0) {
+        if (bodyFile->write(data, len) != len) {
+            throw RuntimeException(QLatin1String("write error: ") + bodyFile->fileName(), __FILE__, __LINE__);
+        }
+        bodyFileLength += len;
+    }
 
-            if (limitBodyBytes > 0 && header.contentLength() > limitBodyBytes) {
-                throw ClientErrorException(413);  // Request Entity Too Large
-            }
+    if (maxSize > len) {
+        httpBuffer.append(data + len, maxSize - len);
+    }
+}
 
-            lengthToRead = qMax(idx + 4 + (qint64)header.contentLength() - httpBuffer.length(), 0LL);
+/*!
+  Parses the bytes received incrementally. A body of multipart/form-data
+  or larger than 2MB is spooled to a temporary file. Throws
+  ClientErrorException if the request is invalid.
+*/
+void THttpBuffer::parse()
+{
+    if (parser.isHeaderComplete() || !parser.parse(httpBuffer))
+        return;
+
+    if (parser.isMultipartFormData() || parser.contentLength() > READ_THRESHOLD_LENGTH) {
+        bodyFile = new TTemporaryFile();
+        if (!bodyFile->open()) {
+            QString path = bodyFile->fileTemplate();
+            delete bodyFile;
+            bodyFile = 0;
+            throw RuntimeException(QLatin1String("temporary file open error: ") + path, __FILE__, __LINE__);
         }
-    } else {
-        tSystemWarn("Not reachable");
+        tSystemDebug("spools the body to the file: %s", qPrintable(bodyFile->fileName()));
+
+        int hlen = parser.headerLength();
+        QByteArray rest = httpBuffer.mid(hlen);
+        httpBuffer.truncate(hlen);
+        writeBodyFile(rest.constData(), rest.length());
     }
 }
 
 
 bool THttpBuffer::canReadHttpRequest() const
 {
-    return (lengthToRead == 0);
+    if (!parser.isHeaderComplete())
+        return false;
+
+    return (bodyFile) ? bodyFileLength >= parser.contentLength()
+        : httpBuffer.length() >= parser.requestLength();
 }
 
 
 void THttpBuffer::clear()
 {
-    lengthToRead = -1;
+    delete bodyFile;  // removes the file
+    bodyFile = 0;
+    bodyFileLength = 0;
+    parser.reset();
     httpBuffer.truncate(0);
     httpBuffer.reserve(1024);
     clientAddr.clear();
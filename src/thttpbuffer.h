@@ -4,6 +4,9 @@
 #include <QByteArray>
 #include <QHostAddress>
 #include <TGlobal>
+#include "thttprequestparser.h"
+
+class TTemporaryFile;
 
 
 class T_CORE_EXPORT THttpBuffer
@@ -11,14 +14,16 @@ class T_CORE_EXPORT THttpBuffer
 public:
     THttpBuffer();
     ~THttpBuffer();
-    THttpBuffer(const THttpBuffer &other);
-    THttpBuffer &operator=(const THttpBuffer &other);
 
-    QByteArray read(int maxSize);
-    int read(char *data, int maxSize);
+    bool readHttpRequest(THttpRequestHeader &header, QByteArray &data, int &bodyOffset, QString &bodyFilePath);
     int write(const char *data, int maxSize);
     int write(const QByteArray &byteArray);
     bool canReadHttpRequest() const;
+    bool isHeaderComplete() const { return parser.isHeaderComplete(); }
+    bool isKeepAliveRequested() const { return parser.isKeepAliveRequested(); }
+    QByteArray requestLine() const { return parser.requestLine(httpBuffer); }
+    QByteArray requestPath() const { return parser.path(httpBuffer); }
+    void parse();
     void clear();
     QByteArray &buffer() { return httpBuffer; }
     const QByteArray &buffer() const { return httpBuffer; }
@@ -26,11 +31,15 @@ public:
     void setClientAddress(const QHostAddress &address) { clientAddr = address; }
 
 private:
-    void parse();
+    void writeBodyFile(const char *data, int maxSize);
 
     QByteArray httpBuffer;
-    qint64 lengthToRead;
+    THttpRequestParser parser;
+    TTemporaryFile *bodyFile;  // spools a large body
+    qint64 bodyFileLength;
     QHostAddress clientAddr;
+
+    Q_DISABLE_COPY(THttpBuffer)
 };
 
 #endif // THTTPBUFFER_H
@@ -0,0 +1,247 @@
+/* Copyright (c) 2013, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QList>
+#include <QFileInfo>
+#include <TWebApplication>
+#include <TAppConfig>
+#include <THttpResponseHeader>
+#include "thttpcompression.h"
+
+
+static quint32 crcTable[256];
+
+static bool makeCrcTable()
+{
+    for (quint32 n = 0; n < 256; ++n) {
+        quint32 c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? (0xedb88320U ^ (c >> 1)) : (c >> 1);
+        }
+        crcTable[n] = c;
+    }
+    return true;
+}
+
+
+static inline void appendUInt32LE(QByteArray &array, quint32 value)
+{
+    array += (char)(value & 0xff);
+    array += (char)((value >> 8) & 0xff);
+    array += (char)((value >> 16) & 0xff);
+    array += (char)((value >> 24) & 0xff);
+}
+
+/*!
+  \class THttpCompression
+  \brief The THttpCompression class provides the content-codings of
+  HTTP, gzip and deflate, and the settings of the compression of the
+  responses in the application.ini.
+  The data is compressed by qCompress(); its zlib stream is sent as it
+  is for deflate, and wrapped in the gzip format for gzip.
+*/
+
+/*!
+  Compresses the \a data with the content-coding \a coding, "gzip" or
+  "deflate". Returns an empty byte array if it's not supported.
+*/
+QByteArray THttpCompression::compress(const QByteArray &data, const QByteArray &coding, int level)
+{
+    if (coding == "gzip") {
+        return gzip(data, level);
+    } else if (coding == "deflate") {
+        return deflate(data, level);
+    }
+    return QByteArray();
+}
+
+/*!
+  Compresses the \a data in the gzip format (RFC 1952).
+*/
+QByteArray THttpCompression::gzip(const QByteArray &data, int level)
+{
+    // zlib stream after the length; 2 bytes header, raw deflate and
+    // 4 bytes Adler-32
+    QByteArray zlib = qCompress(data, level);
+    if (zlib.length() < 4 + 2 + 4) {
+        return QByteArray();
+    }
+
+    static const char header[] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3 };  // deflate, OS: Unix
+    QByteArray gz;
+    gz.reserve(sizeof(header) + zlib.length() - 10 + 8);
+    gz.append(header, sizeof(header));
+    gz.append(zlib.constData() + 6, zlib.length() - 10);
+    appendUInt32LE(gz, crc32(data.constData(), data.length()));
+    appendUInt32LE(gz, (quint32)data.length());
+    return gz;
+}
+
+/*!
+  Compresses the \a data in the zlib format (RFC 1950), which is the
+  content-coding deflate of HTTP.
+*/
+QByteArray THttpCompression::deflate(const QByteArray &data, int level)
+{
+    QByteArray zlib = qCompress(data, level);
+    return (zlib.length() > 4) ? zlib.mid(4) : QByteArray();  // removes the length
+}
+
+/*!
+  Returns the CRC-32 of the \a data of \a length bytes, updating the
+  \a crc of the preceding data.
+*/
+quint32 THttpCompression::crc32(const char *data, int length, quint32 crc)
+{
+    static const bool tableMade = makeCrcTable();
+    Q_UNUSED(tableMade);
+
+    crc = ~crc;
+    for (int i = 0; i < length; ++i) {
+        crc = crcTable[(crc ^ (uchar)data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/*!
+  Returns the content-coding of the response for the Accept-Encoding
+  header \a acceptEncoding; gzip is preferred to deflate. Returns an
+  empty byte array if none of them is acceptable.
+*/
+QByteArray THttpCompression::negotiate(const QByteArray &acceptEncoding)
+{
+    if (acceptEncoding.isEmpty())
+        return QByteArray();
+
+    if (accepts(acceptEncoding, "gzip")) {
+        return "gzip";
+    } else if (accepts(acceptEncoding, "deflate")) {
+        return "deflate";
+    }
+    return QByteArray();
+}
+
+/*!
+  Returns true if the content-coding \a coding is acceptable for the
+  Accept-Encoding header \a acceptEncoding; it's not if its qvalue is 0.
+*/
+bool THttpCompression::accepts(const QByteArray &acceptEncoding, const QByteArray &coding)
+{
+    int wildcard = -1;
+    QList<QByteArray> codings = acceptEncoding.split(',');
+
+    for (QListIterator<QByteArray> it(codings); it.hasNext(); ) {
+        QList<QByteArray> params = it.next().split(';');
+        QByteArray name = params.value(0).trimmed().toLower();
+        if (name == "x-gzip") {
+            name = "gzip";
+        }
+
+        double q = 1.0;
+        for (int i = 1; i < params.count(); ++i) {
+            QByteArray p = params[i].trimmed();
+            if (p.startsWith("q=") || p.startsWith("Q=")) {
+                q = p.mid(2).toDouble();
+            }
+        }
+
+        if (name == coding) {
+            return q > 0;
+        } else if (name == "*") {
+            wildcard = (q > 0) ? 1 : 0;
+        }
+    }
+    return wildcard > 0;
+}
+
+/*!
+  Returns true if the response of the media type \a contentType is
+  compressed; it matches one of the prefixes of HttpCompression.Types
+  in the application.ini.
+*/
+bool THttpCompression::isCompressible(const QByteArray &contentType)
+{
+    if (contentType.isEmpty())
+        return false;
+
+    QByteArray type = contentType.trimmed().toLower();
+    const QList<QByteArray> &types = Tf::app()->appConfig().httpCompressionTypes();
+    for (QListIterator<QByteArray> it(types); it.hasNext(); ) {
+        if (type.startsWith(it.next())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+  Returns the path of the gzip-encoded variant of the static file
+  \a filePath of the media type \a contentType, which is the
+  precompressed file with the suffix ".gz"; returns an empty string if
+  it doesn't exist or the response is not compressed. The worker and
+  the static file cache of the reactors decide the variant by this, so
+  that both send the same representations of a file.
+*/
+QString THttpCompression::gzipVariantPath(const QString &filePath, const QByteArray &contentType)
+{
+    if (!isEnabled() || !isCompressible(contentType))
+        return QString();
+
+    QFileInfo fi(filePath + ".gz");
+    return (fi.isFile() && fi.isReadable()) ? fi.absoluteFilePath() : QString();
+}
+
+/*!
+  Returns the entity-tag of the variant of a static file of the entity-tag
+  \a etag; the one of the gzip-encoded variant is weak if \a gzip is true.
+*/
+QByteArray THttpCompression::variantEntityTag(const QByteArray &etag, bool gzip)
+{
+    return (gzip) ? "W/" + etag : etag;
+}
+
+/*!
+  Sets the headers of the variant of a static file to the \a header of
+  the response of the \a statusCode: Vary if the file has the
+  gzip-encoded variant, \a hasGzip, and Content-Encoding and the ETag
+  of the entity-tag \a etag of the variant sent, gzip-encoded if
+  \a gzip is true.
+*/
+void THttpCompression::setVariantHeader(THttpResponseHeader &header, int statusCode, bool hasGzip, bool gzip, const QByteArray &etag)
+{
+    if (gzip && statusCode != Tf::NotModified) {
+        header.setRawHeader("Content-Encoding", "gzip");
+    }
+    if (hasGzip) {
+        header.setRawHeader("Vary", "Accept-Encoding");
+    }
+    header.setRawHeader("ETag", variantEntityTag(etag, gzip));
+}
+
+/*!
+  Returns the value of HttpCompression.Enable in the application.ini.
+*/
+bool THttpCompression::isEnabled()
+{
+    return Tf::app()->appConfig().httpCompressionEnabled();
+}
+
+/*!
+  Returns the value of HttpCompression.Level in the application.ini.
+*/
+int THttpCompression::level()
+{
+    return Tf::app()->appConfig().httpCompressionLevel();
+}
+
+/*!
+  Returns the value of HttpCompression.MinLength in the application.ini.
+*/
+int THttpCompression::minLength()
+{
+    return Tf::app()->appConfig().httpCompressionMinLength();
+}
@@ -0,0 +1,29 @@
+#ifndef THTTPCOMPRESSION_H
+#define THTTPCOMPRESSION_H
+
+#include <QByteArray>
+#include <QString>
+#include <TGlobal>
+
+class THttpResponseHeader;
+
+class T_CORE_EXPORT THttpCompression
+{
+public:
+    static QByteArray compress(const QByteArray &data, const QByteArray &coding, int level = -1);
+    static QByteArray gzip(const QByteArray &data, int level = -1);
+    static QByteArray deflate(const QByteArray &data, int level = -1);
+    static quint32 crc32(const char *data, int length, quint32 crc = 0);
+    static QByteArray negotiate(const QByteArray &acceptEncoding);
+    static bool accepts(const QByteArray &acceptEncoding, const QByteArray &coding);
+    static bool isCompressible(const QByteArray &contentType);
+    static QString gzipVariantPath(const QString &filePath, const QByteArray &contentType);
+    static QByteArray variantEntityTag(const QByteArray &etag, bool gzip);
+    static void setVariantHeader(THttpResponseHeader &header, int statusCode, bool hasGzip, bool gzip, const QByteArray &etag);
+
+    static bool isEnabled();
+    static int level();
+    static int minLength();
+};
+
+#endif // THTTPCOMPRESSION_H
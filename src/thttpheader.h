@@ -39,6 +39,8 @@ public:
 private:
     QByteArray reqMethod;
     QByteArray reqUri;
+
+    friend class THttpRequestParser;
 };
 
 
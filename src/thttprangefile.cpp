@@ -0,0 +1,281 @@
+/* Copyright (c) 2013, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <THttpRequestHeader>
+#include "thttprangefile.h"
+
+const int MAX_RANGES = 32;
+
+
+static bool toOffset(const QByteArray &str, qint64 &value)
+{
+    if (str.isEmpty() || str.length() > 18)
+        return false;
+
+    value = 0;
+    for (int i = 0; i < str.length(); ++i) {
+        char c = str[i];
+        if (c < '0' || c > '9')
+            return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+
+static inline QByteArray byteRange(qint64 first, qint64 last, qint64 size)
+{
+    return "bytes " + QByteArray::number(first) + '-' + QByteArray::number(last) + '/' + QByteArray::number(size);
+}
+
+/*!
+  \class THttpRangeFile
+  \brief The THttpRangeFile class is a read-only device of the byte
+  ranges of a file for the response 206 Partial Content; a single range
+  is read as it is, and multiple ranges are read in the
+  multipart/byteranges format.
+  The parts() are also sent directly from the file handle by the
+  hybrid MPM.
+*/
+
+/*!
+  Constructor of the ranges \a ranges, which are pairs of the first and
+  last byte positions, of the file \a filePath. The \a contentType is
+  the media type of the file and the \a fileSize is the size of it.
+*/
+THttpRangeFile::THttpRangeFile(const QString &filePath, const QList<QPair<qint64, qint64> > &ranges, const QByteArray &contentType, qint64 fileSize, QObject *parent)
+    : QIODevice(parent), file(filePath), partList(), type(contentType), range(), totalLength(0), partIndex(0), partPos(0)
+{
+    if (ranges.count() == 1) {
+        Part part;
+        part.offset = ranges.first().first;
+        part.length = ranges.first().second - ranges.first().first + 1;
+        partList << part;
+        range = byteRange(ranges.first().first, ranges.first().second, fileSize);
+        totalLength = part.length;
+        return;
+    }
+
+    QByteArray boundary = "THttpRangeFile_" + QByteArray::number(Tf::randXor128(), 16) + QByteArray::number(Tf::randXor128(), 16);
+    for (int i = 0; i < ranges.count(); ++i) {
+        Part part;
+        part.head = (i > 0) ? "\r\n--" : "--";
+        part.head += boundary;
+        part.head += "\r\n";
+        if (!contentType.isEmpty()) {
+            part.head += "Content-Type: ";
+            part.head += contentType;
+            part.head += "\r\n";
+        }
+        part.head += "Content-Range: ";
+        part.head += byteRange(ranges[i].first, ranges[i].second, fileSize);
+        part.head += "\r\n\r\n";
+        part.offset = ranges[i].first;
+        part.length = ranges[i].second - ranges[i].first + 1;
+        partList << part;
+        totalLength += part.head.length() + part.length;
+    }
+
+    Part last;
+    last.head = "\r\n--" + boundary + "--\r\n";
+    last.offset = 0;
+    last.length = 0;
+    partList << last;
+    totalLength += last.head.length();
+    type = "multipart/byteranges; boundary=" + boundary;
+}
+
+
+THttpRangeFile::~THttpRangeFile()
+{
+    close();
+}
+
+
+bool THttpRangeFile::open(OpenMode mode)
+{
+    if ((mode & QIODevice::WriteOnly) || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    partIndex = 0;
+    partPos = 0;
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+
+void THttpRangeFile::close()
+{
+    file.close();
+    QIODevice::close();
+}
+
+
+qint64 THttpRangeFile::bytesAvailable() const
+{
+    qint64 len = -partPos;
+    for (int i = partIndex; i < partList.count(); ++i) {
+        len += partList[i].head.length() + partList[i].length;
+    }
+    return qMax(len, Q_INT64_C(0)) + QIODevice::bytesAvailable();
+}
+
+/*!
+  Returns the body of the ranges of the \a data, which is the content
+  of the file held in memory.
+*/
+QByteArray THttpRangeFile::extract(const QByteArray &data) const
+{
+    QByteArray body;
+    body.reserve(totalLength);
+    for (QListIterator<Part> it(partList); it.hasNext(); ) {
+        const Part &part = it.next();
+        body += part.head;
+        body += data.mid(part.offset, part.length);
+    }
+    return body;
+}
+
+
+qint64 THttpRangeFile::readData(char *data, qint64 maxSize)
+{
+    qint64 total = 0;
+
+    while (total < maxSize && partIndex < partList.count()) {
+        const Part &part = partList[partIndex];
+        if (partPos < part.head.length()) {
+            qint64 len = qMin(part.head.length() - partPos, maxSize - total);
+            memcpy(data + total, part.head.constData() + partPos, len);
+            partPos += len;
+            total += len;
+            continue;
+        }
+
+        qint64 pos = partPos - part.head.length();
+        if (pos < part.length) {
+            qint64 len = -1;
+            if (file.seek(part.offset + pos)) {
+                len = file.read(data + total, qMin(part.length - pos, maxSize - total));
+            }
+            if (len <= 0) {
+                // Read error, or the file was truncated
+                return (total > 0) ? total : -1;
+            }
+            partPos += len;
+            total += len;
+            continue;
+        }
+
+        ++partIndex;
+        partPos = 0;
+    }
+    return total;
+}
+
+
+qint64 THttpRangeFile::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+/*!
+  Parses the Range header \a range for the file of \a size bytes, and
+  sets the satisfiable byte ranges to \a ranges. Returns
+  Tf::PartialContent if any of them is satisfiable, or
+  Tf::RequestedRangeNotSatisfiable if none of them is. Returns Tf::OK if
+  the header is invalid or too fragmented, which is ignored.
+*/
+int THttpRangeFile::parseRange(const QByteArray &range, qint64 size, QList<QPair<qint64, qint64> > &ranges)
+{
+    ranges.clear();
+
+    QByteArray value = range.trimmed();
+    if (!value.toLower().startsWith("bytes="))
+        return Tf::OK;
+
+    int specs = 0;
+    qint64 total = 0;
+    QList<QByteArray> list = value.mid(6).split(',');
+    for (QListIterator<QByteArray> it(list); it.hasNext(); ) {
+        QByteArray spec = it.next().trimmed();
+        if (spec.isEmpty())
+            continue;
+
+        int idx = spec.indexOf('-');
+        if (idx < 0)
+            return Tf::OK;
+
+        qint64 first, last;
+        if (idx == 0) {
+            // Suffix range, the last N bytes
+            qint64 suffix;
+            if (!toOffset(spec.mid(1), suffix))
+                return Tf::OK;
+
+            ++specs;
+            if (suffix == 0 || size == 0)
+                continue;
+            first = qMax(size - suffix, Q_INT64_C(0));
+            last = size - 1;
+        } else {
+            if (!toOffset(spec.left(idx), first))
+                return Tf::OK;
+
+            if (idx + 1 < spec.length()) {
+                if (!toOffset(spec.mid(idx + 1), last) || last < first)
+                    return Tf::OK;
+            } else {
+                last = size - 1;
+            }
+
+            ++specs;
+            if (first >= size)
+                continue;
+            last = qMin(last, size - 1);
+        }
+
+        ranges << qMakePair(first, last);
+        total += last - first + 1;
+    }
+
+    if (specs == 0)
+        return Tf::OK;
+
+    if (ranges.count() > MAX_RANGES || total > size) {
+        // Too many or overlapping ranges; sent entirely
+        ranges.clear();
+        return Tf::OK;
+    }
+    return (ranges.isEmpty()) ? Tf::RequestedRangeNotSatisfiable : Tf::PartialContent;
+}
+
+/*!
+  Evaluates the Range and If-Range headers of the GET request \a header
+  for the file of \a size bytes whose Last-Modified is \a lastModified
+  and ETag is \a etag. Returns Tf::OK if the file is sent entirely;
+  the If-Range doesn't match, in particular. Otherwise, returns the
+  same as parseRange().
+*/
+int THttpRangeFile::evaluate(const THttpRequestHeader &header, qint64 size, const QByteArray &lastModified, const QByteArray &etag, QList<QPair<qint64, qint64> > &ranges)
+{
+    ranges.clear();
+
+    QByteArray range = header.rawHeader("Range");
+    if (range.isEmpty())
+        return Tf::OK;
+
+    QByteArray ifRange = header.rawHeader("If-Range").trimmed();
+    if (!ifRange.isEmpty()) {
+        if (ifRange.startsWith('"') || ifRange.startsWith("W/")) {
+            // Strong comparison of the entity-tags
+            if (etag.isEmpty() || etag.startsWith("W/") || ifRange != etag)
+                return Tf::OK;
+        } else if (ifRange != lastModified) {
+            return Tf::OK;
+        }
+    }
+    return parseRange(range, size, ranges);
+}
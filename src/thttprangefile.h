@@ -0,0 +1,58 @@
+#ifndef THTTPRANGEFILE_H
+#define THTTPRANGEFILE_H
+
+#include <QIODevice>
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QByteArray>
+#include <TGlobal>
+
+class THttpRequestHeader;
+
+
+class T_CORE_EXPORT THttpRangeFile : public QIODevice
+{
+    Q_OBJECT
+public:
+    struct Part
+    {
+        QByteArray head;  // sent before the range of the file
+        qint64 offset;
+        qint64 length;
+    };
+
+    THttpRangeFile(const QString &filePath, const QList<QPair<qint64, qint64> > &ranges, const QByteArray &contentType, qint64 fileSize, QObject *parent = 0);
+    ~THttpRangeFile();
+
+    bool open(OpenMode mode);
+    void close();
+    bool isSequential() const { return true; }
+    qint64 size() const { return totalLength; }
+    qint64 bytesAvailable() const;
+    QString fileName() const { return file.fileName(); }
+    const QList<Part> &parts() const { return partList; }
+    const QByteArray &contentType() const { return type; }
+    const QByteArray &contentRange() const { return range; }
+    QByteArray extract(const QByteArray &data) const;
+
+    static int parseRange(const QByteArray &range, qint64 size, QList<QPair<qint64, qint64> > &ranges);
+    static int evaluate(const THttpRequestHeader &header, qint64 size, const QByteArray &lastModified, const QByteArray &etag, QList<QPair<qint64, qint64> > &ranges);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    QFile file;
+    QList<Part> partList;
+    QByteArray type;
+    QByteArray range;    // Content-Range of a single range
+    qint64 totalLength;
+    int partIndex;
+    qint64 partPos;      // bytes read of the current part, the head included
+
+    Q_DISABLE_COPY(THttpRangeFile)
+};
+
+#endif // THTTPRANGEFILE_H
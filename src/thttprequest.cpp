@@ -84,6 +84,28 @@ THttpRequest::THttpRequest(const QByteArray &byteArray, const QHostAddress &clie
 }
 
 
+/*!
+  Constructor with the header \a header, the body \a body and the
+  client address \a clientAddress.
+*/
+THttpRequest::THttpRequest(const THttpRequestHeader &header, const QByteArray &body, const QHostAddress &clientAddress)
+    : reqHeader(header), clientAddr(clientAddress)
+{
+    parseBody(body);
+}
+
+
+/*!
+  Constructor with the header \a header, a body generated by reading
+  the file \a filePath and the client address \a clientAddress.
+*/
+THttpRequest::THttpRequest(const THttpRequestHeader &header, const QString &filePath, const QHostAddress &clientAddress)
+    : reqHeader(header), clientAddr(clientAddress)
+{
+    setRequest(header, filePath);
+}
+
+
 THttpRequest::~THttpRequest()
 { }
 
@@ -115,7 +137,13 @@ void THttpRequest::setRequest(const QByteArray &header, const QByteArray &body)
 
 void THttpRequest::setRequest(const QByteArray &header, const QString &filePath)
 {
-    reqHeader = THttpRequestHeader(header);
+    setRequest(THttpRequestHeader(header), filePath);
+}
+
+
+void THttpRequest::setRequest(const THttpRequestHeader &header, const QString &filePath)
+{
+    reqHeader = header;
     multiFormData = TMultipartFormData(filePath, boundary());
     formParams.unite(multiFormData.formItems());
 }
@@ -20,6 +20,8 @@ public:
     THttpRequest(const QByteArray &header, const QByteArray &body);
     THttpRequest(const QByteArray &header, const QString &filePath);
     THttpRequest(const QByteArray &byteArray, const QHostAddress &clientAddress);
+    THttpRequest(const THttpRequestHeader &header, const QByteArray &body, const QHostAddress &clientAddress);
+    THttpRequest(const THttpRequestHeader &header, const QString &filePath, const QHostAddress &clientAddress);
     virtual ~THttpRequest();
     THttpRequest &operator=(const THttpRequest &other);
 
@@ -51,6 +53,7 @@ protected:
     void setRequest(const THttpRequestHeader &header, const QByteArray &body);
     void setRequest(const QByteArray &header, const QByteArray &body);
     void setRequest(const QByteArray &header, const QString &filePath);
+    void setRequest(const THttpRequestHeader &header, const QString &filePath);
     QByteArray boundary() const;
 
 private:
@@ -64,7 +67,6 @@ private:
     QHostAddress clientAddr;
 
     friend class THttpSocket;
-    friend class TWorkerStarter;
 };
 
 Q_DECLARE_METATYPE(THttpRequest)
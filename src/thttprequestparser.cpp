@@ -0,0 +1,336 @@
+/* Copyright (c) 2013, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <TWebApplication>
+#include <TAppConfig>
+#include "thttprequestparser.h"
+#include "tsystemglobal.h"
+
+const int MAX_LINE_LENGTH = 8190;         // request-line or a header line
+const int MAX_HEADER_LENGTH = 64 * 1024;  // bytes
+const int MAX_FIELDS = 100;
+
+
+static inline bool isLws(char c)
+{
+    return (c == ' ' || c == '\t');
+}
+
+
+static inline bool isDigit(char c)
+{
+    return (c >= '0' && c <= '9');
+}
+
+
+static inline int indexOf(const char *data, int start, int end, char c)
+{
+    const char *p = (const char *)memchr(data + start, c, end - start);
+    return (p) ? p - data : -1;
+}
+
+/*!
+  \class THttpRequestParser
+  \brief The THttpRequestParser class parses an HTTP request incrementally.
+  It scans only the bytes appended since the last call, and records the
+  offsets of the request-line and the header fields in the buffer.
+  The header is built from the offsets without being parsed again.
+*/
+
+/*!
+  Constructor. If \a limitBody is negative, the value of
+  LimitRequestBody in the application.ini is used.
+*/
+THttpRequestParser::THttpRequestParser(qint64 limitBody)
+    : limitBodyBytes((limitBody < 0) ? defaultLimitBodyBytes() : limitBody)
+{
+    reset();
+}
+
+/*!
+  Returns the value of LimitRequestBody in the application.ini.
+  \sa TAppConfig::limitRequestBody()
+*/
+qint64 THttpRequestParser::defaultLimitBodyBytes()
+{
+    return Tf::app()->appConfig().limitRequestBody();
+}
+
+
+void THttpRequestParser::reset()
+{
+    state = RequestLine;
+    lineStart = 0;
+    scanPos = 0;
+    headerLen = 0;
+    contentLen = 0;
+    keepAliveRequested = false;
+    multipartFormData = false;
+    method = 0;
+    methodLength = 0;
+    uri = 0;
+    uriLength = 0;
+    requestLineEnd = 0;
+    majorVersion = 1;
+    minorVersion = 1;
+    fields.resize(0);
+}
+
+/*!
+  Parses the \a data, the bytes received so far; the bytes parsed in the
+  previous calls must remain at the head of it. Returns true if the
+  header has been received entirely.
+  Throws ClientErrorException if the request is invalid, its header is
+  too large or its body is larger than the limit.
+*/
+bool THttpRequestParser::parse(const QByteArray &data)
+{
+    const char *d = data.constData();
+    int len = data.length();
+
+    while (state != Completed && scanPos < len) {
+        int lf = indexOf(d, scanPos, len, '\n');
+        if (lf < 0) {
+            checkLength(len);
+            scanPos = len;  // waits for the rest of the line
+            break;
+        }
+        checkLength(lf);
+
+        int end = (lf > lineStart && d[lf - 1] == '\r') ? lf - 1 : lf;
+        if (state == RequestLine) {
+            if (end > lineStart) {  // ignores empty lines before the request-line
+                parseRequestLine(d, lineStart, end);
+                state = HeaderLine;
+            }
+        } else if (end == lineStart) {
+            completeHeader(d, lf + 1);
+        } else {
+            parseHeaderLine(d, lineStart, end);
+        }
+        lineStart = scanPos = lf + 1;
+    }
+    return (state == Completed);
+}
+
+
+/*
+  Throws ClientErrorException if the current line, which has been
+  received up to the \a end, or the header is too long.
+*/
+void THttpRequestParser::checkLength(int end) const
+{
+    if (end - lineStart > MAX_LINE_LENGTH) {
+        throw ClientErrorException((state == RequestLine) ? 414 : 431);  // Request-URI Too Long, or Request Header Fields Too Large
+    }
+    if (end > MAX_HEADER_LENGTH) {
+        throw ClientErrorException(431);  // Request Header Fields Too Large
+    }
+}
+
+
+void THttpRequestParser::parseRequestLine(const char *data, int start, int end)
+{
+    // Method
+    int i = indexOf(data, start, end, ' ');
+    if (i <= start) {
+        throw ClientErrorException(400);  // Bad Request
+    }
+    method = start;
+    methodLength = i - start;
+
+    // Request-URI
+    while (i < end && data[i] == ' ')
+        ++i;
+    int j = indexOf(data, i, end, ' ');
+    if (j < 0)
+        j = end;
+    if (j <= i) {
+        throw ClientErrorException(400);  // Bad Request
+    }
+    uri = i;
+    uriLength = j - i;
+    requestLineEnd = end;
+
+    // HTTP-Version
+    while (j < end && data[j] == ' ')
+        ++j;
+    if (end - j >= 8 && qstrncmp(data + j, "HTTP/", 5) == 0
+        && isDigit(data[j + 5]) && data[j + 6] == '.' && isDigit(data[j + 7])) {
+        majorVersion = data[j + 5] - '0';
+        minorVersion = data[j + 7] - '0';
+    }
+}
+
+
+void THttpRequestParser::parseHeaderLine(const char *data, int start, int end)
+{
+    int e = end;
+    while (e > start && isLws(data[e - 1]))
+        --e;
+
+    if (isLws(data[start])) {
+        // Continuation of the previous field
+        if (!fields.isEmpty() && e > start) {
+            Field &field = fields.last();
+            field.valueEnd = e;
+            field.folded = true;
+        }
+        return;
+    }
+
+    int colon = indexOf(data, start, end, ':');
+    if (colon < 0)
+        return;  // ignores the line
+
+    Field field;
+    int n = colon;
+    while (n > start && isLws(data[n - 1]))
+        --n;
+    field.name = start;
+    field.nameLength = n - start;
+
+    int v = colon + 1;
+    while (v < e && isLws(data[v]))
+        ++v;
+    field.value = v;
+    field.valueEnd = qMax(v, e);
+    field.folded = false;
+    fields.append(field);
+
+    if (fields.count() > MAX_FIELDS) {
+        throw ClientErrorException(431);  // Request Header Fields Too Large
+    }
+}
+
+
+void THttpRequestParser::completeHeader(const char *data, int end)
+{
+    QByteArray connection;
+    bool hasContentLength = false;
+    bool hasTransferEncoding = false;
+
+    for (QVectorIterator<Field> it(fields); it.hasNext(); ) {
+        const Field &field = it.next();
+        const char *name = data + field.name;
+
+        if (field.nameLength == 14 && qstrnicmp(name, "Content-Length", 14) == 0) {
+            bool ok;
+            qint64 length = fieldValue(data, field).toLongLong(&ok);
+            if (!ok || length < 0 || (hasContentLength && length != contentLen)) {
+                throw ClientErrorException(400);  // Bad Request
+            }
+            contentLen = length;
+            hasContentLength = true;
+
+        } else if (field.nameLength == 17 && qstrnicmp(name, "Transfer-Encoding", 17) == 0) {
+            hasTransferEncoding = true;
+
+        } else if (field.nameLength == 10 && qstrnicmp(name, "Connection", 10) == 0) {
+            connection = fieldValue(data, field).toLower();
+
+        } else if (field.nameLength == 12 && qstrnicmp(name, "Content-Type", 12) == 0) {
+            multipartFormData = fieldValue(data, field).toLower().startsWith("multipart/form-data");
+        }
+    }
+
+    // The transfer-codings are not decoded. Such a body must not be
+    // taken for the next request on the connection.
+    if (hasTransferEncoding) {
+        if (hasContentLength) {
+            throw ClientErrorException(400);  // Bad Request
+        }
+        throw ClientErrorException(501);  // Not Implemented
+    }
+
+    tSystemDebug("content-length: %lld", contentLen);
+    if (limitBodyBytes > 0 && contentLen > limitBodyBytes) {
+        throw ClientErrorException(413);  // Request Entity Too Large
+    }
+
+    // Persistent connection; default in HTTP/1.1
+    if (majorVersion > 1 || (majorVersion == 1 && minorVersion >= 1)) {
+        keepAliveRequested = !connection.contains("close");
+    } else {
+        keepAliveRequested = connection.contains("keep-alive");
+    }
+
+    headerLen = end;
+    state = Completed;
+}
+
+
+QByteArray THttpRequestParser::fieldValue(const char *data, const Field &field) const
+{
+    if (!field.folded) {
+        return QByteArray(data + field.value, field.valueEnd - field.value);
+    }
+
+    // Joins the lines with a space
+    QByteArray value;
+    int i = field.value;
+    while (i < field.valueEnd) {
+        int j = indexOf(data, i, field.valueEnd, '\n');
+        if (j < 0)
+            j = field.valueEnd;
+
+        QByteArray line = QByteArray(data + i, j - i).trimmed();
+        if (!line.isEmpty()) {
+            if (!value.isEmpty())
+                value += ' ';
+            value += line;
+        }
+        i = j + 1;
+    }
+    return value;
+}
+
+/*!
+  Returns the header of the request in the \a data parsed.
+*/
+THttpRequestHeader THttpRequestParser::header(const QByteArray &data) const
+{
+    THttpRequestHeader header;
+    if (state != Completed)
+        return header;
+
+    const char *d = data.constData();
+    header.reqMethod = QByteArray(d + method, methodLength);
+    header.reqUri = QByteArray(d + uri, uriLength);
+    header.majVersion = majorVersion;
+    header.minVersion = minorVersion;
+
+    for (QVectorIterator<Field> it(fields); it.hasNext(); ) {
+        const Field &field = it.next();
+        header.headerPairList << qMakePair(QByteArray(d + field.name, field.nameLength), fieldValue(d, field));
+    }
+    return header;
+}
+
+/*!
+  Returns the request-line in the \a data parsed, or an empty byte
+  array if it has not been received.
+*/
+QByteArray THttpRequestParser::requestLine(const QByteArray &data) const
+{
+    if (state == RequestLine)
+        return QByteArray();
+    return QByteArray(data.constData() + method, requestLineEnd - method);
+}
+
+/*!
+  Returns the path of the Request-URI in the \a data parsed, without
+  the query string.
+*/
+QByteArray THttpRequestParser::path(const QByteArray &data) const
+{
+    if (state == RequestLine)
+        return QByteArray();
+
+    int end = indexOf(data.constData(), uri, uri + uriLength, '?');
+    return QByteArray(data.constData() + uri, ((end < 0) ? uri + uriLength : end) - uri);
+}
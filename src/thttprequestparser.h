@@ -0,0 +1,69 @@
+#ifndef THTTPREQUESTPARSER_H
+#define THTTPREQUESTPARSER_H
+
+#include <QByteArray>
+#include <QVector>
+#include <TGlobal>
+#include <THttpRequestHeader>
+
+
+class T_CORE_EXPORT THttpRequestParser
+{
+public:
+    THttpRequestParser(qint64 limitBody = -1);
+
+    bool parse(const QByteArray &data);
+    bool isHeaderComplete() const { return state == Completed; }
+    int headerLength() const { return headerLen; }
+    qint64 contentLength() const { return contentLen; }
+    qint64 requestLength() const { return (state == Completed) ? headerLen + contentLen : -1; }
+    bool isKeepAliveRequested() const { return keepAliveRequested; }
+    bool isMultipartFormData() const { return multipartFormData; }
+    THttpRequestHeader header(const QByteArray &data) const;
+    QByteArray requestLine(const QByteArray &data) const;
+    QByteArray path(const QByteArray &data) const;
+    void reset();
+
+    static qint64 defaultLimitBodyBytes();
+
+private:
+    enum State {
+        RequestLine = 0,
+        HeaderLine,
+        Completed,
+    };
+
+    struct Field
+    {
+        int name;
+        int nameLength;
+        int value;
+        int valueEnd;
+        bool folded;  // continued to the following lines
+    };
+
+    void checkLength(int end) const;
+    void parseRequestLine(const char *data, int start, int end);
+    void parseHeaderLine(const char *data, int start, int end);
+    void completeHeader(const char *data, int end);
+    QByteArray fieldValue(const char *data, const Field &field) const;
+
+    int state;
+    int lineStart;
+    int scanPos;
+    int headerLen;
+    qint64 contentLen;
+    qint64 limitBodyBytes;
+    bool keepAliveRequested;
+    bool multipartFormData;
+    int method;
+    int methodLength;
+    int uri;
+    int uriLength;
+    int requestLineEnd;
+    int majorVersion;
+    int minorVersion;
+    QVector<Field> fields;
+};
+
+#endif // THTTPREQUESTPARSER_H
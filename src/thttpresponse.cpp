@@ -7,9 +7,11 @@
 
 #include <QFile>
 #include <QBuffer>
+#include <QFileInfo>
 #include <THttpResponse>
 #include <THttpUtility>
 #include <TSystemGlobal>
+#include "thttprangefile.h"
 
 /*!
   \class THttpResponse
@@ -88,6 +90,35 @@ void THttpResponse::setBodyFile(const QString &filePath)
     delete fp;
 }
 
+/*!
+  Sets the byte ranges \a ranges of the file \a filePath to the body,
+  which are the pairs of the first and last byte positions. The
+  Content-Type header, set before, is replaced with multipart/byteranges
+  for multiple ranges, and the Content-Range header is set for a single
+  range.
+*/
+void THttpResponse::setBodyFile(const QString &filePath, const QList<QPair<qint64, qint64> > &ranges)
+{
+    if (bodyDevice) {
+        delete bodyDevice;
+        bodyDevice = 0;
+    }
+
+    QFileInfo fi(filePath);
+    THttpRangeFile *fp = new THttpRangeFile(filePath, ranges, resHeader.contentType(), fi.size());
+    if (fp->open(QIODevice::ReadOnly)) {
+        bodyDevice = fp;
+        resHeader.setContentType(fp->contentType());
+        if (!fp->contentRange().isEmpty()) {
+            resHeader.setRawHeader("Content-Range", fp->contentRange());
+        }
+        return;
+    }
+
+    tSystemError("faild to open file: %s", qPrintable(filePath));
+    delete fp;
+}
+
 
 /*!
   \fn THttpResponseHeader &THttpResponse::header()
@@ -3,6 +3,8 @@
 
 #include <QByteArray>
 #include <QDateTime>
+#include <QList>
+#include <QPair>
 #include <TGlobal>
 #include <THttpResponseHeader>
 
@@ -21,6 +23,7 @@ public:
     bool isBodyNull() const;
     void setBody(const QByteArray &body);
     void setBodyFile(const QString &filePath);
+    void setBodyFile(const QString &filePath, const QList<QPair<qint64, qint64> > &ranges);
     QIODevice *bodyIODevice() { return bodyDevice; }
     qint64 bodyLength() const { return (bodyDevice) ? bodyDevice->size() : 0; }
 
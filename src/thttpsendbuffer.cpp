@@ -16,26 +16,66 @@
 #include "tsystemglobal.h"
 
 
-THttpSendBuffer::THttpSendBuffer(const QByteArray &header, const QFileInfo &file, bool autoRemove, const TAccessLogger &logger)
-    : arrayBuffer(header), bodyFile(0), fileRemove(autoRemove), accesslogger(logger), arraySentSize(0)
+/*!
+  \class THttpSendBuffer
+  \brief The THttpSendBuffer class holds a response as a chain of
+  segments; byte arrays followed by an optional file body. The segments
+  are sent as they are, without being concatenated.
+*/
+
+/*!
+  Constructs a send-buffer of the \a header and the \a file body. If the
+  \a parts are not empty, only the ranges of them are sent, each one
+  following its head.
+*/
+THttpSendBuffer::THttpSendBuffer(const QByteArray &header, const QFileInfo &file, bool autoRemove, const TAccessLogger &logger,
+                                 const QList<THttpRangeFile::Part> &parts)
+    : arraySegments(), bodyFile(0), fileEnd(-1), fileParts(parts), fileRemove(autoRemove), accesslogger(logger), arraySentSize(0)
 {
+    if (!header.isEmpty()) {
+        arraySegments << header;
+    }
+
     if (file.exists() && file.isFile()) {
         bodyFile = new QFile(file.absoluteFilePath());
-        if (!bodyFile->open(QIODevice::ReadOnly)) {
+        if (!bodyFile->open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
             tSystemWarn("file open failed: %s", qPrintable(file.absoluteFilePath()));
             release();
         }
     }
+
+    if (!fileParts.isEmpty()) {
+        fileEnd = 0;
+        nextFilePart();
+    }
 }
 
 
-THttpSendBuffer::THttpSendBuffer(int statusCode, const QHostAddress &address, const QByteArray &method)
-    : arrayBuffer(), bodyFile(0), fileRemove(false), accesslogger(), arraySentSize(0)
+THttpSendBuffer::THttpSendBuffer(const QByteArray &header, const QByteArray &body, const TAccessLogger &logger)
+    : arraySegments(), bodyFile(0), fileEnd(-1), fileParts(), fileRemove(false), accesslogger(logger), arraySentSize(0)
+{
+    if (!header.isEmpty()) {
+        arraySegments << header;
+    }
+    if (!body.isEmpty()) {
+        arraySegments << body;  // shares the data
+    }
+}
+
+
+/*!
+  Constructs a send-buffer of a response without body, with the status
+  code \a statusCode. The connection is closed after the response.
+  If \a retryAfter is greater than 0, the Retry-After header is set
+  to the seconds.
+*/
+THttpSendBuffer::THttpSendBuffer(int statusCode, const QHostAddress &address, const QByteArray &method, int retryAfter)
+    : arraySegments(), bodyFile(0), fileEnd(-1), fileParts(), fileRemove(false), accesslogger(), arraySentSize(0)
 {
     accesslogger.open();
     accesslogger.setStatusCode(statusCode);
     accesslogger.setTimestamp(QDateTime::currentDateTime());
-    accesslogger.setRemoteHost(address.toString().toLatin1());
+    accesslogger.setRemoteHost(address.isNull() ? QByteArray("(unix)") : address.toString().toLatin1());
     accesslogger.setRequest(method);
 
     THttpResponseHeader header;
@@ -47,13 +87,21 @@ THttpSendBuffer::THttpSendBuffer(int statusCode, const QHostAddress &address, co
     QDateTime utc = QDateTime::currentDateTime().toUTC();
 #endif
     header.setRawHeader("Date", QLocale(QLocale::C).toString(utc, QLatin1String("ddd, dd MMM yyyy hh:mm:ss 'GMT'")).toLatin1());
-    arrayBuffer += header.toByteArray();
+    header.setContentLength(0);
+    header.setRawHeader("Connection", "close");
+    if (retryAfter > 0) {
+        header.setRawHeader("Retry-After", QByteArray::number(retryAfter));
+    }
+    arraySegments << header.toByteArray();
 }
 
 
 THttpSendBuffer::~THttpSendBuffer()
 {
     release();
+    if (sentSemaphore) {
+        sentSemaphore->release();
+    }
 }
 
 
@@ -66,6 +114,7 @@ void THttpSendBuffer::release()
         delete bodyFile;
         bodyFile = 0;
     }
+    fileParts.clear();
 }
 
 
@@ -74,24 +123,28 @@ int THttpSendBuffer::read(char *data, int maxSize)
     int ret = 0;
     int len;
 
-    // Read the byte array
-    len = qMin(arrayBuffer.length() - arraySentSize, maxSize);
-    if (len > 0) {
-        memcpy(data, arrayBuffer.constData() + arraySentSize, len);
-        arraySentSize += len;
+    // Read the byte arrays
+    while (maxSize > 0 && !arraySegments.isEmpty()) {
+        len = qMin(segmentLength(0), maxSize);
+        memcpy(data, segmentData(0), len);
+        arraySent(len);
         data += len;
         ret += len;
         maxSize -= len;
     }
 
     // Read the file
-    if (maxSize > 0 && !atEnd()) {
-        len = bodyFile->read(data, maxSize);
-        if (len < 0) {
+    qint64 remaining = fileRemaining();
+    if (maxSize > 0 && remaining > 0) {
+        len = bodyFile->read(data, qMin((qint64)maxSize, remaining));
+        if (len <= 0) {
             tSystemError("file read error: %s", qPrintable(bodyFile->fileName()));
             release();
         } else {
             ret += len;
+            if (len == remaining) {
+                nextFilePart();
+            }
         }
     }
     return ret;
@@ -101,15 +154,128 @@ int THttpSendBuffer::read(char *data, int maxSize)
 int THttpSendBuffer::prepend(const char *data, int maxSize)
 {
     if (arraySentSize > 0) {
-        arrayBuffer.remove(0, arraySentSize);
+        arraySegments.first().remove(0, arraySentSize);
+        arraySentSize = 0;
     }
-    arrayBuffer.prepend(data, maxSize);
-    arraySentSize = 0;
+    arraySegments.prepend(QByteArray(data, maxSize));
     return maxSize;
 }
 
 
+const char *THttpSendBuffer::segmentData(int index) const
+{
+    const char *data = arraySegments[index].constData();
+    return (index == 0) ? data + arraySentSize : data;
+}
+
+
+int THttpSendBuffer::segmentLength(int index) const
+{
+    int len = arraySegments[index].length();
+    return (index == 0) ? len - arraySentSize : len;
+}
+
+/*!
+  Returns the number of bytes of the byte array segments not sent yet.
+*/
+qint64 THttpSendBuffer::arrayLength() const
+{
+    qint64 len = -arraySentSize;
+    for (QListIterator<QByteArray> it(arraySegments); it.hasNext(); ) {
+        len += it.next().length();
+    }
+    return len;
+}
+
+/*!
+  Discards \a length bytes sent from the head of the byte array segments.
+*/
+void THttpSendBuffer::arraySent(qint64 length)
+{
+    while (length > 0 && !arraySegments.isEmpty()) {
+        int len = segmentLength(0);
+        if (length < len) {
+            arraySentSize += length;
+            break;
+        }
+        arraySegments.removeFirst();
+        arraySentSize = 0;
+        length -= len;
+    }
+}
+
+
+/*!
+  Returns the file handle of the body, or -1 if there is no file body.
+  The body can be sent directly from the handle, starting at fileOffset().
+*/
+int THttpSendBuffer::fileHandle() const
+{
+    return (bodyFile) ? bodyFile->handle() : -1;
+}
+
+
+qint64 THttpSendBuffer::fileOffset() const
+{
+    return (bodyFile) ? bodyFile->pos() : 0;
+}
+
+
+qint64 THttpSendBuffer::fileRemaining() const
+{
+    if (!bodyFile)
+        return 0;
+
+    qint64 end = (fileEnd < 0) ? bodyFile->size() : fileEnd;
+    return qMax(end - bodyFile->pos(), Q_INT64_C(0));
+}
+
+/*!
+  Advances the file offset by \a length bytes sent from the file handle.
+*/
+bool THttpSendBuffer::fileSent(qint64 length)
+{
+    if (!bodyFile)
+        return false;
+
+    if (!bodyFile->seek(bodyFile->pos() + length)) {
+        tSystemError("file seek error: %s", qPrintable(bodyFile->fileName()));
+        release();
+        return false;
+    }
+
+    if (fileRemaining() == 0) {
+        nextFilePart();
+    }
+    return true;
+}
+
+
 bool THttpSendBuffer::atEnd() const
 {
-    return arraySentSize >= arrayBuffer.length() && (!bodyFile || bodyFile->atEnd());
+    return arraySegments.isEmpty() && fileParts.isEmpty() && fileRemaining() == 0;
+}
+
+/*
+  Moves on to the next range of the file after the current one is
+  sent; its head is appended to the byte array segments.
+*/
+void THttpSendBuffer::nextFilePart()
+{
+    while (!fileParts.isEmpty()) {
+        THttpRangeFile::Part part = fileParts.takeFirst();
+        if (!part.head.isEmpty()) {
+            arraySegments << part.head;
+        }
+
+        if (part.length > 0 && bodyFile) {
+            if (!bodyFile->seek(part.offset)) {
+                tSystemError("file seek error: %s", qPrintable(bodyFile->fileName()));
+                release();
+                return;
+            }
+            fileEnd = part.offset + part.length;
+            break;
+        }
+    }
 }
@@ -2,8 +2,12 @@
 #define THTTPSENDBUFFER_H
 
 #include <QByteArray>
+#include <QList>
+#include <QSemaphore>
+#include <QSharedPointer>
 #include <TGlobal>
 #include <TAccessLog>
+#include "thttprangefile.h"
 
 class QFile;
 class QFileInfo;
@@ -14,23 +18,40 @@ class THttpHeader;
 class T_CORE_EXPORT THttpSendBuffer
 {
 public:
-    THttpSendBuffer(const QByteArray &header, const QFileInfo &file, bool autoRemove, const TAccessLogger &logger);
-    THttpSendBuffer(int statusCode, const QHostAddress &address, const QByteArray &method);
+    THttpSendBuffer(const QByteArray &header, const QFileInfo &file, bool autoRemove, const TAccessLogger &logger,
+                    const QList<THttpRangeFile::Part> &parts = QList<THttpRangeFile::Part>());
+    THttpSendBuffer(const QByteArray &header, const QByteArray &body, const TAccessLogger &logger);
+    THttpSendBuffer(int statusCode, const QHostAddress &address, const QByteArray &method, int retryAfter = 0);
     ~THttpSendBuffer();
 
     bool atEnd() const;
     int read(char *data, int maxSize);
     int prepend(const char *data, int maxSize);
+    int segmentCount() const { return arraySegments.count(); }
+    const char *segmentData(int index) const;
+    int segmentLength(int index) const;
+    qint64 arrayLength() const;
+    void arraySent(qint64 length);
+    int fileHandle() const;
+    qint64 fileOffset() const;
+    qint64 fileRemaining() const;
+    bool fileSent(qint64 length);
     TAccessLogger &accessLogger() { return accesslogger; }
     const TAccessLogger &accessLogger() const { return accesslogger; }
+    void setSemaphore(const QSharedPointer<QSemaphore> &semaphore) { sentSemaphore = semaphore; }
     void release();
 
 private:
-    QByteArray arrayBuffer;
+    void nextFilePart();
+
+    QList<QByteArray> arraySegments;
     QFile* bodyFile;
+    qint64 fileEnd;  // end of the current range, or -1 for the whole file
+    QList<THttpRangeFile::Part> fileParts;  // following ranges
     bool fileRemove;
     TAccessLogger accesslogger;
     int arraySentSize;
+    QSharedPointer<QSemaphore> sentSemaphore;  // released when destroyed
 
     THttpSendBuffer();
     Q_DISABLE_COPY(THttpSendBuffer)
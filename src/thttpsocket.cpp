@@ -15,10 +15,17 @@
 #include <TMultipartFormData>
 #include "thttpsocket.h"
 #include "tsystemglobal.h"
+#ifdef Q_OS_UNIX
+# include <sys/uio.h>
+# include <poll.h>
+# include <errno.h>
+# include <QVarLengthArray>
+# include "tfcore_unix.h"
+#endif
 
 const uint   READ_THRESHOLD_LENGTH = 2 * 1024 * 1024; // bytes
-const qint64 WRITE_LENGTH = 1280;
-const int    WRITE_BUFFER_LENGTH = WRITE_LENGTH * 512;
+const int    WRITE_BUFFER_LENGTH = 512 * 1024;
+const int    WRITE_TIMEOUT = 30000;  // msecs
 
 /*!
   \class THttpSocket
@@ -26,7 +33,7 @@ const int    WRITE_BUFFER_LENGTH = WRITE_LENGTH * 512;
 */
 
 THttpSocket::THttpSocket(QObject *parent)
-    : QTcpSocket(parent), lengthToRead(-1), lastProcessed(QDateTime::currentDateTime())
+    : QTcpSocket(parent), lengthToRead(-1), readBuffer(), parser(), lastProcessed(QDateTime::currentDateTime())
 {
     T_TRACEFUNC("");
     connect(this, SIGNAL(readyRead()), this, SLOT(readRequest()));
@@ -43,18 +50,17 @@ THttpRequest THttpSocket::read()
 {
     T_TRACEFUNC("");
     THttpRequest req;
-    if (canReadRequest()) {
-        int idx = readBuffer.indexOf("\r\n\r\n");
-        if (idx > 0) {
-            if (fileBuffer.isOpen()) {
-                fileBuffer.close();
-                req.setRequest(readBuffer.left(idx + 4), fileBuffer.fileName());
-            } else {
-                req.setRequest(readBuffer.left(idx + 4), readBuffer.mid(idx + 4));
-            }
-            readBuffer.clear();
-            req.setClientAddress(peerAddress());
+    if (canReadRequest() && parser.isHeaderComplete()) {
+        THttpRequestHeader header = parser.header(readBuffer);
+        if (fileBuffer.isOpen()) {
+            fileBuffer.close();
+            req.setRequest(header, fileBuffer.fileName());
+        } else {
+            req.setRequest(header, readBuffer.mid(parser.headerLength(), parser.contentLength()));
         }
+        readBuffer.clear();
+        parser.reset();
+        req.setClientAddress(peerAddress());
     }
     return req;
 }
@@ -71,21 +77,22 @@ qint64 THttpSocket::write(const THttpHeader *header, QIODevice *body)
         }
     }
 
-    // Writes HTTP header
-    QByteArray hdata = header->toByteArray();
-    qint64 total = writeRawData(hdata.data(), hdata.size());
+    QList<QByteArray> segments;
+    segments << header->toByteArray();
+
+    QBuffer *buffer = qobject_cast<QBuffer *>(body);
+    if (buffer) {
+        // Writes HTTP header and body at once
+        segments << buffer->data();
+    }
+
+    qint64 total = writeRawData(segments);
     if (total < 0) {
         return -1;
     }
 
     if (body) {
-        QBuffer *buffer = qobject_cast<QBuffer *>(body);
-        if (buffer) {
-            if (writeRawData(buffer->data().data(), buffer->size()) != buffer->size()) {
-                return -1;
-            }
-            total += buffer->size();
-        } else {
+        if (!buffer) {
             QByteArray buf(WRITE_BUFFER_LENGTH, 0);
             qint64 readLen = 0;
             while ((readLen = body->read(buf.data(), buf.size())) > 0) {
@@ -101,23 +108,100 @@ qint64 THttpSocket::write(const THttpHeader *header, QIODevice *body)
 
 
 qint64 THttpSocket::writeRawData(const char *data, qint64 size)
+{
+    QList<QByteArray> segments;
+    segments << QByteArray::fromRawData(data, size);
+    return writeRawData(segments);
+}
+
+/*!
+  Writes the byte arrays \a segments to the socket without concatenating
+  them; on UNIX, they are gathered by writev(). Returns the number of
+  bytes written, or -1 if an error occurred.
+*/
+qint64 THttpSocket::writeRawData(const QList<QByteArray> &segments)
 {
     qint64 total = 0;
-    for (;;) {
-        qint64 written = QTcpSocket::write(data + total, qMin(size - total, WRITE_LENGTH));
-        if (written <= 0) {
-            tWarn("socket write error: total:%d (%d)", (int)total, (int)written);
+
+#ifdef Q_OS_UNIX
+    // Flushes the data written by QTcpSocket
+    while (bytesToWrite() > 0) {
+        if (!waitForBytesWritten(WRITE_TIMEOUT)) {
+            tWarn("socket error: waitForBytesWritten function [%s]", qPrintable(errorString()));
+            return -1;
+        }
+    }
+
+    QVarLengthArray<struct iovec, 4> iov;
+    qint64 size = 0;
+    for (QListIterator<QByteArray> it(segments); it.hasNext(); ) {
+        const QByteArray &seg = it.next();
+        if (!seg.isEmpty()) {
+            struct iovec v;
+            v.iov_base = (void *)seg.constData();
+            v.iov_len = seg.length();
+            iov.append(v);
+            size += seg.length();
+        }
+    }
+
+    int fd = socketDescriptor();
+    int idx = 0;
+    while (total < size) {
+        ssize_t written;
+        EINTR_LOOP(written, ::writev(fd, iov.data() + idx, iov.size() - idx));
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Waits for the socket to be writable
+                struct pollfd pfd;
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                int ret;
+                EINTR_LOOP(ret, ::poll(&pfd, 1, WRITE_TIMEOUT));
+                if (ret > 0) {
+                    continue;
+                }
+            }
+            tWarn("socket write error: total:%d (errno:%d)", (int)total, errno);
             return -1;
         }
         total += written;
-        if (total >= size)
-            break;
 
-        if (!waitForBytesWritten()) {
+        // Skips the segments written
+        while (written > 0) {
+            if ((size_t)written >= iov[idx].iov_len) {
+                written -= iov[idx].iov_len;
+                ++idx;
+            } else {
+                iov[idx].iov_base = (char *)iov[idx].iov_base + written;
+                iov[idx].iov_len -= written;
+                written = 0;
+            }
+        }
+    }
+#else
+    for (QListIterator<QByteArray> it(segments); it.hasNext(); ) {
+        const QByteArray &seg = it.next();
+        qint64 len = 0;
+        while (len < seg.length()) {
+            qint64 written = QTcpSocket::write(seg.constData() + len, seg.length() - len);
+            if (written <= 0) {
+                tWarn("socket write error: total:%d (%d)", (int)total, (int)written);
+                return -1;
+            }
+            len += written;
+        }
+        total += len;
+    }
+
+    while (bytesToWrite() > 0) {
+        if (!waitForBytesWritten(WRITE_TIMEOUT)) {
             tWarn("socket error: waitForBytesWritten function [%s]", qPrintable(errorString()));
             break;
         }
     }
+#endif
     return total;
 }
 
@@ -135,7 +219,6 @@ bool THttpSocket::canReadRequest() const
 void THttpSocket::readRequest()
 {
     T_TRACEFUNC("");
-    uint limitBodyBytes = Tf::app()->appSettings().value("LimitRequestBody", "0").toUInt();
     qint64 bytes = 0;
     QByteArray buf;
 
@@ -162,29 +245,22 @@ void THttpSocket::readRequest()
 
         } else if (lengthToRead < 0) {
             readBuffer.append(buf);
-            int idx = readBuffer.indexOf("\r\n\r\n");
-            if (idx > 0) {
-                THttpRequestHeader header(readBuffer.left(idx + 4));
-                tSystemDebug("content-length: %d", header.contentLength());
-
-                if (limitBodyBytes > 0 && header.contentLength() > limitBodyBytes) {
-                    throw ClientErrorException(413);  // Request Entity Too Large
-                }
-
-                lengthToRead = qMax(idx + 4 + (qint64)header.contentLength() - readBuffer.length(), 0LL);
+            if (parser.parse(readBuffer)) {
+                int hlen = parser.headerLength();
+                lengthToRead = qMax(hlen + parser.contentLength() - readBuffer.length(), 0LL);
 
-                if (header.contentType().trimmed().startsWith("multipart/form-data")
-                    || header.contentLength() > READ_THRESHOLD_LENGTH) {
+                if (parser.isMultipartFormData() || parser.contentLength() > READ_THRESHOLD_LENGTH) {
                     // Writes to file buffer
                     if (!fileBuffer.open()) {
                         throw RuntimeException(QLatin1String("temporary file open error: ") + fileBuffer.fileTemplate(), __FILE__, __LINE__);
                     }
-                    if (readBuffer.length() > idx + 4) {
+                    if (readBuffer.length() > hlen) {
                         tSystemDebug("fileBuffer name: %s", qPrintable(fileBuffer.fileName()));
-                        if (fileBuffer.write(readBuffer.data() + idx + 4, readBuffer.length() - (idx + 4)) < 0) {
+                        if (fileBuffer.write(readBuffer.data() + hlen, readBuffer.length() - hlen) < 0) {
                             throw RuntimeException(QLatin1String("write error: ") + fileBuffer.fileName(), __FILE__, __LINE__);
                         }
                     }
+                    readBuffer.truncate(hlen);
                 }
             }
         } else {
@@ -7,6 +7,7 @@
 #include <THttpRequest>
 #include <TTemporaryFile>
 #include <TGlobal>
+#include "thttprequestparser.h"
 
 
 class T_CORE_EXPORT THttpSocket : public QTcpSocket
@@ -19,6 +20,7 @@ public:
     THttpRequest read();
     bool canReadRequest() const;
     qint64 write(const THttpHeader *header, QIODevice *body);
+    qint64 writeRawData(const QList<QByteArray> &segments);
     int idleTime() const;
 
 protected:
@@ -35,6 +37,7 @@ private:
 
     qint64 lengthToRead;
     QByteArray readBuffer;
+    THttpRequestParser parser;
     TTemporaryFile fileBuffer;
     QDateTime lastProcessed;
 };
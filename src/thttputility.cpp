@@ -60,6 +60,7 @@ Q_GLOBAL_STATIC_WITH_INITIALIZER(IntHash, reasonPhrase,
     x->insert(Tf::UnsupportedMediaType, "Unsupported Media Type");
     x->insert(Tf::RequestedRangeNotSatisfiable, "Requested Range Not Satisfiable");
     x->insert(Tf::ExpectationFailed, "Expectation Failed");
+    x->insert(Tf::RequestHeaderFieldsTooLarge, "Request Header Fields Too Large");
     // Server Error 5xx
     x->insert(Tf::InternalServerError, "Internal Server Error");
     x->insert(Tf::NotImplemented, "Not Implemented");
@@ -384,3 +385,47 @@ QDateTime THttpUtility::fromHttpDateTimeUTCString(const QByteArray &utc)
     }
     return QLocale(QLocale::C).toDateTime(utc.left(utc.lastIndexOf(' ')), HTTP_DATE_TIME_FORMAT);
 }
+
+/*!
+  Returns the entity-tag of the ETag header of a file, which is the
+  last modified time \a lastModified and the \a size in hexadecimal.
+*/
+QByteArray THttpUtility::toEntityTag(const QDateTime &lastModified, qint64 size)
+{
+    return '"' + QByteArray::number((qulonglong)lastModified.toTime_t(), 16) + '-'
+        + QByteArray::number(size, 16) + '"';
+}
+
+/*!
+  Returns true if the \a etag matches one of the comma-separated list
+  of the entity-tags \a entityTags, or it's "*", such as the value of
+  the If-None-Match header. The weak comparison is used; the prefixes
+  "W/" are ignored.
+*/
+bool THttpUtility::matchesEntityTag(const QByteArray &entityTags, const QByteArray &etag)
+{
+    QByteArray tag = (etag.startsWith("W/")) ? etag.mid(2) : etag;
+    int i = 0;
+    while (i < entityTags.length()) {
+        char c = entityTags[i];
+        if (c == ' ' || c == '\t' || c == ',') {
+            ++i;
+            continue;
+        }
+        if (c == '*')
+            return true;
+
+        if (entityTags.mid(i, 2) == "W/")
+            i += 2;
+        if (i >= entityTags.length() || entityTags[i] != '"')
+            break;  // invalid
+
+        int end = entityTags.indexOf('"', i + 1);
+        if (end < 0)
+            break;
+        if (entityTags.mid(i, end - i + 1) == tag)
+            return true;
+        i = end + 1;
+    }
+    return false;
+}
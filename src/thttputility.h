@@ -34,6 +34,8 @@ public:
     static QDateTime fromHttpDateTimeString(const QByteArray &localTime);
     static QByteArray toHttpDateTimeUTCString(const QDateTime &utc);
     static QDateTime fromHttpDateTimeUTCString(const QByteArray &utc);
+    static QByteArray toEntityTag(const QDateTime &lastModified, qint64 size);
+    static bool matchesEntityTag(const QByteArray &entityTags, const QByteArray &etag);
 
 private:
     THttpUtility();
@@ -0,0 +1,104 @@
+#ifndef TIOURING_H
+#define TIOURING_H
+
+#include <QVector>
+#include <TGlobal>
+#include "teventbackend.h"
+
+
+class T_CORE_EXPORT TIoUring
+{
+public:
+    TIoUring();
+    ~TIoUring();
+
+    bool setup(int entries, int completionEntries);
+    bool setupBuffers(int group, int count, int size);
+    bool isValid() const { return ringFd >= 0; }
+
+    bool prepareAccept(int fd, quint64 userData);
+    bool prepareRecv(int fd, int group, quint64 userData);
+    bool preparePoll(int fd, uint events, bool multishot, quint64 userData);
+    bool preparePollRemove(quint64 target, quint64 userData);
+    bool prepareCancel(int fd, bool linkNext, quint64 userData);
+    bool prepareClose(int fd, quint64 userData);
+
+    int submit();
+    int submitAndWait(int timeout);
+    bool nextCompletion(quint64 &userData, int &result, uint &flags);
+
+    const char *buffer(int bufferId) const;
+    void recycleBuffer(int bufferId);
+
+    static bool hasMore(uint flags);
+    static int bufferId(uint flags);
+    static bool isSupported();
+
+private:
+    struct Sqe;
+    Sqe *getSqe();
+
+    int ringFd;
+    int sqEntries;
+    uint sqMask;
+    uint *sqHead;
+    uint *sqTail;
+    uint *sqArray;
+    uint sqLocalTail;  // prepared, not submitted yet
+    Sqe *sqes;
+    uint cqMask;
+    uint *cqHead;
+    uint *cqTail;
+    void *cqes;
+    void *sqRing;
+    void *cqRing;
+    qint64 sqRingSize;
+    qint64 cqRingSize;
+    qint64 sqesSize;
+
+    // Provided buffers
+    void *bufRing;
+    qint64 bufRingSize;
+    char *bufData;
+    int bufCount;
+    int bufSize;
+    int bufGroup;
+    ushort bufTail;
+
+    Q_DISABLE_COPY(TIoUring)
+};
+
+
+class TIoUringBackend : public TEventBackend
+{
+public:
+    TIoUringBackend();
+    ~TIoUringBackend();
+
+    bool setup();
+    bool add(int fd, int type);
+    bool modify(int fd, int events);
+    bool remove(int fd);
+    void close(int fd);
+    int wait(int timeout, TEventHandler *handler);
+
+private:
+    struct Watch
+    {
+        Watch() : type(0), generation(0), active(false), writing(false) { }
+        int type;
+        uint generation;  // incremented for each add of the fd
+        bool active;
+        bool writing;     // polling for the output
+    };
+
+    bool isWatched(int fd, uint generation) const;
+    bool arm(int fd);
+
+    TIoUring ring;
+    QVector<Watch> watches;  // indexed by fd
+
+    Q_DISABLE_COPY(TIoUringBackend)
+};
+
+#endif // TIOURING_H
@@ -0,0 +1,822 @@
+/* Copyright (c) 2013, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+#include <QHostAddress>
+#include "tiouring.h"
+#include "tsystemglobal.h"
+#include "tfcore_unix.h"
+
+#ifdef __has_include
+# if __has_include(<linux/io_uring.h>)
+#  include <linux/io_uring.h>
+# endif
+#endif
+
+// Multishot recv with provided buffers; the newest of the features used
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+# define TF_HAVE_IO_URING
+#endif
+
+#define LOAD_ACQUIRE(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+const int URING_ENTRIES = 1024;  // submission queue
+const int URING_COMPLETION_ENTRIES = 8192;
+const int URING_BUFFER_GROUP = 0;
+const int URING_BUFFER_COUNT = 1024;  // provided for the recv
+const int URING_BUFFER_SIZE = 16384;
+
+// Operations of the backend, in the user data of the requests
+enum UringOperation {
+    UringIgnored = 0,  // the completion is not processed
+    UringAccept,
+    UringRecv,
+    UringPollIn,
+    UringPollOut,
+};
+
+
+#ifdef TF_HAVE_IO_URING
+
+struct TIoUring::Sqe : public io_uring_sqe
+{ };
+
+
+static inline int sysSetup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)::syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+static inline int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argsz)
+{
+    return (int)::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argsz);
+}
+
+
+static inline int sysRegister(int fd, unsigned opcode, void *arg, unsigned nrArgs)
+{
+    return (int)::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+/*
+  Returns true if the kernel is 6.0 or later, which supports the
+  multishot recv; it's not told by the features of the ring.
+*/
+static bool supportsMultishotRecv()
+{
+    struct utsname name;
+    int major = 0;
+    if (::uname(&name) < 0 || sscanf(name.release, "%d", &major) != 1)
+        return false;
+    return major >= 6;
+}
+
+#else
+
+struct TIoUring::Sqe
+{ };
+
+#endif // TF_HAVE_IO_URING
+
+/*!
+  \class TIoUring
+  \brief The TIoUring class is a thin wrapper of an io_uring instance,
+  the submission and completion queues shared with the kernel, for the
+  reactors of the hybrid MPM. The received data is read into the
+  buffers provided to the kernel by a buffer ring.
+  It's used by the thread which sets it up only.
+*/
+
+TIoUring::TIoUring()
+    : ringFd(-1), sqEntries(0), sqMask(0), sqHead(0), sqTail(0), sqArray(0), sqLocalTail(0), sqes(0),
+      cqMask(0), cqHead(0), cqTail(0), cqes(0), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqRingSize(0),
+      cqRingSize(0), sqesSize(0), bufRing(MAP_FAILED), bufRingSize(0), bufData(0), bufCount(0), bufSize(0),
+      bufGroup(0), bufTail(0)
+{ }
+
+
+TIoUring::~TIoUring()
+{
+    if (ringFd >= 0) {
+        // Pending requests are cancelled
+        ::close(ringFd);
+    }
+    if (bufRing != MAP_FAILED) {
+        ::munmap(bufRing, bufRingSize);
+    }
+    delete[] bufData;
+
+    if (sqes) {
+        ::munmap(sqes, sqesSize);
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        ::munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED) {
+        ::munmap(sqRing, sqRingSize);
+    }
+}
+
+/*!
+  Sets up the io_uring of the submission queue of \a entries and the
+  completion queue of \a completionEntries. Returns false if the kernel
+  does not support the features used.
+*/
+bool TIoUring::setup(int entries, int completionEntries)
+{
+#ifdef TF_HAVE_IO_URING
+    if (ringFd >= 0 || !supportsMultishotRecv())
+        return false;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = completionEntries;
+
+    int fd = sysSetup(entries, &params);
+    if (fd < 0) {
+        tSystemWarn("Failed io_uring_setup  errno:%d", errno);
+        return false;
+    }
+
+    // The timeout of waiting is passed by the extended argument
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        ::close(fd);
+        return false;
+    }
+    ringFd = fd;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize = cqRingSize = qMax(sqRingSize, cqRingSize);
+    }
+
+    sqRing = ::mmap(0, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+        goto mmap_error;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } else {
+        cqRing = ::mmap(0, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED)
+            goto mmap_error;
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (Sqe *)::mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if ((void *)sqes == MAP_FAILED) {
+        sqes = 0;
+        goto mmap_error;
+    }
+
+    sqEntries = params.sq_entries;
+    sqMask = *(uint *)((char *)sqRing + params.sq_off.ring_mask);
+    sqHead = (uint *)((char *)sqRing + params.sq_off.head);
+    sqTail = (uint *)((char *)sqRing + params.sq_off.tail);
+    sqArray = (uint *)((char *)sqRing + params.sq_off.array);
+    sqLocalTail = *sqTail;
+    for (uint i = 0; i < params.sq_entries; ++i) {
+        sqArray[i] = i;  // the entries are used in order
+    }
+
+    cqMask = *(uint *)((char *)cqRing + params.cq_off.ring_mask);
+    cqHead = (uint *)((char *)cqRing + params.cq_off.head);
+    cqTail = (uint *)((char *)cqRing + params.cq_off.tail);
+    cqes = (char *)cqRing + params.cq_off.cqes;
+    return true;
+
+mmap_error:
+    tSystemError("Failed mmap of io_uring  errno:%d", errno);
+    ::close(ringFd);
+    ringFd = -1;
+    return false;
+#else
+    Q_UNUSED(entries);
+    Q_UNUSED(completionEntries);
+    return false;
+#endif
+}
+
+/*!
+  Provides the kernel with the \a count buffers of \a size bytes as the
+  buffer group \a group, which the data is received into. The \a count
+  is rounded up to a power of two.
+*/
+bool TIoUring::setupBuffers(int group, int count, int size)
+{
+#ifdef TF_HAVE_IO_URING
+    if (ringFd < 0 || bufData)
+        return false;
+
+    int entries = 1;
+    while (entries < count) {
+        entries <<= 1;
+    }
+    if (entries > 32768)
+        return false;
+
+    bufRingSize = entries * sizeof(struct io_uring_buf);
+    bufRing = ::mmap(0, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufRing == MAP_FAILED) {
+        tSystemError("Failed mmap of buffer ring  errno:%d", errno);
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (quint64)(quintptr)bufRing;
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    if (sysRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        tSystemWarn("Failed to register buffer ring  errno:%d", errno);
+        ::munmap(bufRing, bufRingSize);
+        bufRing = MAP_FAILED;
+        return false;
+    }
+
+    bufData = new char[(qint64)entries * size];
+    bufCount = entries;
+    bufSize = size;
+    bufGroup = group;
+    bufTail = 0;
+    for (int i = 0; i < entries; ++i) {
+        recycleBuffer(i);
+    }
+    return true;
+#else
+    Q_UNUSED(group);
+    Q_UNUSED(count);
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+/*!
+  Returns a submission queue entry cleared, or 0 if the queue is full
+  even after the entries prepared are submitted.
+*/
+TIoUring::Sqe *TIoUring::getSqe()
+{
+#ifdef TF_HAVE_IO_URING
+    if (sqLocalTail - LOAD_ACQUIRE(sqHead) >= (uint)sqEntries) {
+        submit();
+        if (sqLocalTail - LOAD_ACQUIRE(sqHead) >= (uint)sqEntries) {
+            tSystemError("io_uring submission queue full");
+            return 0;
+        }
+    }
+
+    Sqe *sqe = &sqes[sqLocalTail++ & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+#else
+    return 0;
+#endif
+}
+
+/*!
+  Prepares the multishot accept on the listening socket \a fd; the
+  sockets accepted are non-blocking.
+*/
+bool TIoUring::prepareAccept(int fd, quint64 userData)
+{
+#ifdef TF_HAVE_IO_URING
+    Sqe *sqe = getSqe();
+    if (!sqe)
+        return false;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = userData;
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(userData);
+    return false;
+#endif
+}
+
+/*!
+  Prepares the multishot recv on the socket \a fd into the buffers of
+  the group \a group.
+*/
+bool TIoUring::prepareRecv(int fd, int group, quint64 userData)
+{
+#ifdef TF_HAVE_IO_URING
+    Sqe *sqe = getSqe();
+    if (!sqe)
+        return false;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->user_data = userData;
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(group);
+    Q_UNUSED(userData);
+    return false;
+#endif
+}
+
+/*!
+  Prepares the poll of the \a events on the \a fd. If \a multishot is
+  true, it's completed every time the events occur.
+*/
+bool TIoUring::preparePoll(int fd, uint events, bool multishot, quint64 userData)
+{
+#ifdef TF_HAVE_IO_URING
+    Sqe *sqe = getSqe();
+    if (!sqe)
+        return false;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = (multishot) ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = userData;
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(events);
+    Q_UNUSED(multishot);
+    Q_UNUSED(userData);
+    return false;
+#endif
+}
+
+/*!
+  Prepares the removal of the poll of the user data \a target.
+*/
+bool TIoUring::preparePollRemove(quint64 target, quint64 userData)
+{
+#ifdef TF_HAVE_IO_URING
+    Sqe *sqe = getSqe();
+    if (!sqe)
+        return false;
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = userData;
+    return true;
+#else
+    Q_UNUSED(target);
+    Q_UNUSED(userData);
+    return false;
+#endif
+}
+
+/*!
+  Prepares the cancellation of all the requests on the \a fd. If
+  \a linkNext is true, the next entry is linked to it, and executed
+  after it whether or not any request is cancelled.
+*/
+bool TIoUring::prepareCancel(int fd, bool linkNext, quint64 userData)
+{
+#ifdef TF_HAVE_IO_URING
+    Sqe *sqe = getSqe();
+    if (!sqe)
+        return false;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->flags = (linkNext) ? IOSQE_IO_HARDLINK : 0;
+    sqe->user_data = userData;
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(linkNext);
+    Q_UNUSED(userData);
+    return false;
+#endif
+}
+
+/*!
+  Prepares closing the \a fd.
+*/
+bool TIoUring::prepareClose(int fd, quint64 userData)
+{
+#ifdef TF_HAVE_IO_URING
+    Sqe *sqe = getSqe();
+    if (!sqe)
+        return false;
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(userData);
+    return false;
+#endif
+}
+
+/*!
+  Submits the entries prepared. Returns the number of them submitted,
+  or -1 on error.
+*/
+int TIoUring::submit()
+{
+#ifdef TF_HAVE_IO_URING
+    STORE_RELEASE(sqTail, sqLocalTail);
+    uint count = sqLocalTail - LOAD_ACQUIRE(sqHead);
+    if (count == 0)
+        return 0;
+
+    int ret;
+    do {
+        ret = sysEnter(ringFd, count, 0, 0, 0, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        tSystemError("Failed io_uring_enter  errno:%d", errno);
+    }
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+/*!
+  Submits the entries prepared, and waits for a completion up to
+  \a timeout msecs; if \a timeout is -1, waits without timeout.
+  Returns the number of the entries submitted, or -1 on error.
+*/
+int TIoUring::submitAndWait(int timeout)
+{
+#ifdef TF_HAVE_IO_URING
+    STORE_RELEASE(sqTail, sqLocalTail);
+    uint count = sqLocalTail - LOAD_ACQUIRE(sqHead);
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        arg.ts = (quint64)(quintptr)&ts;
+    }
+
+    int ret = sysEnter(ringFd, count, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret < 0) {
+        if (errno == ETIME || errno == EINTR || errno == EBUSY) {
+            return 0;  // no completions
+        }
+        tSystemError("Failed io_uring_enter  errno:%d", errno);
+    }
+    return ret;
+#else
+    Q_UNUSED(timeout);
+    return -1;
+#endif
+}
+
+/*!
+  Takes the next completion out of the completion queue. Returns false
+  if it's empty.
+*/
+bool TIoUring::nextCompletion(quint64 &userData, int &result, uint &flags)
+{
+#ifdef TF_HAVE_IO_URING
+    uint head = *cqHead;
+    if (head == LOAD_ACQUIRE(cqTail))
+        return false;
+
+    const struct io_uring_cqe *cqe = (const struct io_uring_cqe *)cqes + (head & cqMask);
+    userData = cqe->user_data;
+    result = cqe->res;
+    flags = cqe->flags;
+    STORE_RELEASE(cqHead, head + 1);
+    return true;
+#else
+    Q_UNUSED(userData);
+    Q_UNUSED(result);
+    Q_UNUSED(flags);
+    return false;
+#endif
+}
+
+/*!
+  Returns the data of the buffer \a bufferId provided.
+*/
+const char *TIoUring::buffer(int bufferId) const
+{
+    return bufData + (qint64)bufferId * bufSize;
+}
+
+/*!
+  Returns the buffer \a bufferId to the kernel, after its data is read.
+*/
+void TIoUring::recycleBuffer(int bufferId)
+{
+#ifdef TF_HAVE_IO_URING
+    // Not by io_uring_buf_ring; its flexible array is shifted in C++.
+    // The tail is overlaid with the reserved field of the first entry.
+    struct io_uring_buf *bufs = (struct io_uring_buf *)bufRing;
+    struct io_uring_buf *buf = &bufs[bufTail & (bufCount - 1)];
+    buf->addr = (quint64)(quintptr)(bufData + (qint64)bufferId * bufSize);
+    buf->len = bufSize;
+    buf->bid = bufferId;
+    STORE_RELEASE(&bufs[0].resv, ++bufTail);
+#else
+    Q_UNUSED(bufferId);
+#endif
+}
+
+/*!
+  Returns true if the multishot request of the completion \a flags
+  continues; otherwise it must be submitted again.
+*/
+bool TIoUring::hasMore(uint flags)
+{
+#ifdef TF_HAVE_IO_URING
+    return flags & IORING_CQE_F_MORE;
+#else
+    Q_UNUSED(flags);
+    return false;
+#endif
+}
+
+/*!
+  Returns the ID of the buffer which the data of the completion
+  \a flags is received into, or -1 if none.
+*/
+int TIoUring::bufferId(uint flags)
+{
+#ifdef TF_HAVE_IO_URING
+    return (flags & IORING_CQE_F_BUFFER) ? (int)(flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+#else
+    Q_UNUSED(flags);
+    return -1;
+#endif
+}
+
+/*!
+  Returns true if the io_uring with the features used is available.
+*/
+bool TIoUring::isSupported()
+{
+    TIoUring uring;
+    return uring.setup(4, 8) && uring.setupBuffers(0, 2, 64);
+}
+
+/*
+  Returns the user data of the request of the \a operation on the \a fd;
+  the \a generation of the watch tells the completions of the former
+  watches of the same fd.
+*/
+static inline quint64 uringData(int operation, int fd, uint generation = 0)
+{
+    return ((quint64)operation << 56) | ((quint64)(generation & 0xffffff) << 32) | (uint)fd;
+}
+
+/*!
+  \class TIoUringBackend
+  \brief The TIoUringBackend class is the event backend by io_uring.
+  The listening socket is accepted and a connection is received by the
+  multishot requests, and the notifiers are polled for the input. The
+  data is received into the buffers provided, which are recycled after
+  the handler processes it. The output of a connection is waited for
+  by a one-shot poll.
+*/
+
+TIoUringBackend::TIoUringBackend()
+    : ring(), watches()
+{ }
+
+
+TIoUringBackend::~TIoUringBackend()
+{
+    // Submits the closing of the sockets left
+    ring.submit();
+}
+
+/*!
+  Sets up the io_uring and the buffers provided. Returns false if it's
+  not available.
+*/
+bool TIoUringBackend::setup()
+{
+    return ring.setup(URING_ENTRIES, URING_COMPLETION_ENTRIES)
+        && ring.setupBuffers(URING_BUFFER_GROUP, URING_BUFFER_COUNT, URING_BUFFER_SIZE);
+}
+
+/*!
+  Watches the \a fd of the \a type for the input.
+*/
+bool TIoUringBackend::add(int fd, int type)
+{
+    if (fd >= watches.count()) {
+        watches.resize(qMax(fd + 1, watches.count() * 2));
+    }
+
+    Watch &w = watches[fd];
+    w.type = type;
+    w.generation++;
+    w.active = true;
+    w.writing = false;
+    return arm(fd);
+}
+
+/*!
+  Changes the \a events watched on the connection \a fd; the output is
+  waited for by a one-shot poll.
+*/
+bool TIoUringBackend::modify(int fd, int events)
+{
+    if (fd >= watches.count() || !watches[fd].active)
+        return true;
+
+    Watch &w = watches[fd];
+    quint64 pollOut = uringData(UringPollOut, fd, w.generation);
+    bool ret = true;
+    if ((events & Writable) && !w.writing) {
+        ret = ring.preparePoll(fd, POLLOUT, false, pollOut);
+    } else if (!(events & Writable) && w.writing) {
+        ret = ring.preparePollRemove(pollOut, uringData(UringIgnored, fd));
+    }
+
+    if (!ret) {
+        tSystemError("Failed to prepare io_uring poll  fd:%d", fd);
+        return false;
+    }
+    w.writing = (events & Writable);
+    return true;
+}
+
+/*!
+  Stops watching the \a fd; the requests on it are cancelled at once,
+  since it may be closed next.
+*/
+bool TIoUringBackend::remove(int fd)
+{
+    if (fd < watches.count()) {
+        watches[fd].active = false;
+    }
+    ring.prepareCancel(fd, false, uringData(UringIgnored, fd));
+    ring.submit();
+    return true;
+}
+
+/*!
+  Cancels the requests on the \a fd, and then closes it by the request
+  linked to the cancellation.
+*/
+void TIoUringBackend::close(int fd)
+{
+    if (fd < watches.count()) {
+        watches[fd].active = false;
+    }
+
+    if (!ring.prepareCancel(fd, true, uringData(UringIgnored, fd))
+        || !ring.prepareClose(fd, uringData(UringIgnored, fd))) {
+        // The requests left complete by the shutdown
+        ::shutdown(fd, SHUT_RDWR);
+        TF_CLOSE(fd);
+    }
+}
+
+/*!
+  Submits the requests prepared, waits for the completions up to
+  \a timeout msecs, and passes their events to the \a handler.
+  Returns the number of the completions, or -1 on error.
+*/
+int TIoUringBackend::wait(int timeout, TEventHandler *handler)
+{
+    if (ring.submitAndWait(timeout) < 0)
+        return -1;
+
+    int count = 0;
+    quint64 data;
+    int res;
+    uint flags;
+
+    while (ring.nextCompletion(data, res, flags)) {
+        ++count;
+        int operation = (int)(data >> 56);
+        uint generation = (uint)(data >> 32) & 0xffffff;
+        int fd = (int)(uint)data;
+        bool more = TIoUring::hasMore(flags);
+
+        switch (operation) {
+        case UringAccept:
+            if (res >= 0) {
+                struct sockaddr_storage addr;
+                socklen_t addrlen = sizeof(addr);
+                bool inet = (::getpeername(res, (sockaddr *)&addr, &addrlen) == 0 && addr.ss_family != AF_UNIX);
+                handler->acceptEvent(res, (inet) ? QHostAddress((sockaddr *)&addr) : QHostAddress());
+            } else if (res != -ECANCELED) {
+                tSystemWarn("Failed accept  errno:%d", -res);
+            }
+
+            if (!more && res != -ECANCELED && isWatched(fd, generation)) {
+                arm(fd);
+            }
+            break;
+
+        case UringRecv: {
+            int bid = TIoUring::bufferId(flags);
+            if (isWatched(fd, generation)) {
+                if (res > 0 && bid >= 0) {
+                    handler->receiveEvent(fd, ring.buffer(bid), res);
+                } else if (res != -ENOBUFS) {
+                    // Disconnect
+                    handler->disconnectEvent(fd, (res < 0) ? -res : 0);
+                }
+
+                // Receives again if the multishot recv has ended,
+                // e.g. by running out of the buffers
+                if (!more && isWatched(fd, generation) && !arm(fd)) {
+                    handler->disconnectEvent(fd, 0);
+                }
+            }
+
+            if (bid >= 0) {
+                ring.recycleBuffer(bid);
+            }
+            break; }
+
+        case UringPollIn:
+            if (isWatched(fd, generation)) {
+                handler->notifyEvent(fd);
+                if (!more && res >= 0 && isWatched(fd, generation)) {
+                    arm(fd);
+                }
+            }
+            break;
+
+        case UringPollOut:
+            if (res >= 0 && isWatched(fd, generation) && watches[fd].writing) {
+                // Send data
+                watches[fd].writing = false;
+                handler->sendEvent(fd);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+    return count;
+}
+
+/*
+  Returns true if the \a fd is watched by the watch of the \a generation.
+*/
+bool TIoUringBackend::isWatched(int fd, uint generation) const
+{
+    return fd >= 0 && fd < watches.count() && watches[fd].active
+        && (watches[fd].generation & 0xffffff) == generation;
+}
+
+/*
+  Prepares the request watching the input of the \a fd by its type.
+*/
+bool TIoUringBackend::arm(int fd)
+{
+    const Watch &w = watches[fd];
+    bool ret;
+    switch (w.type) {
+    case Listener:
+        ret = ring.prepareAccept(fd, uringData(UringAccept, fd, w.generation));
+        break;
+    case Connection:
+        ret = ring.prepareRecv(fd, URING_BUFFER_GROUP, uringData(UringRecv, fd, w.generation));
+        break;
+    default:
+        ret = ring.preparePoll(fd, POLLIN, true, uringData(UringPollIn, fd, w.generation));
+        break;
+    }
+
+    if (!ret) {
+        tSystemError("Failed to prepare io_uring request  fd:%d", fd);
+    }
+    return ret;
+}
@@ -255,6 +255,18 @@ void TKvsDatabasePool2::timerEvent(QTimerEvent *event)
         return;
     }
 
+    closeConnections(30);
+}
+
+/*!
+  Closes the KVS connections in the pool which have not been used for
+  \a idleSecs seconds. If \a idleSecs is 0, closes all of them.
+*/
+void TKvsDatabasePool2::closeConnections(int idleSecs)
+{
+    if (!dbSet)
+        return;
+
     int typeCnt = kvsTypeHash()->count();
 
     // Closes connection
@@ -262,7 +274,7 @@ void TKvsDatabasePool2::timerEvent(QTimerEvent *event)
         for (int i = 0; i < dbSet[j].maxCount(); ++i) {
             DatabaseUse *du = (DatabaseUse *)dbSet[j].peekPop(i);
             if (du) {
-                if (du->lastUsed < QDateTime::currentDateTime().toTime_t() - 30) {
+                if (idleSecs <= 0 || du->lastUsed < QDateTime::currentDateTime().toTime_t() - idleSecs) {
                     TKvsDatabase db = TKvsDatabase::database(du->dbName);
                     if (db.isOpen()) {
                         db.close();
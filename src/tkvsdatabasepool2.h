@@ -18,6 +18,7 @@ public:
     ~TKvsDatabasePool2();
     TKvsDatabase database(TKvsDatabase::Type type);
     void pool(TKvsDatabase &database);
+    void closeConnections(int idleSecs = 0);
 
     static void instantiate();
     static TKvsDatabasePool2 *instance();
@@ -2,7 +2,7 @@
 #define TMULTIPLEXINGSERVER_H
 
 #include <QThread>
-#include <QMap>
+#include <QVector>
 #include <QQueue>
 #include <QList>
 #include <QByteArray>
@@ -11,13 +11,15 @@
 #include <TGlobal>
 #include <TApplicationServerBase>
 #include <TAccessLog>
-#include "tatomicqueue.h"
 
 class QIODevice;
+class QHostAddress;
 class THttpRequest;
 class THttpHeader;
 class THttpBuffer;
 class THttpSendBuffer;
+class TEventBackend;
+template <class T, bool MultiConsumer> class TBoundedQueue;
 
 
 class T_CORE_EXPORT TMultiplexingServer : public QThread, public TApplicationServerBase
@@ -28,29 +30,46 @@ public:
 
     bool isListening() const { return listenSocket > 0; }
     bool start();
-    void stop() { stopped = true; }
+    void stop();
+    int reactorId() const { return id; }
+    int sendTimeoutSecs() const { return sendTimeout; }
+    void setSocketDescriptor(int socket);
 
     void setSendRequest(int fd, const THttpHeader *header, QIODevice *body, bool autoRemove, const TAccessLogger &accessLogger);
+    void setSendRequest(int fd, THttpSendBuffer *buffer, bool closeAfterSend, bool partial);
     void setDisconnectRequest(int fd);
+    void releaseWorker();
+    static void loadStaticFile(const QString &path);
+
+    // Statistics of the pending requests
+    int pendingRequestCount() const;
+    int lastPendingWaitTime() const;
+    int peakPendingWaitTime() const;
+    int rejectedRequestCount() const;
 
     static void instantiate();
     static TMultiplexingServer *instance();
+    static TMultiplexingServer *instance(int reactorId);
+    static int reactorCount();
 
 protected:
     void run();
-    int epollAdd(int fd, int events);
-    int epollModify(int fd, int events);
-    int epollDel(int fd);
-    void epollClose(int fd);
+    int watch(int fd, int type);
+    int watchEvents(int fd, int events);
+    int unwatch(int fd);
+    void closeSocket(int fd);
     int getSendRequest();
-    void emitIncomingRequest(int fd, THttpBuffer &buffer);
-
-signals:
-    bool incomingHttpRequest(int fd, const QByteArray &request, const QString &address);
+    void wakeup();
+    bool reserveWorker();
+    void emitIncomingRequest(int fd);
+    void expireTimers();
+    void dispatchPendingRequests();
+    void reportLoad();
+    void rejectRequest(int fd);
+    void respondClientError(int fd, int statusCode);
 
 protected slots:
     void terminate();
-    void deleteActionContext();
 
 private:
     struct SendData
@@ -62,37 +81,72 @@ private:
         int method;
         int fd;
         THttpSendBuffer *buffer;
+        bool closeAfterSend;
+        bool partial;  // the rest of the response follows
     };
 
+    struct Connection;
+    class EventHandler;
+
+    int id;
     int maxWorkers;
+    int keepAliveMaxRequests;
+    int keepAliveTimeout;
+    bool reportsLoad;  // started by tfmanager, which the load is reported to
+    int headerReadTimeout;
+    int bodyReadTimeout;
+    int sendTimeout;
+    int maxPendingRequests;
+    int maxPendingWaitTime;  // msecs
+    int retryAfter;          // secs
+    QList<QByteArray> priorityPaths;
     volatile bool stopped;
+    volatile bool finished;  // the event loop has exited
     int listenSocket;
-    int epollFd;
-    QMap<int, THttpBuffer> recvBuffers;
-    QMap<int, QQueue<THttpSendBuffer*> > sendBuffers;
-    TAtomicQueue<SendData*> sendRequests;
-    QList<int> pendingRequests;
-    QAtomicInt threadCounter;
-
-    TMultiplexingServer(QObject *parent = 0);  // Constructor
-    friend class TWorkerStarter;
+    bool ownListenSocket;  // closed by this reactor
+    TEventBackend *backend;  // epoll or io_uring
+    int eventFd;  // wakes the reactor up
+    int loadTimerFd;  // reports the load periodically
+    QAtomicInt wakeupPending;
+    QAtomicInt hasPendingRequests;
+    QVector<Connection *> connections;  // indexed by fd
+    QVector<Connection *> timerWheel;   // lists of the connections by the deadline
+    int timerCount;
+    uint timerTick;  // secs of the last tick
+    int connectionCount;
+    TBoundedQueue<SendData*, false> *sendRequests;
+    QQueue<int> pendingRequests;
+    QQueue<int> priorityRequests;  // dispatched before the pending requests
+    int pendingCount;
+    QAtomicInt pendingDepth;
+    QAtomicInt lastWaitTime;
+    QAtomicInt peakWaitTime;
+    QAtomicInt rejectedCount;
+    char *copyBuffer;  // used if sendfile() is not available
+    int copyBufferSize;
+    QByteArray httpDate;  // Date header field
+    qint64 httpDateTime;
+    QAtomicInt threadCounter;  // workers of this reactor
+    static QAtomicInt totalThreadCounter;  // workers of all the reactors
+
+    void enqueueSendRequest(SendData *data);
+    Connection *connection(int fd) const;
+    Connection *openConnection(int fd);
+    void acceptConnection(int fd, const QHostAddress &address);
+    void receiveData(int fd, Connection *conn, const char *data, int length);
+    void processNotification(int fd);
+    void dispatchRequest(int fd, Connection *conn);
+    bool serveStaticFile(int fd, Connection *conn);
+    const QByteArray &currentHttpDate();
+    void enqueuePendingRequest(int fd, Connection *conn);
+    void setTimer(Connection *conn, int type, int timeout);
+    void cancelTimer(Connection *conn);
+    void updateTimer(Connection *conn);
+    void sendData(int fd, Connection *conn);
+    bool writeSendBuffers(int fd, Connection *conn);
+
+    TMultiplexingServer(int reactorId, QObject *parent = 0);  // Constructor
     Q_DISABLE_COPY(TMultiplexingServer)
 };
 
-
-/*
- * WorkerStarter class declaration
- * This object creates worker threads in the main event loop.
- */
-class TWorkerStarter : public QObject
-{
-    Q_OBJECT
-public:
-    TWorkerStarter(QObject *parent = 0) : QObject(parent) { }
-    virtual ~TWorkerStarter();
-
-public slots:
-    void startWorker(int fd, const QByteArray &request, const QString &address);
-};
-
 #endif // TMULTIPLEXINGSERVER_H
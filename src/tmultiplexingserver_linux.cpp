@@ -7,14 +7,23 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <iostream>
 #include <QHostAddress>
 #include <QBuffer>
+#include <QFile>
+#include <QStringList>
+#include <QDateTime>
+#include <QLocale>
 #include <TWebApplication>
 #include <TApplicationServerBase>
 #include <TMultiplexingServer>
@@ -23,79 +32,247 @@
 #include <TActionWorker>
 #include <THttpHeader>
 #include <THttpRequest>
+#include <THttpUtility>
 #include "thttpbuffer.h"
 #include "thttpsendbuffer.h"
+#include "tstaticfilecache.h"
+#include "thttpcompression.h"
+#include "thttprangefile.h"
+#include "teventbackend.h"
+#include "tboundedqueue.h"
 #include "tfcore_unix.h"
 
-const int SEND_BUF_SIZE = 256 * 1024;
-const int RECV_BUF_SIZE = 256 * 1024;
-static TMultiplexingServer *multiplexingServer = 0;
+const int SENDFILE_MAX_SIZE = 2 * 1024 * 1024;
+const int MAX_IOV_COUNT = 16;
+const int PENDING_CHECK_INTERVAL = 100;  // msecs
+const int TIMER_WHEEL_SIZE = 64;  // slots of a second, power of two
+const int LOAD_REPORT_INTERVAL = 1;  // secs
+const int STOP_DRAIN_TIME = 5000;  // msecs
+
+enum TimerType {
+    NoTimer = 0,
+    HeaderTimer,  // receiving the header of a request
+    BodyTimer,    // receiving the body
+    SendTimer,    // sending the response
+    IdleTimer,    // waiting for the next request
+};
+
+static QList<TMultiplexingServer *> reactors;
+static TStaticFileCache *staticFileCache = 0;
+QAtomicInt TMultiplexingServer::totalThreadCounter(0);
+
+/*
+  State of a connection. The objects are held in the table indexed
+  by fd, and reused for the next connection of the same fd.
+*/
+struct TMultiplexingServer::Connection
+{
+    Connection() : fd(0), events(0), requestCount(0), pendingSince(0), timerType(NoTimer), deadline(0),
+                   timerPrev(0), timerNext(0), active(false), processing(false), pending(false),
+                   keepAlive(false), closing(false), invalid(false) { }
+    THttpBuffer recvBuffer;
+    QQueue<THttpSendBuffer*> sendBuffers;
+    int fd;
+    int events;  // watched by the event backend
+    int requestCount;
+    qint64 pendingSince;  // msecs of the monotonic clock
+    int timerType;
+    uint deadline;  // secs of the monotonic clock
+    Connection *timerPrev;  // in the slot of the timer wheel
+    Connection *timerNext;
+    bool active;
+    bool processing;  // a worker is processing a request
+    bool pending;     // waiting for a worker
+    bool keepAlive;   // keeps the connection after the response
+    bool closing;     // closed by the peer while processing
+    bool invalid;     // received an invalid request; the rest is discarded
+};
+
+
+/*
+  Returns the msecs of the monotonic clock.
+*/
+static qint64 currentMSecs()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (qint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static inline uint currentSecs()
+{
+    return (uint)(currentMSecs() / 1000);
+}
 
 
 static void cleanup()
 {
-    if (multiplexingServer) {
-        delete multiplexingServer;
-        multiplexingServer = 0;
+    for (QListIterator<TMultiplexingServer *> it(reactors); it.hasNext(); ) {
+        delete it.next();
     }
+    reactors.clear();
+
+    delete staticFileCache;
+    staticFileCache = 0;
 }
 
+/*
+  Sends the data of the send-buffer to the socket without copying it;
+  the byte array segments are gathered by sendmsg() with MSG_MORE so that
+  they go out with the head of the file body, which is sent by sendfile().
+  Returns the number of bytes sent, 0 if the socket is not writable,
+  or -1 on error.
+*/
+static qint64 sendDirect(int fd, THttpSendBuffer *sendbuf)
+{
+    qint64 total = 0;
+    ssize_t res;
+    int fh = sendbuf->fileHandle();
+    qint64 remaining = sendbuf->fileRemaining();
+
+    int count = qMin(sendbuf->segmentCount(), MAX_IOV_COUNT);
+    if (count > 0) {
+        struct iovec iov[MAX_IOV_COUNT];
+        qint64 len = 0;
+        for (int i = 0; i < count; ++i) {
+            iov[i].iov_base = (void *)sendbuf->segmentData(i);
+            iov[i].iov_len = sendbuf->segmentLength(i);
+            len += iov[i].iov_len;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        bool more = (count < sendbuf->segmentCount()) || (fh >= 0 && remaining > 0);
+        EINTR_LOOP(res, ::sendmsg(fd, &msg, (more ? MSG_MORE : 0)));
+        if (res < 0) {
+            return (errno == EAGAIN) ? 0 : -1;
+        }
+
+        sendbuf->arraySent(res);
+        total += res;
+        if (res < len || sendbuf->segmentCount() > 0) {
+            return total;
+        }
+    }
 
+    if (fh >= 0 && remaining > 0) {
+        off_t offset = sendbuf->fileOffset();
+        EINTR_LOOP(res, ::sendfile(fd, fh, &offset, qMin(remaining, (qint64)SENDFILE_MAX_SIZE)));
+        if (res < 0) {
+            return (errno == EAGAIN) ? total : -1;
+        }
+        if (res == 0) {
+            // The file was truncated
+            errno = EIO;
+            return -1;
+        }
+
+        if (!sendbuf->fileSent(res)) {
+            errno = EIO;
+            return -1;
+        }
+        total += res;
+    }
+    return total;
+}
+
+/*!
+  Creates the reactors. The number of them is set by the setting
+  \a MPM.hybrid.ReactorThreads in the application.ini; if it's 0 or
+  not specified, the number of CPU cores is used.
+*/
 void TMultiplexingServer::instantiate()
 {
-    if (!multiplexingServer) {
-        multiplexingServer = new TMultiplexingServer();
-        TWorkerStarter *starter = new TWorkerStarter(multiplexingServer);
-        connect(multiplexingServer, SIGNAL(incomingHttpRequest(int, const QByteArray &, const QString &)), starter, SLOT(startWorker(int, const QByteArray &, const QString &)));
+    if (reactors.isEmpty()) {
+        int num = Tf::app()->appSettings().value("MPM.hybrid.ReactorThreads").toInt();
+        if (num <= 0) {
+            num = qMax(QThread::idealThreadCount(), 1);
+        }
+        tSystemDebug("Reactor threads: %d", num);
+
+        for (int i = 0; i < num; ++i) {
+            reactors << new TMultiplexingServer(i);
+        }
+
         qAddPostRoutine(::cleanup);
     }
 }
 
-
+/*!
+  Returns a pointer to the primary reactor, which starts up all
+  the reactors.
+*/
 TMultiplexingServer *TMultiplexingServer::instance()
 {
-    if (!multiplexingServer) {
+    if (reactors.isEmpty()) {
         tFatal("Call TMultiplexingServer::instantiate() function first");
     }
-    return multiplexingServer;
+    return reactors.first();
 }
 
-
-static void setNonBlocking(int sock)
+/*!
+  Returns a pointer to the reactor with the ID \a reactorId.
+*/
+TMultiplexingServer *TMultiplexingServer::instance(int reactorId)
 {
-    int flag = fcntl(sock, F_GETFL);
-    fcntl(sock, F_SETFL, flag | O_NONBLOCK);
+    return reactors.value(reactorId);
 }
 
+/*!
+  Returns the number of the reactors.
+*/
+int TMultiplexingServer::reactorCount()
+{
+    return reactors.count();
+}
 
-static void setSocketOption(int fd)
+/*!
+  Returns the number of the requests waiting for a worker.
+*/
+int TMultiplexingServer::pendingRequestCount() const
 {
-    int ret, flag, bufsize;
+    return T_ATOMIC_LOAD_RELAXED(pendingDepth);
+}
 
-    // Disable the Nagle (TCP No Delay) algorithm
-    flag = 1;
-    ret = setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag));
-    if (ret < 0) {
-        tSystemWarn("setsockopt error [TCP_NODELAY] fd:%d", fd);
-    }
+/*!
+  Returns the msecs which the request dispatched last has waited for
+  a worker.
+*/
+int TMultiplexingServer::lastPendingWaitTime() const
+{
+    return T_ATOMIC_LOAD_RELAXED(lastWaitTime);
+}
 
-    bufsize = SEND_BUF_SIZE;
-    ret = setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
-    if (ret < 0) {
-        tSystemWarn("setsockopt error [SO_SNDBUF] fd:%d", fd);
-    }
+/*!
+  Returns the longest msecs which a request has waited for a worker.
+*/
+int TMultiplexingServer::peakPendingWaitTime() const
+{
+    return T_ATOMIC_LOAD_RELAXED(peakWaitTime);
+}
 
-    bufsize = RECV_BUF_SIZE;
-    ret = setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
-    if (ret < 0) {
-        tSystemWarn("setsockopt error [SO_RCVBUF] fd:%d", fd);
-    }
+/*!
+  Returns the number of the requests rejected by the admission control.
+*/
+int TMultiplexingServer::rejectedRequestCount() const
+{
+    return T_ATOMIC_LOAD_RELAXED(rejectedCount);
 }
 
 
-TMultiplexingServer::TMultiplexingServer(QObject *parent)
-    : QThread(parent), TApplicationServerBase(), maxWorkers(0), stopped(false),
-      listenSocket(0), epollFd(0), sendRequests(), threadCounter(0)
+TMultiplexingServer::TMultiplexingServer(int reactorId, QObject *parent)
+    : QThread(parent), TApplicationServerBase(), id(reactorId), maxWorkers(0),
+      keepAliveMaxRequests(0), keepAliveTimeout(0), reportsLoad(false), headerReadTimeout(0), bodyReadTimeout(0),
+      sendTimeout(0), maxPendingRequests(0),
+      maxPendingWaitTime(0), retryAfter(0), priorityPaths(), stopped(false), finished(false), listenSocket(0), ownListenSocket(false),
+      backend(0), eventFd(0), loadTimerFd(0), wakeupPending(0), hasPendingRequests(0), connections(),
+      timerWheel(TIMER_WHEEL_SIZE), timerCount(0), timerTick(0), connectionCount(0), sendRequests(new TBoundedQueue<SendData*>()), pendingRequests(), priorityRequests(), pendingCount(0),
+      pendingDepth(0), lastWaitTime(0), peakWaitTime(0), rejectedCount(0), copyBuffer(0),
+      copyBufferSize(0), httpDate(), httpDateTime(0), threadCounter(0)
 {
     connect(qApp, SIGNAL(aboutToQuit()), this, SLOT(terminate()));
     Q_ASSERT(Tf::app()->multiProcessingModule() == TWebApplication::Hybrid);
@@ -104,19 +281,77 @@ TMultiplexingServer::TMultiplexingServer(QObject *parent)
 
 TMultiplexingServer::~TMultiplexingServer()
 {
-    if (listenSocket > 0)
+    // The shared listening socket is closed by the primary reactor
+    if (ownListenSocket && listenSocket > 0)
         TF_CLOSE(listenSocket);
 
-    if (epollFd > 0)
-        TF_CLOSE(epollFd);
+    delete backend;
+
+    if (eventFd > 0)
+        TF_CLOSE(eventFd);
+
+    if (loadTimerFd > 0)
+        TF_CLOSE(loadTimerFd);
+
+    for (QVectorIterator<Connection *> it(connections); it.hasNext(); ) {
+        Connection *conn = it.next();
+        if (conn) {
+            qDeleteAll(conn->sendBuffers);
+            delete conn;
+        }
+    }
+
+    SendData *req;
+    while (sendRequests->dequeue(req)) {
+        delete req->buffer;
+        delete req;
+    }
+    delete sendRequests;
 }
 
 
+/*!
+  Starts all the reactors. This function must be called for the
+  primary reactor.
+*/
 bool TMultiplexingServer::start()
 {
     if (isRunning())
         return true;
 
+    if (id != 0) {
+        tSystemError("Not primary reactor  id:%d", id);
+        return false;
+    }
+
+    // Listen socket; inherited from tfmanager or opened
+    int sock = listenSocket;
+    reportsLoad = (sock > 0);
+    if (sock <= 0) {
+        QString listenPort = Tf::app()->appSettings().value("ListenPort").toString().trimmed();
+        if (listenPort.startsWith("unix:", Qt::CaseInsensitive)) {
+            // UNIX domain
+            sock = TApplicationServerBase::nativeListen(listenPort.mid(5));
+        } else {
+            sock = TApplicationServerBase::nativeListen(QHostAddress::Any, listenPort.toUInt());
+        }
+
+        if (sock > 0) {
+            tSystemDebug("listen successfully.  port:%s", qPrintable(listenPort));
+        } else {
+            tSystemError("Failed to set socket descriptor: %d", sock);
+            TApplicationServerBase::nativeClose(sock);
+            return false;
+        }
+    }
+
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    bool unixDomain = (::getsockname(sock, (sockaddr *)&addr, &addrlen) == 0 && addr.ss_family == AF_UNIX);
+    if (unixDomain) {
+        tSystemDebug("Listening socket of UNIX domain: %d", sock);
+    }
+
     // Loads libs
     TApplicationServerBase::loadLibraries();
 
@@ -125,99 +360,202 @@ bool TMultiplexingServer::start()
     initializer->wait();
     delete initializer;
 
-    connect(this, SIGNAL(finished()), this, SLOT(deleteLater()));
-    QThread::start();
+    // Static files served by the reactors
+    if (!staticFileCache && Tf::app()->appSettings().value("MPM.hybrid.StaticFileCache", true).toBool()) {
+        qint64 cacheSize = Tf::app()->appSettings().value("MPM.hybrid.StaticFileCacheSize", 16777216).toLongLong();
+        qint64 maxFileSize = Tf::app()->appSettings().value("MPM.hybrid.StaticFileMaxSize", 65536).toLongLong();
+        staticFileCache = new TStaticFileCache(Tf::app()->publicPath(), cacheSize, maxFileSize);
+    }
+
+    // Worker thread pool
+    int workerNum = Tf::app()->maxNumberOfServers(10);
+    TActionWorker::startWorkers(workerNum);
+    tSystemDebug("MaxWorkers: %d", workerNum);
+
+    // All the reactors share the listening socket; with Socket.ReusePort,
+    // each of the others listens on its own socket bound to the same
+    // address, and the kernel distributes the connections among them
+    bool reusePort = !unixDomain && Tf::app()->appSettings().value("Socket.ReusePort", false).toBool();
+    for (QListIterator<TMultiplexingServer *> it(reactors); it.hasNext(); ) {
+        TMultiplexingServer *reactor = it.next();
+        reactor->listenSocket = sock;
+        reactor->ownListenSocket = (reactor->id == 0);
+        if (reusePort && reactor->id != 0) {
+            int sd = TApplicationServerBase::nativeListenSameAddress(sock);
+            if (sd > 0) {
+                reactor->listenSocket = sd;
+                reactor->ownListenSocket = true;
+            } else {
+                tSystemWarn("Failed to listen on the port with SO_REUSEPORT  reactor:%d", reactor->id);
+            }
+        }
+        reactor->maxWorkers = workerNum;
+        reactor->QThread::start();
+    }
     return true;
 }
 
 
-void TMultiplexingServer::epollClose(int fd)
+/*!
+  Sets the listening socket \a socket shared by the server processes;
+  it's used instead of opening the port of ListenPort. This function
+  must be called for the primary reactor before start().
+*/
+void TMultiplexingServer::setSocketDescriptor(int socket)
 {
-    tf_epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
-    TF_CLOSE(fd);
-    recvBuffers.remove(fd);
-    QQueue<THttpSendBuffer*> que = sendBuffers.take(fd);
-    for (QListIterator<THttpSendBuffer*> it(que); it.hasNext(); ) {
-        delete it.next();
-    }
-    pendingRequests.removeAll(fd);
+    listenSocket = socket;
 }
 
-
-int TMultiplexingServer::epollAdd(int fd, int events)
+/*!
+  Returns the connection of the socket \a fd, or 0 if it's not open.
+*/
+TMultiplexingServer::Connection *TMultiplexingServer::connection(int fd) const
 {
-    struct epoll_event ev;
+    Connection *conn = (fd >= 0 && fd < connections.count()) ? connections[fd] : 0;
+    return (conn && conn->active) ? conn : 0;
+}
 
-    memset(&ev, 0, sizeof(ev));
-    ev.events = events;
-    ev.data.fd = fd;
 
-    int ret = tf_epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
-    int err = errno;
-    if (ret < 0 && err != EEXIST) {
-        tSystemError("Failed epoll_ctl (EPOLL_CTL_ADD)  fd:%d errno:%d", fd, errno);
-        epollClose(fd);
-    } else {
-        //tSystemDebug("OK epoll_ctl (EPOLL_CTL_ADD) (events:%d)  fd:%d", events, fd);
+TMultiplexingServer::Connection *TMultiplexingServer::openConnection(int fd)
+{
+    if (fd >= connections.count()) {
+        connections.resize(qMax(fd + 1, connections.count() * 2));
+    }
+
+    Connection *&conn = connections[fd];
+    if (!conn) {
+        conn = new Connection;
     }
-    return ret;
+    conn->active = true;
+    conn->fd = fd;
+    conn->events = TEventBackend::Readable;
+    ++connectionCount;
+    updateTimer(conn);  // header-read timeout
+    return conn;
 }
 
 
-int TMultiplexingServer::epollModify(int fd, int events)
+/*!
+  Closes the socket \a fd and its connection.
+*/
+void TMultiplexingServer::closeSocket(int fd)
 {
-    struct epoll_event ev;
+    Connection *conn = connection(fd);
+    if (conn && conn->processing && !stopped) {
+        // The fd is closed after the worker releases it,
+        // not to be reused for another connection
+        backend->remove(fd);
+        ::shutdown(fd, SHUT_RDWR);
+        cancelTimer(conn);
+        conn->closing = true;
+        return;
+    }
 
-    memset(&ev, 0, sizeof(ev));
-    ev.events = events;
-    ev.data.fd = fd;
+    backend->close(fd);
+
+    if (conn) {
+        cancelTimer(conn);
+        conn->recvBuffer.clear();
+        qDeleteAll(conn->sendBuffers);
+        conn->sendBuffers.clear();
+        conn->requestCount = 0;
+        conn->active = false;
+        conn->processing = false;
+        if (conn->pending) {
+            conn->pending = false;  // removed from the queue later
+            if (--pendingCount == 0) {
+                pendingRequests.clear();
+                priorityRequests.clear();
+            }
+            T_ATOMIC_STORE_RELEASE(pendingDepth, pendingCount);
+        }
+        conn->keepAlive = false;
+        conn->closing = false;
+        conn->invalid = false;
+        --connectionCount;
+    }
+}
 
-    int ret = tf_epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
-    if (ret < 0) {
-        tSystemError("Failed epoll_ctl (EPOLL_CTL_MOD)  fd:%d errno:%d", fd, errno);
-        epollClose(fd);
-    } else {
-        tSystemDebug("OK epoll_ctl (EPOLL_CTL_MOD)  fd:%d", fd);
+/*!
+  Watches the input of the \a fd of the \a type, one of the types of
+  TEventBackend. Returns -1 on error, and the \a fd is closed.
+*/
+int TMultiplexingServer::watch(int fd, int type)
+{
+    if (!backend->add(fd, type)) {
+        closeSocket(fd);
+        return -1;
     }
-    return ret;
+    return 0;
 }
 
+/*!
+  Changes the \a events watched on the connection \a fd. The writable
+  event is one-shot; it's watched again if the socket is still full.
+  Returns -1 on error, and the \a fd is closed.
+*/
+int TMultiplexingServer::watchEvents(int fd, int events)
+{
+    if (!backend->modify(fd, events)) {
+        closeSocket(fd);
+        return -1;
+    }
+
+    Connection *conn = connection(fd);
+    if (conn) {
+        conn->events = events;
+    }
+    return 0;
+}
 
-int TMultiplexingServer::epollDel(int fd)
+/*!
+  Stops watching the \a fd. Returns -1 on error, and the \a fd is closed.
+*/
+int TMultiplexingServer::unwatch(int fd)
 {
-    int ret = tf_epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
-    int err = errno;
-    if (ret < 0 && err != ENOENT) {
-        tSystemError("Failed epoll_ctl (EPOLL_CTL_DEL)  fd:%d errno:%d", fd, errno);
-        epollClose(fd);
-    } else {
-        tSystemDebug("OK epoll_ctl (EPOLL_CTL_DEL)  fd:%d", fd);
+    if (!backend->remove(fd)) {
+        closeSocket(fd);
+        return -1;
     }
-    return ret;
+    return 0;
 }
 
 
 int TMultiplexingServer::getSendRequest()
 {
     // Check send-request
-    QList<SendData*> reqQueue = sendRequests.dequeue();
+    int count = 0;
+    SendData *req;
 
-    for (QListIterator<SendData*> it(reqQueue); it.hasNext(); ) {
-        SendData *req = it.next();
+    while (sendRequests->dequeue(req)) {
+        ++count;
         int fd = req->fd;
+        Connection *conn = connection(fd);
+        if (conn && !req->partial) {
+            conn->processing = false;  // released by the worker
+        }
+
         if (req->method == SendData::Send) {
-            if (recvBuffers.contains(fd)) {
+            if (conn && !conn->closing) {
                 // Add to a send-buffer
-                sendBuffers[fd].enqueue(req->buffer);
-                // Set epoll for sending and recieving
-                epollModify(fd, EPOLLIN | EPOLLOUT);
+                conn->sendBuffers.enqueue(req->buffer);
+                conn->keepAlive = !req->closeAfterSend;
+                if (!(conn->events & TEventBackend::Writable)) {
+                    // Sends at once; waits for writable only if the socket is full
+                    sendData(fd, conn);
+                } else {
+                    updateTimer(conn);
+                }
             } else {
                 delete req->buffer;
+                if (conn) {
+                    closeSocket(fd);
+                }
             }
 
         } else if (req->method == SendData::Disconnect) {
-            if (recvBuffers.contains(fd) || sendBuffers.contains(fd)) {
-                epollClose(fd);
+            if (conn) {
+                closeSocket(fd);
             }
         } else {
             Q_ASSERT(0);
@@ -225,38 +563,763 @@ int TMultiplexingServer::getSendRequest()
         delete req;
     }
 
-    return reqQueue.count();
+    return count;
 }
 
+/*!
+  Enqueues the \a data to the send-requests and wakes the reactor up.
+  This function is called by worker threads. The \a data is dropped
+  if the reactor has stopped.
+*/
+void TMultiplexingServer::enqueueSendRequest(SendData *data)
+{
+    while (!finished) {
+        if (sendRequests->enqueue(data)) {
+            wakeup();
+            return;
+        }
+        // Full, waits for the reactor
+        wakeup();
+        QThread::yieldCurrentThread();
+    }
 
-void TMultiplexingServer::emitIncomingRequest(int fd, THttpBuffer &buffer)
+    // The reactor has exited; no one sends it
+    tSystemWarn("Send request dropped, the reactor stopped  fd:%d", data->fd);
+    delete data->buffer;
+    delete data;
+}
+
+/*!
+  Wakes the reactor up from waiting for the events.
+  Writes to the eventfd only if the reactor has not been woken yet.
+*/
+void TMultiplexingServer::wakeup()
 {
-    QHostAddress host = buffer.clientAddress();
-    emit incomingHttpRequest(fd, buffer.read(INT_MAX), host.toString());
-    threadCounter.fetchAndAddOrdered(1);
+    if (eventFd > 0 && wakeupPending.testAndSetOrdered(0, 1)) {
+        quint64 val = 1;
+        int ret;
+        EINTR_LOOP(ret, ::write(eventFd, &val, sizeof(val)));
+        if (ret < 0 && errno != EAGAIN) {
+            tSystemError("Failed write to eventfd  errno:%d", errno);
+        }
+    }
+}
+
+
+void TMultiplexingServer::stop()
+{
+    stopped = true;
+    wakeup();
+}
+
+
+/*!
+  Reserves a worker thread out of the maximum number of the workers
+  shared by all the reactors. Returns true if reserved; otherwise
+  returns false.
+*/
+bool TMultiplexingServer::reserveWorker()
+{
+    if (totalThreadCounter.fetchAndAddOrdered(1) < maxWorkers) {
+        return true;
+    }
+    totalThreadCounter.fetchAndAddOrdered(-1);
+    return false;
+}
+
+
+/*!
+  Sends the data of the send-buffers of the connection. If the socket
+  gets full, waits for writable to send the rest. After all the data
+  is sent, the connection is closed or the pipelined request is
+  dispatched.
+*/
+void TMultiplexingServer::sendData(int fd, Connection *conn)
+{
+    if (writeSendBuffers(fd, conn)) {
+        // Pipelined request
+        dispatchRequest(fd, conn);
+        if (conn->active) {
+            updateTimer(conn);
+        }
+    }
+}
+
+/*!
+  Writes the data of the send-buffers of the connection to the socket.
+  Returns true if all the data is sent and the connection waits for the
+  next request; otherwise returns false, if the rest is sent when
+  writable, or the connection is closed.
+*/
+bool TMultiplexingServer::writeSendBuffers(int fd, Connection *conn)
+{
+    while (!conn->sendBuffers.isEmpty()) {
+        THttpSendBuffer *sendbuf = conn->sendBuffers.head();
+        qint64 sentlen = sendDirect(fd, sendbuf);
+        int err = errno;
+        if (sentlen < 0 && (err == EINVAL || err == ENOSYS)) {
+            // sendfile() is not supported for this file; copies the data
+            int len = sendbuf->read(copyBuffer, copyBufferSize);
+            sentlen = ::send(fd, copyBuffer, len, 0);
+            err = errno;
+            if (sentlen < 0 && err == EAGAIN) {
+                sentlen = 0;
+            }
+            if (sentlen >= 0 && len > sentlen) {
+                tSystemDebug("sendbuf prepend: len:%d", len - (int)sentlen);
+                sendbuf->prepend(copyBuffer + sentlen, len - sentlen);
+            }
+        }
+        TAccessLogger &logger = sendbuf->accessLogger();
+
+        if (sentlen < 0) {
+            if (err != ECONNRESET && err != EPIPE) {
+                tSystemError("Failed send : errno:%d", err);
+            }
+            // Access log
+            logger.setResponseBytes(-1);
+            logger.write();
+
+            closeSocket(fd);
+            return false;
+        }
+        logger.setResponseBytes(logger.responseBytes() + sentlen);
+
+        if (!sendbuf->atEnd()) {
+            // Sends the rest when writable
+            if (watchEvents(fd, TEventBackend::Readable | TEventBackend::Writable) == 0) {
+                updateTimer(conn);  // write-stall timeout
+            }
+            return false;
+        }
+
+        logger.write();  // Writes access log
+        sendbuf->release();
+        delete conn->sendBuffers.dequeue(); // delete send-buffer obj
+    }
+
+    if (conn->processing) {
+        // The rest of the response is streamed by the worker
+        if (watchEvents(fd, TEventBackend::Readable) == 0) {
+            updateTimer(conn);
+        }
+        return false;
+    }
+
+    if (!conn->keepAlive) {
+        closeSocket(fd);
+        return false;
+    }
+
+    // Prepare recv
+    return (watchEvents(fd, TEventBackend::Readable) == 0);
+}
+
+/*!
+  Dispatches a request received on the connection to a worker, or
+  queues the connection to wait for a worker. Only a request at a time
+  is processed on a connection. The pipelined requests of the static
+  files cached are responded in a loop, not by recursion, until one is
+  dispatched or the response waits for the socket writable.
+*/
+void TMultiplexingServer::dispatchRequest(int fd, Connection *conn)
+{
+    while (!conn->processing && !conn->pending && conn->sendBuffers.isEmpty()) {
+        try {
+            conn->recvBuffer.parse();  // pipelined request
+        } catch (ClientErrorException &e) {
+            tSystemWarn("Invalid request: status code:%d  fd:%d", e.statusCode(), fd);
+            respondClientError(fd, e.statusCode());
+            return;
+        } catch (RuntimeException &e) {
+            tSystemError("%s  fd:%d", qPrintable(e.message()), fd);
+            closeSocket(fd);
+            return;
+        }
+
+        if (!conn->recvBuffer.canReadHttpRequest())
+            return;
+
+        // The static files are served without a worker
+        if (staticFileCache && serveStaticFile(fd, conn)) {
+            if (!writeSendBuffers(fd, conn))
+                return;
+            continue;  // next pipelined request
+        }
+
+        // Does not overtake the pending requests
+        if (pendingCount == 0 && reserveWorker()) {
+            emitIncomingRequest(fd);
+        } else if (maxPendingRequests > 0 && pendingCount >= maxPendingRequests) {
+            tSystemDebug("Pending requests full  fd:%d", fd);
+            rejectRequest(fd);
+        } else {
+            enqueuePendingRequest(fd, conn);
+        }
+        return;
+    }
+}
+
+/*!
+  Queues the response of the static file of the request received on
+  the connection from the cache to the send-buffers. Returns false if
+  the file is not cached, or the request is not for a static file;
+  it's dispatched to a worker, which reads the file into the cache,
+  not to block the reactor.
+*/
+bool TMultiplexingServer::serveStaticFile(int fd, Connection *conn)
+{
+    THttpBuffer &buffer = conn->recvBuffer;
+    QByteArray requestLine = buffer.requestLine();
+    if (!requestLine.startsWith("GET "))
+        return false;
+
+    // Only the names with a suffix are looked up
+    QByteArray rawPath = buffer.requestPath();
+    if (rawPath.indexOf('.', rawPath.lastIndexOf('/')) < 0)
+        return false;
+
+    QString path = THttpUtility::fromUrlEncoding(rawPath);
+    TStaticFileCache::Entry entry;
+    if (!staticFileCache->find(path, entry))
+        return false;
+
+    bool keepAlive = buffer.isKeepAliveRequested() && !stopped
+        && (keepAliveMaxRequests <= 0 || conn->requestCount + 1 < keepAliveMaxRequests);
+
+    THttpRequestHeader header;
+    QByteArray reqData;
+    int bodyOffset;
+    QString bodyFilePath;
+    buffer.readHttpRequest(header, reqData, bodyOffset, bodyFilePath);
+    if (!bodyFilePath.isEmpty()) {
+        QFile::remove(bodyFilePath);
+    }
+    conn->requestCount++;
+
+    // If-None-Match takes precedence over If-Modified-Since
+    QByteArray ifNoneMatch = header.rawHeader("If-None-Match");
+    bool notModified = (!ifNoneMatch.isEmpty()) ? THttpUtility::matchesEntityTag(ifNoneMatch, entry.etag)
+        : (header.rawHeader("If-Modified-Since") == entry.lastModified);
+    bool gzip = !entry.gzipHeader.isEmpty() && THttpCompression::accepts(header.rawHeader("Accept-Encoding"), "gzip");
+
+    // The variant sent, and the byte ranges of it
+    const QByteArray &body = (gzip) ? entry.gzipBody : entry.body;
+    const QString &filePath = (gzip) ? entry.gzipFilePath : entry.filePath;
+    qint64 size = (gzip) ? entry.gzipSize : entry.size;
+    bool inMemory = (body.length() == size);
+    QList<QPair<qint64, qint64> > ranges;
+    int status = (notModified) ? (int)Tf::NotModified
+        : THttpRangeFile::evaluate(header, size, entry.lastModified, THttpCompression::variantEntityTag(entry.etag, gzip), ranges);
+
+    QByteArray response;
+    QByteArray partialBody;
+    QList<THttpRangeFile::Part> parts;
+    if (status == Tf::NotModified) {
+        response = (gzip) ? TStaticFileCache::responseHeader(status, entry, gzip, QByteArray(), 0) : entry.notModifiedHeader;
+    } else if (status == Tf::PartialContent) {
+        THttpRangeFile rangeFile(filePath, ranges, entry.contentType, size);
+        response = TStaticFileCache::responseHeader(status, entry, gzip, rangeFile.contentType(), rangeFile.size(), rangeFile.contentRange());
+        if (inMemory) {
+            partialBody = rangeFile.extract(body);
+        } else {
+            parts = rangeFile.parts();
+        }
+    } else if (status == Tf::RequestedRangeNotSatisfiable) {
+        response = TStaticFileCache::responseHeader(status, entry, gzip, QByteArray(), 0, "bytes */" + QByteArray::number(size));
+    } else {
+        response = (gzip) ? entry.gzipHeader : entry.header;
+    }
+
+    response += "Date: ";
+    response += currentHttpDate();
+    response += "\r\n";
+    if (!keepAlive) {
+        response += "Connection: close\r\n";
+    } else if (header.majorVersion() == 1 && header.minorVersion() == 0) {
+        response += "Connection: Keep-Alive\r\n";
+    }
+    response += "\r\n";
+
+    TAccessLogger logger;
+    logger.open();
+    logger.setTimestamp(QDateTime::currentDateTime());
+    logger.setRemoteHost(buffer.clientAddress().isNull() ? QByteArray("(unix)") : buffer.clientAddress().toString().toLatin1());
+    logger.setRequest(requestLine);
+    logger.setStatusCode(status);
+
+    THttpSendBuffer *sendbuf;
+    if (status == Tf::PartialContent) {
+        sendbuf = (inMemory) ? new THttpSendBuffer(response, partialBody, logger)
+            : new THttpSendBuffer(response, QFileInfo(filePath), false, logger, parts);
+    } else if (status != Tf::OK) {
+        sendbuf = new THttpSendBuffer(response, QByteArray(), logger);
+    } else if (inMemory) {
+        sendbuf = new THttpSendBuffer(response, body, logger);  // shares the data
+    } else {
+        sendbuf = new THttpSendBuffer(response, QFileInfo(filePath), false, logger);
+    }
+
+    conn->keepAlive = keepAlive;
+    conn->sendBuffers.enqueue(sendbuf);
+    return true;
+}
+
+/*!
+  Reads the static file of the \a path into the cache, so that the
+  reactors serve it from the next request. This function is called by
+  the worker thread which has served the file.
+*/
+void TMultiplexingServer::loadStaticFile(const QString &path)
+{
+    // Only the names with a suffix are looked up by the reactors
+    if (!staticFileCache || path.indexOf(QLatin1Char('.'), path.lastIndexOf(QLatin1Char('/'))) < 0)
+        return;
+
+    TStaticFileCache::Entry entry;
+    if (!staticFileCache->find(path, entry)) {
+        staticFileCache->load(path, entry);
+    }
+}
+
+/*!
+  Returns the value of the Date header field of the current time;
+  it's formatted once a second.
+*/
+const QByteArray &TMultiplexingServer::currentHttpDate()
+{
+    qint64 now = ::time(NULL);
+    if (now != httpDateTime) {
+        httpDateTime = now;
+# if QT_VERSION >= 0x040700
+        QDateTime utc = QDateTime::currentDateTimeUtc();
+#else
+        QDateTime utc = QDateTime::currentDateTime().toUTC();
+#endif
+        httpDate = QLocale(QLocale::C).toString(utc, QLatin1String("ddd, dd MMM yyyy hh:mm:ss 'GMT'")).toLatin1();
+    }
+    return httpDate;
+}
+
+/*!
+  Queues the connection to wait for a worker. The requests for the paths
+  of MPM.hybrid.PriorityPaths are queued to the priority queue.
+*/
+void TMultiplexingServer::enqueuePendingRequest(int fd, Connection *conn)
+{
+    cancelTimer(conn);  // MPM.hybrid.MaxPendingWaitTime is applied instead
+    conn->pending = true;
+    conn->pendingSince = currentMSecs();
+    ++pendingCount;
+    T_ATOMIC_STORE_RELEASE(pendingDepth, pendingCount);
+
+    if (!priorityPaths.isEmpty()) {
+        QByteArray path = conn->recvBuffer.requestPath();
+        for (QListIterator<QByteArray> it(priorityPaths); it.hasNext(); ) {
+            if (path.startsWith(it.next())) {
+                priorityRequests.enqueue(fd);
+                return;
+            }
+        }
+    }
+    pendingRequests.enqueue(fd);
+}
+
+/*!
+  Dispatches the pending requests to the workers reserved, the requests
+  of the priority queue first. The requests which have waited longer
+  than MPM.hybrid.MaxPendingWaitTime are rejected.
+*/
+void TMultiplexingServer::dispatchPendingRequests()
+{
+    qint64 now = currentMSecs();
+    QQueue<int> *queues[] = { &priorityRequests, &pendingRequests };
+
+    for (int i = 0; i < 2; ++i) {
+        QQueue<int> &queue = *queues[i];
+
+        while (!queue.isEmpty()) {
+            int fd = queue.head();
+            Connection *conn = connection(fd);
+            if (!conn || !conn->pending) {
+                queue.dequeue();  // closed
+                continue;
+            }
+
+            int waitTime = (int)(now - conn->pendingSince);
+            bool expired = (maxPendingWaitTime > 0 && waitTime >= maxPendingWaitTime);
+            if (!expired && !reserveWorker()) {
+                break;  // the rest are not expired yet
+            }
+
+            queue.dequeue();
+            conn->pending = false;
+            --pendingCount;
+
+            if (expired) {
+                tSystemDebug("Pending request timed out  fd:%d", fd);
+                rejectRequest(fd);
+            } else {
+                T_ATOMIC_STORE_RELEASE(lastWaitTime, waitTime);
+                if (waitTime > T_ATOMIC_LOAD_RELAXED(peakWaitTime)) {
+                    T_ATOMIC_STORE_RELEASE(peakWaitTime, waitTime);
+                }
+                emitIncomingRequest(fd);
+            }
+        }
+    }
+
+    if (pendingCount == 0) {
+        pendingRequests.clear();
+        priorityRequests.clear();
+    }
+    T_ATOMIC_STORE_RELEASE(pendingDepth, pendingCount);
+}
+
+/*!
+  Responds 503 Service Unavailable with the Retry-After header to the
+  request received on the socket \a fd, without dispatching it to a
+  worker, and closes the connection.
+*/
+void TMultiplexingServer::rejectRequest(int fd)
+{
+    Connection *conn = connection(fd);
+    THttpBuffer &buffer = conn->recvBuffer;
+
+    rejectedCount.fetchAndAddRelaxed(1);
+    conn->keepAlive = false;
+    conn->sendBuffers.enqueue(new THttpSendBuffer(Tf::ServiceUnavailable, buffer.clientAddress(), buffer.requestLine(), retryAfter));
+    sendData(fd, conn);
+}
+
+
+/*!
+  Responds the error \a statusCode to the invalid request received on
+  the socket \a fd, and closes the connection. The bytes following it
+  are discarded, not to be taken for the next request. If a response
+  is in progress on the connection, the error is responded after it,
+  by parsing the request again.
+*/
+void TMultiplexingServer::respondClientError(int fd, int statusCode)
+{
+    Connection *conn = connection(fd);
+    THttpBuffer &buffer = conn->recvBuffer;
+
+    conn->invalid = true;
+    if (conn->processing || !conn->sendBuffers.isEmpty())
+        return;
+
+    conn->keepAlive = false;
+    conn->sendBuffers.enqueue(new THttpSendBuffer(statusCode, buffer.clientAddress(), buffer.requestLine()));
     buffer.clear();
-    buffer.setClientAddress(host); // inherits the host adress
+    sendData(fd, conn);
 }
 
 
-void TMultiplexingServer::run()
+void TMultiplexingServer::emitIncomingRequest(int fd)
+{
+    Connection *conn = connection(fd);
+    THttpBuffer &buffer = conn->recvBuffer;
+    conn->requestCount++;
+    conn->processing = true;
+    cancelTimer(conn);
+
+    // Keeps the connection alive unless the client or the limit refuses
+    bool keepAlive = buffer.isKeepAliveRequested() && !stopped
+        && (keepAliveMaxRequests <= 0 || conn->requestCount < keepAliveMaxRequests);
+
+    THttpRequestHeader header;
+    QByteArray data;
+    int bodyOffset;
+    QString bodyFilePath;
+    buffer.readHttpRequest(header, data, bodyOffset, bodyFilePath);
+
+    threadCounter.fetchAndAddOrdered(1);
+    if (!TActionWorker::postRequest(fd, header, data, bodyOffset, bodyFilePath, buffer.clientAddress(), this, keepAlive)) {
+        if (!bodyFilePath.isEmpty()) {
+            QFile::remove(bodyFilePath);
+        }
+        conn->processing = false;
+        releaseWorker();
+        closeSocket(fd);
+    }
+}
+
+/*!
+  Releases the worker reserved by this reactor. This function is called
+  by the worker thread which has processed the request.
+*/
+void TMultiplexingServer::releaseWorker()
+{
+    threadCounter.fetchAndAddOrdered(-1);
+    totalThreadCounter.fetchAndAddOrdered(-1);
+
+    // Wakes up the reactors waiting for a worker
+    for (QListIterator<TMultiplexingServer *> it(reactors); it.hasNext(); ) {
+        TMultiplexingServer *reactor = it.next();
+        if (T_ATOMIC_LOAD_ACQUIRE(reactor->hasPendingRequests)) {
+            reactor->wakeup();
+        }
+    }
+}
+
+/*!
+  Reports the busy ratio of the workers of this process, including the
+  requests waiting for a worker of all the reactors, in percentage to
+  tfmanager. It's reported every LOAD_REPORT_INTERVAL seconds by the
+  primary reactor, so that tfmanager samples the current load.
+*/
+void TMultiplexingServer::reportLoad()
+{
+    int busy = T_ATOMIC_LOAD_RELAXED(totalThreadCounter);
+    for (QListIterator<TMultiplexingServer *> it(reactors); it.hasNext(); ) {
+        busy += it.next()->pendingRequestCount();
+    }
+
+    int load = (maxWorkers > 0) ? qMin(busy * 100 / maxWorkers, 100) : 0;
+    QByteArray msg = "_load:" + QByteArray::number(load) + '\n';
+    std::cerr << msg.constData() << std::flush;  // send to tfmanager at a time
+}
+
+/*!
+  Sets the timer of the type \a type, expiring in \a timeout seconds,
+  to the connection; the timer set before is cancelled. If \a timeout
+  is 0, no timer is set.
+*/
+void TMultiplexingServer::setTimer(Connection *conn, int type, int timeout)
 {
-    // Listen socket
-    quint16 port = Tf::app()->appSettings().value("ListenPort").toUInt();
-    int sock = TApplicationServerBase::nativeListen(QHostAddress::Any, port);
-    if (sock > 0) {
-        tSystemDebug("listen successfully.  port:%d", port);
+    cancelTimer(conn);
+    if (timeout <= 0)
+        return;
+
+    conn->timerType = type;
+    conn->deadline = timerTick + timeout;
+    Connection *&head = timerWheel[conn->deadline & (TIMER_WHEEL_SIZE - 1)];
+    conn->timerPrev = 0;
+    conn->timerNext = head;
+    if (head) {
+        head->timerPrev = conn;
+    }
+    head = conn;
+    ++timerCount;
+}
+
+
+void TMultiplexingServer::cancelTimer(Connection *conn)
+{
+    if (conn->timerType == NoTimer)
+        return;
+
+    if (conn->timerPrev) {
+        conn->timerPrev->timerNext = conn->timerNext;
     } else {
-        tSystemError("Failed to set socket descriptor: %d", sock);
-        TApplicationServerBase::nativeClose(sock);
+        timerWheel[conn->deadline & (TIMER_WHEEL_SIZE - 1)] = conn->timerNext;
+    }
+    if (conn->timerNext) {
+        conn->timerNext->timerPrev = conn->timerPrev;
+    }
+    conn->timerPrev = 0;
+    conn->timerNext = 0;
+    conn->timerType = NoTimer;
+    --timerCount;
+}
+
+/*!
+  Sets the timer according to the state of the connection. The header
+  of a request must be received within MPM.hybrid.HeaderReadTimeout
+  seconds; the timers of the body and the response are restarted at
+  every progress.
+*/
+void TMultiplexingServer::updateTimer(Connection *conn)
+{
+    if (conn->pending || conn->closing) {
+        cancelTimer(conn);
+    } else if (!conn->sendBuffers.isEmpty()) {
+        setTimer(conn, SendTimer, sendTimeout);  // also while a response is streamed
+    } else if (conn->processing) {
+        cancelTimer(conn);
+    } else if (conn->recvBuffer.isHeaderComplete()) {
+        setTimer(conn, BodyTimer, bodyReadTimeout);
+    } else if (conn->recvBuffer.buffer().isEmpty() && conn->requestCount > 0) {
+        if (conn->timerType != IdleTimer) {
+            setTimer(conn, IdleTimer, keepAliveTimeout);
+        }
+    } else if (conn->timerType != HeaderTimer) {
+        setTimer(conn, HeaderTimer, headerReadTimeout);
+    }
+}
+
+/*!
+  Closes the connections whose timers have expired. The slots of the
+  timer wheel passed since the last tick are checked; a connection in
+  the slot expiring in a later round of the wheel is left.
+*/
+void TMultiplexingServer::expireTimers()
+{
+    static const char *const timerNames[] = { "", "Header-read", "Body-read", "Send", "Keep-alive" };
+
+    uint now = currentSecs();
+    uint ticks = qMin(now - timerTick, (uint)TIMER_WHEEL_SIZE);
+    uint slot = timerTick;
+    timerTick = now;
+
+    for (uint i = 0; i < ticks && timerCount > 0; ++i) {
+        Connection *conn = timerWheel[++slot & (TIMER_WHEEL_SIZE - 1)];
+        while (conn) {
+            Connection *next = conn->timerNext;
+            if ((int)(conn->deadline - now) <= 0) {
+                tSystemDebug("%s timeout  fd:%d", timerNames[conn->timerType], conn->fd);
+                closeSocket(conn->fd);
+            }
+            conn = next;
+        }
+    }
+}
+
+
+/*!
+  Opens the connection of the socket \a fd accepted from the client of
+  the \a address, which is null for UNIX domain.
+*/
+void TMultiplexingServer::acceptConnection(int fd, const QHostAddress &address)
+{
+    Connection *conn = openConnection(fd);
+    if (!address.isNull()) {
+        conn->recvBuffer.setClientAddress(address);
+    }
+    watch(fd, TEventBackend::Connection);
+}
+
+/*!
+  Processes the \a data of \a length bytes received on the connection.
+*/
+void TMultiplexingServer::receiveData(int fd, Connection *conn, const char *data, int length)
+{
+    if (conn->invalid) {
+        return;  // discards the bytes following the invalid request
+    }
+
+    try {
+        conn->recvBuffer.write(data, length);
+    } catch (ClientErrorException &e) {
+        tSystemWarn("Invalid request: status code:%d  fd:%d", e.statusCode(), fd);
+        respondClientError(fd, e.statusCode());
+        return;
+    } catch (RuntimeException &e) {
+        tSystemError("%s  fd:%d", qPrintable(e.message()), fd);
+        closeSocket(fd);
         return;
     }
 
-    listenSocket = sock;
-    setSocketOption(listenSocket);
+    // Incoming a request
+    dispatchRequest(fd, conn);
+    if (conn->active && conn->sendBuffers.isEmpty()) {
+        updateTimer(conn);
+    }
+}
 
-    maxWorkers = Tf::app()->maxNumberOfServers(10);
-    tSystemDebug("MaxWorkers: %d", maxWorkers);
+/*!
+  Processes the input of the \a fd other than the sockets.
+*/
+void TMultiplexingServer::processNotification(int fd)
+{
+    if (fd == loadTimerFd && loadTimerFd > 0) {
+        quint64 expirations;
+        int ret;
+        EINTR_LOOP(ret, ::read(loadTimerFd, &expirations, sizeof(expirations)));
+        reportLoad();
+
+    } else if (fd == eventFd) {
+        // Woken up; the send-requests are got in the next loop
+        quint64 val;
+        int ret;
+        EINTR_LOOP(ret, ::read(eventFd, &val, sizeof(val)));
+        T_ATOMIC_STORE_RELEASE(wakeupPending, 0);
+
+    } else if (staticFileCache && fd == staticFileCache->notifierHandle()) {
+        // Static files changed
+        staticFileCache->processEvents();
+    }
+}
+
+/*
+  Handler of the events of the backend, which are processed by the
+  reactor.
+*/
+class TMultiplexingServer::EventHandler : public TEventHandler
+{
+public:
+    EventHandler(TMultiplexingServer *reactor) : server(reactor) { }
+
+    void acceptEvent(int fd, const QHostAddress &address)
+    {
+        server->acceptConnection(fd, address);
+    }
+
+    void receiveEvent(int fd, const char *data, int length)
+    {
+        Connection *conn = server->connection(fd);
+        if (conn && !conn->closing) {
+            server->receiveData(fd, conn, data, length);
+        }
+    }
+
+    void disconnectEvent(int fd, int error)
+    {
+        if (error != 0 && error != ECONNRESET) {
+            tSystemError("Failed recv : errno:%d", error);
+        }
+        server->closeSocket(fd);
+    }
+
+    void sendEvent(int fd)
+    {
+        Connection *conn = server->connection(fd);
+        if (conn && !conn->closing) {
+            server->sendData(fd, conn);
+        }
+    }
+
+    void notifyEvent(int fd)
+    {
+        server->processNotification(fd);
+    }
+
+private:
+    TMultiplexingServer *server;
+};
+
+
+void TMultiplexingServer::run()
+{
+    if (listenSocket <= 0) {
+        tSystemError("Invalid listening socket  reactor:%d", id);
+        return;
+    }
+
+    // Persistent connections
+    keepAliveMaxRequests = Tf::app()->appSettings().value("MPM.hybrid.KeepAliveMaxRequests", 100).toInt();
+    keepAliveTimeout = Tf::app()->appSettings().value("MPM.hybrid.KeepAliveTimeout", 15).toInt();
+
+    // Timeouts of slow clients
+    headerReadTimeout = Tf::app()->appSettings().value("MPM.hybrid.HeaderReadTimeout", 10).toInt();
+    bodyReadTimeout = Tf::app()->appSettings().value("MPM.hybrid.BodyReadTimeout", 30).toInt();
+    sendTimeout = Tf::app()->appSettings().value("MPM.hybrid.SendTimeout", 30).toInt();
+    timerTick = currentSecs();
+
+    // Admission control
+    maxPendingRequests = Tf::app()->appSettings().value("MPM.hybrid.MaxPendingRequests", 1000).toInt();
+    maxPendingWaitTime = Tf::app()->appSettings().value("MPM.hybrid.MaxPendingWaitTime", 10000).toInt();
+    retryAfter = Tf::app()->appSettings().value("MPM.hybrid.RetryAfter", 5).toInt();
+
+    priorityPaths.clear();
+    QStringList paths = Tf::app()->appSettings().value("MPM.hybrid.PriorityPaths").toStringList();
+    for (QStringListIterator it(paths); it.hasNext(); ) {
+        QByteArray path = it.next().trimmed().toLatin1();
+        if (!path.isEmpty()) {
+            priorityPaths << path;
+        }
+    }
 
     // Get send buffer size and recv buffer size
     int res, sendBufSize, recvBufSize;
@@ -269,22 +1332,47 @@ void TMultiplexingServer::run()
     if (res < 0)
         tSystemDebug("SO_RCVBUF: %d", recvBufSize);
 
-    const int MaxEvents = 128;
-    struct epoll_event events[MaxEvents];
-    sendBufSize *= 0.8;
-    char *sndbuffer = new char[sendBufSize];
-    char *rcvbuffer = new char[recvBufSize];
+    copyBufferSize = sendBufSize * 0.8;
+    copyBuffer = new char[copyBufferSize];
+    qint64 drainDeadline = 0;  // msecs, after stopped
+    EventHandler handler(this);
 
-    // Create epoll
-    epollFd = epoll_create(1);
-    if (epollFd < 0) {
-        tSystemError("Failed epoll_create()");
+    // Event backend, epoll or io_uring
+    QString backendName = Tf::app()->appSettings().value("MPM.hybrid.EventBackend", "epoll").toString().trimmed().toLower();
+    backend = TEventBackend::create(backendName, recvBufSize);
+    if (!backend) {
         goto socket_error;
     }
 
-    if (epollAdd(listenSocket, EPOLLIN) < 0) {
-        tSystemError("Failed epoll_ctl()");
-        goto epoll_error;
+    // Create eventfd for wakeup
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0 || watch(eventFd, TEventBackend::Notifier) < 0) {
+        tSystemError("Failed eventfd()");
+        goto backend_error;
+    }
+
+    // Wakes up only one of the reactors for an incoming connection
+    if (watch(listenSocket, TEventBackend::Listener) < 0) {
+        tSystemError("Failed to watch the listening socket");
+        goto backend_error;
+    }
+
+    // Timer to report the load to tfmanager
+    if (id == 0 && reportsLoad) {
+        loadTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct itimerspec spec;
+        spec.it_interval.tv_sec = LOAD_REPORT_INTERVAL;
+        spec.it_interval.tv_nsec = 0;
+        spec.it_value = spec.it_interval;
+        if (loadTimerFd < 0 || timerfd_settime(loadTimerFd, 0, &spec, NULL) < 0 || watch(loadTimerFd, TEventBackend::Notifier) < 0) {
+            tSystemError("Failed timerfd  errno:%d", errno);
+            goto backend_error;
+        }
+    }
+
+    // Changes of the static files cached
+    if (id == 0 && staticFileCache && staticFileCache->notifierHandle() >= 0) {
+        watch(staticFileCache->notifierHandle(), TEventBackend::Notifier);
     }
 
     for (;;) {
@@ -292,154 +1380,93 @@ void TMultiplexingServer::run()
         getSendRequest();
 
         // Check pending requests
-        while (!pendingRequests.isEmpty() && (int)threadCounter < maxWorkers) {
-            int fd = pendingRequests.takeFirst();
-            THttpBuffer &recvbuf = recvBuffers[fd];
-            emitIncomingRequest(fd, recvbuf);
+        if (pendingCount > 0) {
+            // Set the flag first not to miss a wakeup by a worker
+            hasPendingRequests.fetchAndStoreOrdered(1);
+            dispatchPendingRequests();
+
+            if (pendingCount == 0) {
+                hasPendingRequests.fetchAndStoreOrdered(0);
+            }
         }
 
-        // Poll Sending/Receiving/Incoming
-        int timeout = ((int)threadCounter > 0) ? 1 : 100;
-        int nfd = tf_epoll_wait(epollFd, events, MaxEvents, timeout);
-        int err = errno;
-        if (nfd < 0) {
-            tSystemError("Failed epoll_wait() : errno:%d", err);
+        // Poll Sending/Receiving/Incoming; blocks until woken up
+        // except for checking the timeouts
+        int timeout = -1;
+        if (stopped) {
+            timeout = PENDING_CHECK_INTERVAL;  // checks the connections drained
+        } else if (pendingCount > 0 && maxPendingWaitTime > 0) {
+            timeout = qMin(maxPendingWaitTime, PENDING_CHECK_INTERVAL);
+        } else if (timerCount > 0) {
+            timeout = 1000;
+        }
+        if (backend->wait(timeout, &handler) < 0) {
             break;
         }
 
-        for (int i = 0; i < nfd; ++i) {
-            if (events[i].data.fd == listenSocket) {
-                if (!pendingRequests.isEmpty())
-                    continue;
-
-                // Incoming connection
-                struct sockaddr_storage addr;
-                socklen_t addrlen = sizeof(addr);
-
-                int clt = ::accept(events[i].data.fd, (sockaddr *)&addr, &addrlen);
-                if (clt < 0) {
-                    tSystemWarn("Failed accept");
-                    continue;
-                }
-
-                setNonBlocking(clt);
-                if (epollAdd(clt, EPOLLIN) == 0) {
-                    THttpBuffer &recvbuf = recvBuffers[clt];
-                    recvbuf.clear();
-                    recvbuf.setClientAddress(QHostAddress((sockaddr *)&addr));
-                }
-
-            } else {
-                int cltfd = events[i].data.fd;
-
-                if ( (events[i].events & EPOLLIN) ) {
-                    // Receive data
-                    int len = ::recv(cltfd, rcvbuffer, recvBufSize, 0);
-                    err = errno;
-                    if (len > 0) {
-                        // Read successfully
-                        THttpBuffer &recvbuf = recvBuffers[cltfd];
-                        recvbuf.write(rcvbuffer, len);
-
-                        if (recvbuf.canReadHttpRequest()) {
-                            // Incoming a request
-                            if ((int)threadCounter >= maxWorkers) {
-                                pendingRequests << cltfd;
-                            } else {
-                                emitIncomingRequest(cltfd, recvbuf);
-                            }
-                        }
-
-                    } else {
-                        if (len < 0 && err != ECONNRESET) {
-                            tSystemError("Failed recv : errno:%d", err);
-                        }
-
-                        // Disconnect
-                        epollClose(cltfd);
-                        continue;
-                    }
-                }
-
-                if ( (events[i].events & EPOLLOUT) ) {
-                    // Send data
-                    THttpSendBuffer *sendbuf = sendBuffers[cltfd].first();
-                    if (!sendbuf) {
-                        tSystemError("Not found send-buffer");
-                        epollClose(cltfd);
-                        continue;
-                    }
-
-                    int len = sendbuf->read(sndbuffer, sendBufSize);
-                    int sentlen = ::send(cltfd, sndbuffer, len, 0);
-                    err = errno;
-                    TAccessLogger &logger = sendbuf->accessLogger();
-
-                    if (sentlen <= 0) {
-                        if (err != ECONNRESET) {
-                            tSystemError("Failed send : errno:%d", err);
-                        }
-                        // Access log
-                        logger.setResponseBytes(-1);
-                        logger.write();
-
-                        epollClose(cltfd);
-                        continue;
-                    } else {
-                        logger.setResponseBytes(logger.responseBytes() + sentlen);
-
-                        if (len > sentlen) {
-                            tSystemDebug("sendbuf prepend: len:%d", len - sentlen);
-                            sendbuf->prepend(sndbuffer + sentlen, len - sentlen);
-                        }
-
-                        if (sendbuf->atEnd()) {
-                            logger.write();  // Writes access log
-                            sendbuf->release();
-
-                            QQueue<THttpSendBuffer*> &que = sendBuffers[cltfd];
-                            delete que.dequeue(); // delete send-buffer obj
-
-                            // Prepare recv
-                            if (que.isEmpty())
-                                epollModify(cltfd, EPOLLIN);
-                        }
-                    }
-                }
-            }
-        }
+        // Check timeouts; advances the clock of the timers
+        expireTimers();
 
         // Check stop flag
         if (stopped) {
             if (listenSocket > 0) {
-                // Close the listen-socket
-                epollClose(listenSocket);
+                // Stop listening; the shared socket is closed by the primary reactor
+                unwatch(listenSocket);
+                if (ownListenSocket) {
+                    TF_CLOSE(listenSocket);
+                }
                 listenSocket = 0;
             }
 
-            if (!recvBuffers.isEmpty()) {
-                for (QMapIterator<int, THttpBuffer> it(recvBuffers); it.hasNext(); ) {
-                    it.next();
-                    epollClose(it.key());
+            // Drains the connections; the idle ones are closed at once, and
+            // the others after their responses or at the time limit
+            if (drainDeadline == 0) {
+                drainDeadline = currentMSecs() + STOP_DRAIN_TIME;
+            }
+            bool expired = (currentMSecs() >= drainDeadline);
+
+            for (int fd = 0; fd < connections.count() && connectionCount > 0; ++fd) {
+                Connection *conn = connection(fd);
+                if (conn && (expired || (!conn->processing && !conn->pending && conn->sendBuffers.isEmpty()
+                                         && conn->recvBuffer.buffer().isEmpty()))) {
+                    closeSocket(fd);
                 }
             }
 
-            if (recvBuffers.isEmpty() && sendBuffers.isEmpty()) {
+            if (connectionCount == 0) {
                 break;
             }
         }
     }
 
-epoll_error:
-    TF_CLOSE(epollFd);
-    epollFd = 0;
+backend_error:
+    // Drops the send-requests left; no more are enqueued
+    finished = true;
+    SendData *req;
+    while (sendRequests->dequeue(req)) {
+        delete req->buffer;
+        delete req;
+    }
+
+    if (eventFd > 0) {
+        int fd = eventFd;
+        eventFd = 0;
+        TF_CLOSE(fd);
+    }
+    if (loadTimerFd > 0) {
+        TF_CLOSE(loadTimerFd);
+        loadTimerFd = 0;
+    }
+    // Submits the closing of the connections left
+    delete backend;
+    backend = 0;
 
 socket_error:
-    if (listenSocket > 0)
+    if (ownListenSocket && listenSocket > 0)
         TF_CLOSE(listenSocket);
     listenSocket = 0;
-    delete sndbuffer;
-    delete rcvbuffer;
+    delete[] copyBuffer;
+    copyBuffer = 0;
 }
 
 
@@ -449,21 +1476,46 @@ void TMultiplexingServer::setSendRequest(int fd, const THttpHeader *header, QIOD
     sd->method = SendData::Send;
     sd->fd = fd;
     sd->buffer = 0;
+    sd->closeAfterSend = header->rawHeader("Connection").toLower().contains("close");
+    sd->partial = false;
 
     QByteArray response = header->toByteArray();
-    QFileInfo fi;
-
-    if (body) {
-        QBuffer *buffer = qobject_cast<QBuffer *>(body);
-        if (buffer) {
-            response += buffer->data();
-        } else {
+    QBuffer *buffer = qobject_cast<QBuffer *>(body);
+    THttpRangeFile *rangeFile = qobject_cast<THttpRangeFile *>(body);
+
+    if (buffer) {
+        // The body is not copied; it's sent as another segment
+        sd->buffer = new THttpSendBuffer(response, buffer->data(), accessLogger);
+    } else if (rangeFile) {
+        // The ranges are sent from the file handle
+        sd->buffer = new THttpSendBuffer(response, QFileInfo(rangeFile->fileName()), autoRemove, accessLogger, rangeFile->parts());
+    } else {
+        QFileInfo fi;
+        if (body) {
             fi.setFile(*qobject_cast<QFile *>(body));
         }
+        sd->buffer = new THttpSendBuffer(response, fi, autoRemove, accessLogger);
     }
-    sd->buffer = new THttpSendBuffer(response, fi, autoRemove, accessLogger);
 
-    sendRequests.enqueue(sd);
+    enqueueSendRequest(sd);
+}
+
+
+/*!
+  Sends the send-buffer \a buffer of a part of the response streamed by
+  a worker. If \a partial is true, the rest of the response follows;
+  otherwise the worker releases the connection.
+*/
+void TMultiplexingServer::setSendRequest(int fd, THttpSendBuffer *buffer, bool closeAfterSend, bool partial)
+{
+    SendData *sd = new SendData;
+    sd->method = SendData::Send;
+    sd->fd = fd;
+    sd->buffer = buffer;
+    sd->closeAfterSend = closeAfterSend;
+    sd->partial = partial;
+
+    enqueueSendRequest(sd);
 }
 
 
@@ -476,43 +1528,26 @@ void TMultiplexingServer::setDisconnectRequest(int fd)
     sd->method = SendData::Disconnect;
     sd->fd = fd;
     sd->buffer = 0;
+    sd->closeAfterSend = true;
+    sd->partial = false;
 
-    sendRequests.enqueue(sd);
+    enqueueSendRequest(sd);
 }
 
 
 void TMultiplexingServer::terminate()
 {
-    stopped = true;
-    wait(10000);
-}
-
-
-void TMultiplexingServer::deleteActionContext()
-{
-    TActionWorker *worker = qobject_cast<TActionWorker *>(sender());
-    Q_CHECK_PTR(worker);
-    deletePointer(worker);
-    worker->deleteLater();
-    threadCounter.fetchAndAddOrdered(-1);
-}
-
-
-/*
- * TWorkerStarter class
- */
-
-TWorkerStarter::~TWorkerStarter()
-{ }
-
-
-void TWorkerStarter::startWorker(int fd, const QByteArray &request, const QString &address)
-{
-    //
-    // Create worker threads in main thread for signal/slot mechanism!
-    //
-    TActionWorker *worker = new TActionWorker(fd, THttpRequest(request, QHostAddress(address)));
-    connect(worker, SIGNAL(finished()), multiplexingServer, SLOT(deleteActionContext()));
-    multiplexingServer->insertPointer(worker);
-    worker->start();
+    if (id == 0) {
+        // Stops all the reactors, and then the workers
+        for (QListIterator<TMultiplexingServer *> it(reactors); it.hasNext(); ) {
+            it.next()->stop();
+        }
+        for (QListIterator<TMultiplexingServer *> it(reactors); it.hasNext(); ) {
+            it.next()->wait(10000);
+        }
+        TActionWorker::stopWorkers();
+    } else {
+        stopped = true;
+        wait(10000);
+    }
 }
@@ -5,11 +5,21 @@
  * the New BSD License, which is incorporated herein by reference.
  */
 
+#include <iostream>
+#include <QTimer>
+#include <QDateTime>
+#include <QSocketNotifier>
 #include <TPreforkApplicationServer>
 #include <TWebApplication>
 #include <TActionForkProcess>
 #include "tapplicationserverbase.h"
+#include "tsqldatabasepool2.h"
+#include "tkvsdatabasepool2.h"
 #include "tsystemglobal.h"
+#ifdef Q_OS_UNIX
+# include <signal.h>
+# include "tfcore_unix.h"
+#endif
 
 
 class TStaticInitializer : public TActionForkProcess
@@ -29,10 +39,21 @@ public:
   \class TPreforkApplicationServer
   \brief The TPreforkApplicationServer class provides functionality common to
   an web application server for prefork.
+  A server process keeps accepting connections on the listening socket
+  inherited, and exits to be recycled after it has processed the number
+  of requests of MPM.prefork.MaxRequestsPerServer or has run for the
+  seconds of MPM.prefork.ServerLifetime.
+
+  In the zygote mode, the process loads the libraries and runs the
+  static initializers, and then forks the server processes on demand of
+  tfmanager, instead of serving the requests. The server processes start
+  at once and share the pages of the zygote copy-on-write.
 */
 
 TPreforkApplicationServer::TPreforkApplicationServer(QObject *parent)
-    : QTcpServer(parent), TApplicationServerBase()
+    : QTcpServer(parent), TApplicationServerBase(), maxRequests(0), requestCount(0), lifetime(0),
+      processing(false), recycling(false), acceptedSockets(), zygoteSocket(0), forked(false),
+      commandNotifier(0), commandBuffer(), children(), reapTimer()
 {
     connect(qApp, SIGNAL(aboutToQuit()), this, SLOT(terminate()));
     Q_ASSERT(Tf::app()->multiProcessingModule() == TWebApplication::Prefork);
@@ -50,9 +71,53 @@ bool TPreforkApplicationServer::start()
     TStaticInitializer *initializer = new TStaticInitializer();
     initializer->start();
     delete initializer;
+
+    maxRequests = Tf::app()->appSettings().value("MPM.prefork.MaxRequestsPerServer", 1000).toInt();
+    lifetime = Tf::app()->appSettings().value("MPM.prefork.ServerLifetime", 0).toInt();
+
+#ifdef Q_OS_UNIX
+    if (isZygote()) {
+        // Waits for the commands of tfmanager
+        commandNotifier = new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this);
+        connect(commandNotifier, SIGNAL(activated(int)), this, SLOT(readZygoteCommand()));
+        reapTimer.start(1000, this);
+        notify("_ready");
+        return true;
+    }
+#endif
+
+    if (lifetime > 0) {
+        QTimer::singleShot(lifetime * 1000, this, SLOT(recycle()));
+    }
     return true;
 }
 
+/*!
+  Sets the zygote mode; this process forks the server processes which
+  accept connections on the listening socket \a socketDescriptor.
+  This function must be called before start().
+*/
+void TPreforkApplicationServer::setZygoteMode(int socketDescriptor)
+{
+    zygoteSocket = socketDescriptor;
+}
+
+/*!
+  Writes the \a message to tfmanager through stderr, terminated by a
+  newline. A server process forked by the zygote appends its PID to it,
+  since it shares stderr with the others.
+*/
+void TPreforkApplicationServer::notify(const QByteArray &message) const
+{
+    QByteArray msg = message;
+    if (forked) {
+        msg += ':';
+        msg += QByteArray::number(QCoreApplication::applicationPid());
+    }
+    msg += '\n';
+    std::cerr << msg.constData() << std::flush;  // written at a time
+}
+
 
 void TPreforkApplicationServer::stop()
 {
@@ -65,6 +130,20 @@ void TPreforkApplicationServer::terminate()
 {
     close();
     releaseAllContexts();
+
+#ifdef Q_OS_UNIX
+    if (isZygote()) {
+        // Stops the server processes forked
+        for (QSetIterator<qint64> it(children); it.hasNext(); ) {
+            ::kill((pid_t)it.next(), SIGTERM);
+        }
+        for (QSetIterator<qint64> it(children); it.hasNext(); ) {
+            int ret;
+            EINTR_LOOP(ret, ::waitpid((pid_t)it.next(), NULL, 0));
+        }
+        children.clear();
+    }
+#endif
 }
 
 
@@ -77,11 +156,47 @@ void TPreforkApplicationServer::incomingConnection(
 {
     T_TRACEFUNC("socketDescriptor: %d", socketDescriptor);
 
+    // A connection accepted while processing a request, in the event
+    // loop for cleanup, is processed after it
+    acceptedSockets.enqueue(socketDescriptor);
+    if (processing)
+        return;
+
+    processing = true;
+    while (!acceptedSockets.isEmpty()) {
+        TActionForkProcess *process = new TActionForkProcess(acceptedSockets.dequeue());
+        connect(process, SIGNAL(finished()), this, SLOT(deleteActionContext()));
+        insertPointer(process);
+        notify("_accepted");
+        process->start();
+
+        if (maxRequests > 0 && ++requestCount >= maxRequests) {
+            recycling = true;
+        }
+    }
+    processing = false;
+
+    if (recycling) {
+        recycle();
+    } else {
+        notify("_listening");
+    }
+}
+
+/*!
+  Closes the listening port and exits the process; tfmanager starts
+  another server process instead of it. If a request is being processed,
+  the process exits after it.
+*/
+void TPreforkApplicationServer::recycle()
+{
+    recycling = true;
+    if (processing)
+        return;
+
+    tSystemDebug("Recycles the server process  requests:%d", requestCount);
     close();  // Closes the listening port
-    TActionForkProcess *process = new TActionForkProcess(socketDescriptor);
-    connect(process, SIGNAL(finished()), this, SLOT(deleteActionContext()));
-    insertPointer(process);
-    process->start();
+    QCoreApplication::exit(1);
 }
 
 
@@ -92,3 +207,124 @@ void TPreforkApplicationServer::deleteActionContext()
     sender()->deleteLater();
 }
 
+
+
+void TPreforkApplicationServer::readZygoteCommand()
+{
+#ifdef Q_OS_UNIX
+    char buf[256];
+    int len;
+
+    EINTR_LOOP(len, ::read(STDIN_FILENO, buf, sizeof(buf)));
+    if (len <= 0) {
+        if (len < 0 && errno == EAGAIN)
+            return;
+
+        // tfmanager has gone
+        tSystemError("Zygote lost the connection to tfmanager");
+        commandNotifier->setEnabled(false);
+        QCoreApplication::exit(-1);
+        return;
+    }
+
+    commandBuffer.append(buf, len);
+    int idx;
+    while ((idx = commandBuffer.indexOf('\n')) >= 0) {
+        QByteArray command = commandBuffer.left(idx).trimmed();
+        commandBuffer.remove(0, idx + 1);
+
+        if (command == "fork") {
+            if (forkServer()) {
+                return;  // in the child process
+            }
+        } else if (!command.isEmpty()) {
+            tSystemWarn("Unknown command: %s", command.data());
+        }
+    }
+#endif
+}
+
+/*!
+  Forks a server process sharing the libraries loaded and the data
+  initialized. Returns true in the child process, or false in the
+  zygote.
+*/
+bool TPreforkApplicationServer::forkServer()
+{
+#ifdef Q_OS_UNIX
+    // The connections opened by the static initializers are closed, not
+    // to be shared; closing them in the child would end the sessions
+    TSqlDatabasePool2::instance()->closeConnections();
+    TKvsDatabasePool2::instance()->closeConnections();
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        tSystemError("Failed fork  errno:%d", errno);
+        return false;
+    }
+
+    if (pid > 0) {
+        children.insert(pid);
+        notify(QByteArray("_forked:") + QByteArray::number((qint64)pid));
+        return false;
+    }
+
+    // Child process; stops working as the zygote
+    commandNotifier->setEnabled(false);
+    commandNotifier->deleteLater();
+    commandNotifier = 0;
+    commandBuffer.clear();
+    reapTimer.stop();
+    children.clear();
+
+    int fd = ::open("/dev/null", O_RDONLY);
+    if (fd > 0) {
+        ::dup2(fd, STDIN_FILENO);
+        TF_CLOSE(fd);
+    }
+
+    // Opens the log files by itself
+    tResetLoggers();
+
+    // Must not generate the same random numbers as the others
+    Tf::srandXor128((QDateTime::currentDateTime().toTime_t() << 14) | (QCoreApplication::applicationPid() & 0x3fff));
+
+    int sd = zygoteSocket;
+    zygoteSocket = 0;
+    forked = true;
+    if (!setSocketDescriptor(sd)) {
+        tSystemError("Failed to set socket descriptor: %d", sd);
+        ::_exit(-1);
+    }
+
+    if (lifetime > 0) {
+        QTimer::singleShot(lifetime * 1000, this, SLOT(recycle()));
+    }
+    notify("_listening");
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*!
+  Reaps the server processes exited, and notifies tfmanager of them
+  with the exit codes; -1 means a crash.
+*/
+void TPreforkApplicationServer::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != reapTimer.timerId()) {
+        QTcpServer::timerEvent(event);
+        return;
+    }
+
+#ifdef Q_OS_UNIX
+    pid_t pid;
+    int status;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+        children.remove(pid);
+        int code = (WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+        notify(QByteArray("_exited:") + QByteArray::number((qint64)pid) + ':' + QByteArray::number(code));
+    }
+#endif
+}
@@ -2,9 +2,14 @@
 #define TPREFORKAPPLICATIONSERVER_H
 
 #include <QTcpServer>
+#include <QQueue>
+#include <QSet>
+#include <QBasicTimer>
 #include <TGlobal>
 #include "tapplicationserverbase.h"
 
+class QSocketNotifier;
+
 
 class T_CORE_EXPORT TPreforkApplicationServer : public QTcpServer, public TApplicationServerBase
 {
@@ -15,6 +20,8 @@ public:
 
     bool start();
     void stop();
+    bool isZygote() const { return zygoteSocket > 0; }
+    void setZygoteMode(int socketDescriptor);
 
 public slots:
     void terminate();
@@ -25,11 +32,29 @@ protected:
 #else
     void incomingConnection(int socketDescriptor);
 #endif
+    void timerEvent(QTimerEvent *event);
+    void notify(const QByteArray &message) const;
+    bool forkServer();
 
 protected slots:
     void deleteActionContext();
+    void recycle();
+    void readZygoteCommand();
 
 private:
+    int maxRequests;
+    int requestCount;
+    int lifetime;
+    bool processing;
+    bool recycling;
+    QQueue<int> acceptedSockets;
+    int zygoteSocket;  // listening socket passed to the children
+    bool forked;       // forked by the zygote
+    QSocketNotifier *commandNotifier;
+    QByteArray commandBuffer;
+    QSet<qint64> children;
+    QBasicTimer reapTimer;
+
     Q_DISABLE_COPY(TPreforkApplicationServer)
 };
 
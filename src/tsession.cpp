@@ -7,6 +7,7 @@
 
 #include <TSession>
 #include <TWebApplication>
+#include <TAppConfig>
 #include <TActionController>
 
 /*!
@@ -33,7 +34,7 @@ void TSession::reset()
  */
 QByteArray TSession::sessionName()
 {
-    return Tf::app()->appSettings().value("Session.Name").toByteArray();
+    return Tf::app()->appConfig().sessionName();
 }
 
 
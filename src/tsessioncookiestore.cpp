@@ -9,6 +9,7 @@
 #include <QDataStream>
 #include <QCryptographicHash>
 #include <TWebApplication>
+#include <TAppConfig>
 #include <TSystemGlobal>
 #include "tsessioncookiestore.h"
 
@@ -25,7 +26,7 @@ bool TSessionCookieStore::store(TSession &session)
     QByteArray ba;
     QDataStream ds(&ba, QIODevice::WriteOnly);
     ds << *static_cast<const QVariantMap *>(&session);
-    QByteArray digest = QCryptographicHash::hash(ba + Tf::app()->appSettings().value("Session.Secret").toByteArray(),
+    QByteArray digest = QCryptographicHash::hash(ba + Tf::app()->appConfig().sessionSecret(),
                                                  QCryptographicHash::Sha1);
     session.sessionId = ba.toHex() + "_" + digest.toHex();
     return true;
@@ -41,7 +42,7 @@ TSession TSessionCookieStore::find(const QByteArray &id, const QDateTime &)
     QList<QByteArray> balst = id.split('_');
     if (balst.count() == 2 && !balst.value(0).isEmpty() && !balst.value(1).isEmpty()) {
         QByteArray ba = QByteArray::fromHex(balst.value(0));
-        QByteArray digest = QCryptographicHash::hash(ba + Tf::app()->appSettings().value("Session.Secret").toByteArray(),
+        QByteArray digest = QCryptographicHash::hash(ba + Tf::app()->appConfig().sessionSecret(),
                                                      QCryptographicHash::Sha1);
         
         if (digest != QByteArray::fromHex(balst.value(1))) {
@@ -9,6 +9,7 @@
 #include <QCryptographicHash>
 #include <QThread>
 #include <TWebApplication>
+#include <TAppConfig>
 #include <TSessionStore>
 #include "tsystemglobal.h"
 #include "tsessionmanager.h"
@@ -103,7 +104,7 @@ bool TSessionManager::remove(const QByteArray &id)
 
 QString TSessionManager::storeType() const
 {
-    return Tf::app()->appSettings().value(STORE_TYPE).toString().toLower();
+    return Tf::app()->appConfig().sessionStoreType();
 }
 
 
@@ -228,6 +228,15 @@ void TSqlDatabasePool2::timerEvent(QTimerEvent *event)
         return;
     }
 
+    closeConnections(30);
+}
+
+/*!
+  Closes the database connections in the pool which have not been used
+  for \a idleSecs seconds. If \a idleSecs is 0, closes all of them.
+*/
+void TSqlDatabasePool2::closeConnections(int idleSecs)
+{
     if (!Tf::app()->isSqlDatabaseAvailable()) {
         return;
     }
@@ -238,7 +247,7 @@ void TSqlDatabasePool2::timerEvent(QTimerEvent *event)
         for (int i = 0; i < dbSet[j].maxCount(); ++i) {
             DatabaseUse *du = (DatabaseUse *)dbSet[j].peekPop(i);
             if (du) {
-                if (du->lastUsed < QDateTime::currentDateTime().toTime_t() - 30) {
+                if (idleSecs <= 0 || du->lastUsed < QDateTime::currentDateTime().toTime_t() - idleSecs) {
                     QSqlDatabase db = QSqlDatabase::database(du->dbName, false);
                     if (db.isOpen()) {
                         db.close();
@@ -17,6 +17,7 @@ public:
     ~TSqlDatabasePool2();
     QSqlDatabase database(int databaseId = 0);
     void pool(QSqlDatabase &database);
+    void closeConnections(int idleSecs = 0);
 
     static void instantiate();
     static TSqlDatabasePool2 *instance();
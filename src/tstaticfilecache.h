@@ -0,0 +1,83 @@
+#ifndef TSTATICFILECACHE_H
+#define TSTATICFILECACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QMutex>
+#include <QAtomicInt>
+#include <TGlobal>
+#include "tboundedqueue.h"
+
+
+class T_CORE_EXPORT TStaticFileCache
+{
+public:
+    struct Entry
+    {
+        QByteArray header;             // 200 OK, without the terminating empty line
+        QByteArray notModifiedHeader;  // 304 Not Modified, ditto
+        QByteArray body;               // null if it's sent from the file
+        QByteArray lastModified;
+        QByteArray etag;
+        QByteArray contentType;
+        QString filePath;
+        qint64 size;
+        QByteArray gzipHeader;  // gzip-encoded variant; empty if none
+        QByteArray gzipBody;    // null if it's sent from the file
+        QString gzipFilePath;
+        qint64 gzipSize;
+    };
+
+    TStaticFileCache(const QString &rootPath, qint64 maxMemory, qint64 maxFileSize);
+    ~TStaticFileCache();
+
+    bool find(const QString &path, Entry &entry) const;
+    bool load(const QString &path, Entry &entry);
+    void remove(const QString &path);
+    void clear();
+    int count() const;
+    qint64 memoryUsage() const;
+    int notifierHandle() const { return inotifyFd; }
+    void processEvents();
+
+    static QByteArray responseHeader(int statusCode, const Entry &entry, bool gzip, const QByteArray &contentType,
+                                     qint64 length, const QByteArray &contentRange = QByteArray());
+
+private:
+    struct Item
+    {
+        Entry entry;
+        QString path;
+        QAtomicInt lastUsed;  // secs of the monotonic clock
+        Item *prev;  // in the LRU list
+        Item *next;
+    };
+
+    bool watch(const QString &dir);
+    void removeItems(const QString &path);
+    void removeFile(const QString &path);
+    void removeItem(Item *item);
+    void evict(qint64 size);
+    void linkFirst(Item *item) const;
+    void unlink(Item *item) const;
+
+    QString root;
+    qint64 maxMemory;
+    qint64 maxFileSize;
+    qint64 memory;
+    int generation;  // incremented when entries are removed
+    QHash<QString, Item *> items;  // by the path in the root
+    mutable Item *first;  // the LRU list, from the most recently used
+    mutable Item *last;
+    mutable QMutex listMutex;  // locks the LRU list with the read lock
+    QHash<int, QString> watches;    // directory by the watch descriptor
+    QHash<QString, int> watchedDirs;
+    int inotifyFd;
+    mutable QReadWriteLock lock;
+
+    Q_DISABLE_COPY(TStaticFileCache)
+};
+
+#endif // TSTATICFILECACHE_H
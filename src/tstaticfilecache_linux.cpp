@@ -0,0 +1,438 @@
+/* Copyright (c) 2013, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <TWebApplication>
+#include <THttpResponseHeader>
+#include <THttpUtility>
+#include "tstaticfilecache.h"
+#include "thttpcompression.h"
+#include "tsystemglobal.h"
+#include "tfcore_unix.h"
+
+const uint WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO
+                        | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+
+static inline int currentSecs()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int)ts.tv_sec;
+}
+
+
+static inline qint64 entrySize(const TStaticFileCache::Entry &entry)
+{
+    return entry.body.length() + entry.header.length() + entry.notModifiedHeader.length()
+        + entry.gzipBody.length() + entry.gzipHeader.length();
+}
+
+static bool readFile(const QString &path, qint64 size, QByteArray &data)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    data = file.readAll();
+    return (data.length() == size);  // false if being written
+}
+
+/*!
+  \class TStaticFileCache
+  \brief The TStaticFileCache class caches the static files under a
+  root directory with the headers of the responses, for the reactors
+  of the hybrid MPM to serve them without a worker.
+  The files not larger than the maximum file size are held in memory,
+  up to the maximum memory; the least recently used ones are evicted.
+  The larger files are sent from the disk with the cached header.
+  The entries are removed when their files change, which is notified
+  by inotify.
+*/
+
+/*!
+  Constructor.
+*/
+TStaticFileCache::TStaticFileCache(const QString &rootPath, qint64 maxMemory, qint64 maxFileSize)
+    : root(rootPath), maxMemory(maxMemory), maxFileSize(maxFileSize), memory(0), generation(0),
+      items(), first(0), last(0), listMutex(), watches(), watchedDirs(), inotifyFd(-1)
+{
+    if (!root.endsWith(QDir::separator())) {
+        root += QDir::separator();
+    }
+
+    inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        tSystemError("Failed inotify_init1()  errno:%d", errno);
+    }
+}
+
+
+TStaticFileCache::~TStaticFileCache()
+{
+    clear();
+    if (inotifyFd >= 0) {
+        TF_CLOSE(inotifyFd);
+    }
+}
+
+/*!
+  Finds the entry of the \a path in the root directory. Returns false if
+  it's not cached.
+*/
+bool TStaticFileCache::find(const QString &path, Entry &entry) const
+{
+    QReadLocker locker(&lock);
+    Item *item = items.value(path);
+    if (!item)
+        return false;
+
+    entry = item->entry;
+    int now = currentSecs();
+    if (T_ATOMIC_LOAD_RELAXED(item->lastUsed) != now) {
+        // Moved to the head of the LRU list once a second at most
+        QMutexLocker listLocker(&listMutex);
+        if (T_ATOMIC_LOAD_RELAXED(item->lastUsed) != now) {
+            T_ATOMIC_STORE_RELEASE(item->lastUsed, now);
+            unlink(item);
+            linkFirst(item);
+        }
+    }
+    return true;
+}
+
+/*!
+  Reads the file of the \a path in the root directory, and caches it.
+  Returns false if it's not a readable regular file, or the path is
+  not canonical.
+*/
+bool TStaticFileCache::load(const QString &path, Entry &entry)
+{
+    if (inotifyFd < 0 || !path.startsWith(QLatin1Char('/')) || QDir::cleanPath(path) != path)
+        return false;
+
+    int gen;
+    {
+        // Watches the directories before reading the file
+        QWriteLocker locker(&lock);
+        if (!watch(path.left(path.lastIndexOf(QLatin1Char('/'))))) {
+            return false;
+        }
+        gen = generation;
+    }
+
+    QFileInfo fi(root + path.mid(1));
+    if (!fi.isFile() || !fi.isReadable())
+        return false;
+
+    entry.filePath = fi.absoluteFilePath();
+    entry.size = fi.size();
+    entry.lastModified = THttpUtility::toHttpDateTimeString(fi.lastModified());
+    entry.etag = THttpUtility::toEntityTag(fi.lastModified(), entry.size);
+    entry.contentType = Tf::app()->internetMediaType(fi.suffix());
+    entry.body.clear();
+    entry.gzipHeader.clear();
+    entry.gzipBody.clear();
+    entry.gzipFilePath.clear();
+    entry.gzipSize = 0;
+
+    if (entry.size <= maxFileSize && !readFile(entry.filePath, entry.size, entry.body)) {
+        return false;
+    }
+
+    // Gzip-encoded variant; the precompressed file, as the worker sends
+    entry.gzipFilePath = THttpCompression::gzipVariantPath(entry.filePath, entry.contentType);
+    if (!entry.gzipFilePath.isEmpty()) {
+        entry.gzipSize = QFileInfo(entry.gzipFilePath).size();
+        if (entry.gzipSize <= maxFileSize && !readFile(entry.gzipFilePath, entry.gzipSize, entry.gzipBody)) {
+            return false;
+        }
+    }
+
+    entry.header = responseHeader(Tf::OK, entry, false, entry.contentType, entry.size);
+    entry.notModifiedHeader = responseHeader(Tf::NotModified, entry, false, entry.contentType, 0);
+    if (!entry.gzipFilePath.isEmpty()) {
+        entry.gzipHeader = responseHeader(Tf::OK, entry, true, entry.contentType, entry.gzipSize);
+    }
+
+    qint64 size = entrySize(entry);
+    QWriteLocker locker(&lock);
+    if (gen != generation || size > maxMemory) {
+        return true;  // not cached; changed while reading, or too large
+    }
+
+    Item *old = items.value(path);
+    if (old) {
+        removeItem(old);
+    }
+    evict(size);
+
+    Item *item = new Item;
+    item->entry = entry;
+    item->path = path;
+    T_ATOMIC_STORE_RELEASE(item->lastUsed, currentSecs());
+    linkFirst(item);
+    items.insert(path, item);
+    memory += size;
+    return true;
+}
+
+/*!
+  Removes the entry of the \a path, and the entries under it if it's
+  a directory.
+*/
+void TStaticFileCache::remove(const QString &path)
+{
+    QWriteLocker locker(&lock);
+    removeItems(path);
+}
+
+/*!
+  Removes all the entries.
+*/
+void TStaticFileCache::clear()
+{
+    QWriteLocker locker(&lock);
+    qDeleteAll(items);
+    items.clear();
+    first = last = 0;
+    memory = 0;
+    ++generation;
+}
+
+/*!
+  Returns the number of the entries.
+*/
+int TStaticFileCache::count() const
+{
+    QReadLocker locker(&lock);
+    return items.count();
+}
+
+/*!
+  Returns the number of bytes of the entries.
+*/
+qint64 TStaticFileCache::memoryUsage() const
+{
+    QReadLocker locker(&lock);
+    return memory;
+}
+
+/*!
+  Reads the inotify events and removes the entries of the files changed.
+  This function is called when notifierHandle() gets readable.
+*/
+void TStaticFileCache::processEvents()
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len;
+        EINTR_LOOP(len, ::read(inotifyFd, buf, sizeof(buf)));
+        if (len <= 0) {
+            break;  // no more
+        }
+
+        QWriteLocker locker(&lock);
+        ++generation;
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                tSystemWarn("inotify queue overflowed; static file cache cleared");
+                removeItems(QString());
+                continue;
+            }
+
+            if (!watches.contains(event->wd))
+                continue;
+
+            QString dir = watches.value(event->wd);
+            if (event->len == 0) {
+                // The directory itself
+                removeItems(dir);
+            } else {
+                QString path = dir + QLatin1Char('/') + QFile::decodeName(event->name);
+                if (event->mask & IN_ISDIR) {
+                    removeItems(path);
+                } else {
+                    // Looked up by the key, not to scan all the entries
+                    removeFile(path);
+                    if (path.endsWith(".gz")) {
+                        removeFile(path.left(path.length() - 3));  // precompressed file
+                    }
+                }
+            }
+
+            if (event->mask & IN_MOVE_SELF) {
+                // Watched again at the path when a file is loaded
+                ::inotify_rm_watch(inotifyFd, event->wd);
+            }
+            if (event->mask & (IN_IGNORED | IN_MOVE_SELF)) {
+                watches.remove(event->wd);
+                watchedDirs.remove(dir);
+            }
+        }
+    }
+}
+
+/*!
+  Returns the header of the response for the \a entry, without the
+  terminating empty line; of the gzip-encoded variant if \a gzip is
+  true. The \a contentRange is set to the Content-Range header of the
+  206 Partial Content and 416 Requested Range Not Satisfiable.
+*/
+QByteArray TStaticFileCache::responseHeader(int statusCode, const Entry &entry, bool gzip, const QByteArray &contentType,
+                                            qint64 length, const QByteArray &contentRange)
+{
+    THttpResponseHeader header;
+    header.setStatusLine(statusCode, THttpUtility::getResponseReasonPhrase(statusCode));
+    if (statusCode != Tf::NotModified) {
+        if (!contentType.isEmpty()) {
+            header.setContentType(contentType);
+        }
+        header.setContentLength(length);
+        if (!contentRange.isEmpty()) {
+            header.setRawHeader("Content-Range", contentRange);
+        }
+        header.setRawHeader("Accept-Ranges", "bytes");
+    }
+    header.setRawHeader("Last-Modified", entry.lastModified);
+    THttpCompression::setVariantHeader(header, statusCode, !entry.gzipFilePath.isEmpty(), gzip, entry.etag);
+    header.setRawHeader("Server", "TreeFrog server");
+
+    QByteArray ret = header.toByteArray();
+    ret.chop(2);
+    return ret;
+}
+
+/*
+  Watches the directory \a dir in the root directory and its parents,
+  so that moving any of them is notified. Must be called with the
+  write lock.
+*/
+bool TStaticFileCache::watch(const QString &dir)
+{
+    int pos = 0;
+    for (;;) {
+        QString d = dir.left(pos);
+        if (!watchedDirs.contains(d)) {
+            int wd = ::inotify_add_watch(inotifyFd, QFile::encodeName(root + d.mid(1)).constData(), WATCH_MASK);
+            if (wd < 0) {
+                tSystemWarn("Failed inotify_add_watch()  errno:%d  dir:%s", errno, qPrintable(root + d.mid(1)));
+                return false;
+            }
+            watches.insert(wd, d);
+            watchedDirs.insert(d, wd);
+        }
+
+        if (pos >= dir.length())
+            break;
+        pos = dir.indexOf(QLatin1Char('/'), pos + 1);
+        if (pos < 0) {
+            pos = dir.length();
+        }
+    }
+    return true;
+}
+
+/*
+  Removes the entry of the \a path and the entries under it. Must be
+  called with the write lock.
+*/
+void TStaticFileCache::removeItems(const QString &path)
+{
+    QString prefix = path + QLatin1Char('/');
+    QMutableHashIterator<QString, Item *> it(items);
+    while (it.hasNext()) {
+        it.next();
+        if (it.key() == path || it.key().startsWith(prefix)) {
+            Item *item = it.value();
+            unlink(item);
+            memory -= entrySize(item->entry);
+            delete item;
+            it.remove();
+        }
+    }
+}
+
+/*
+  Removes the entry of the file \a path. Must be called with the write
+  lock.
+*/
+void TStaticFileCache::removeFile(const QString &path)
+{
+    Item *item = items.value(path);
+    if (item) {
+        removeItem(item);
+    }
+}
+
+/*
+  Removes the \a item. Must be called with the write lock.
+*/
+void TStaticFileCache::removeItem(Item *item)
+{
+    items.remove(item->path);
+    unlink(item);
+    memory -= entrySize(item->entry);
+    delete item;
+}
+
+/*
+  Evicts the least recently used entries so that \a size bytes can be
+  added. Must be called with the write lock.
+*/
+void TStaticFileCache::evict(qint64 size)
+{
+    while (last && memory + size > maxMemory) {
+        removeItem(last);
+    }
+}
+
+/*
+  Links the \a item to the head of the LRU list. Must be called with
+  the write lock, or with the read lock and the list mutex.
+*/
+void TStaticFileCache::linkFirst(Item *item) const
+{
+    item->prev = 0;
+    item->next = first;
+    if (first) {
+        first->prev = item;
+    } else {
+        last = item;
+    }
+    first = item;
+}
+
+/*
+  Unlinks the \a item from the LRU list. Must be called with the write
+  lock, or with the read lock and the list mutex.
+*/
+void TStaticFileCache::unlink(Item *item) const
+{
+    if (item->prev) {
+        item->prev->next = item->next;
+    } else {
+        first = item->next;
+    }
+    if (item->next) {
+        item->next->prev = item->prev;
+    } else {
+        last = item->prev;
+    }
+    item->prev = item->next = 0;
+}
@@ -6,6 +6,7 @@
  */
 
 #include <QFile>
+#include <QHash>
 #include <QTextStream>
 #include <TWebApplication>
 #include <TSystemGlobal>
@@ -23,6 +24,87 @@ static void cleanup()
     }
 }
 
+/*
+  Node of the trie of the path segments. A route is held by the node of
+  its last segment; the routes with ":params" match the rest of the path.
+  The subtree of a node holds no route of higher priority than its
+  minRouteId, so that it's skipped once a route of the higher priority
+  is found.
+*/
+struct TUrlRoute::Node
+{
+    QHash<QString, Node *> children;  // by the segment
+    Node *paramChild;                 // ":param", any segment
+    Node *intChild;                   // ":int", an integer segment
+    QList<int> routeIds;              // indexes of the routes, in the order of priority
+    QList<int> restRouteIds;          // ditto, with ":params"
+    int minRouteId;                   // of the routes in the subtree
+
+    Node() : paramChild(0), intChild(0), minRouteId(-1) { }
+    ~Node()
+    {
+        qDeleteAll(children);
+        delete paramChild;
+        delete intChild;
+    }
+};
+
+
+static QStringList splitPath(const QString &path)
+{
+    QStringList segments = path.split(QLatin1Char('/'));
+    if (!segments.isEmpty() && segments.first().isEmpty()) {
+        segments.removeFirst();  // before the leading slash
+    }
+    if (!segments.isEmpty() && segments.last().isEmpty()) {
+        segments.removeLast();  // trailing slash
+    }
+    return segments;
+}
+
+
+static bool isInteger(const QString &str)
+{
+    int i = (str.startsWith(QLatin1Char('-'))) ? 1 : 0;
+    if (i >= str.length())
+        return false;
+
+    for (; i < str.length(); ++i) {
+        ushort c = str[i].unicode();
+        if (c < '0' || c > '9')
+            return false;
+    }
+    return true;
+}
+
+
+static inline bool isAcceptable(int routeMethod, Tf::HttpMethod method)
+{
+    return routeMethod == TRoute::Match
+        || (routeMethod == TRoute::Get && method == Tf::Get)
+        || (routeMethod == TRoute::Post && method == Tf::Post);
+}
+
+/*!
+  \class TUrlRoute
+  \brief The TUrlRoute class routes the URL paths to the actions by the
+  routes.cfg. The routes are compiled into a trie of the path segments,
+  so that a path is looked up in the time proportional to its length,
+  regardless of the number of the routes.
+  The segment ":param" of a route matches any segment, and ":int"
+  matches an integer; they are passed to the action as the parameters.
+  The last segment ":params" matches the rest of the path.
+*/
+
+TUrlRoute::TUrlRoute()
+    : routes(), root(new Node)
+{ }
+
+
+TUrlRoute::~TUrlRoute()
+{
+    delete root;
+}
 
 /*!
  * Initializes.
@@ -60,66 +142,7 @@ bool TUrlRoute::parseConfigFile()
         ++cnt;
 
         if (!line.isEmpty() && !line.startsWith('#')) {
-            QStringList items = line.split(' ');
-            if (items.count() == 3) {
-                // Trimm quotes
-                items[1] = THttpUtility::trimmedQuotes(items[1]);
-                items[2] = THttpUtility::trimmedQuotes(items[2]);
-
-                TRoute rt;
-
-                // Check method
-                if (items[0].toLower() == "match") {
-                    rt.method = TRoute::Match;
-                } else if (items[0].toLower() == "get") {
-                    rt.method = TRoute::Get;
-                } else if (items[0].toLower() == "post") {
-                    rt.method = TRoute::Post;
-                } else {
-                    tError("Invalid directive, '%s'  [line : %d]", qPrintable(items[0]), cnt);
-                    continue;
-                }
-
-                // parse path
-                if (items[1].endsWith(":params")) {
-                    rt.params = true;
-                    rt.path = items[1].left(items[1].length() - 7);
-                } else {
-                    rt.params = false;
-                    rt.path = items[1];
-                }
-
-                // parse controller and action
-                QStringList list = items[2].split('#');
-                if (list.count() == 2) {
-                    rt.controller = list[0].toLower().toLatin1() + "controller";
-                    rt.action = list[1].toLatin1();
-                } else {
-                    tError("Invalid action, '%s'  [line : %d]", qPrintable(items[2]), cnt);
-                    continue;
-                }
-
-                routes << rt;
-                tSystemDebug("route: method:%d path:%s ctrl:%s action:%s params:%d",
-                             rt.method, qPrintable(rt.path), rt.controller.data(),
-                             rt.action.data(), rt.params);
-
-                if (!rt.params) {
-                    if (rt.path.endsWith('/')) {
-                        rt.path.chop(1);
-                    } else {
-                        rt.path += QLatin1Char('/');
-                    }
-
-                    if (!rt.path.isEmpty()) {
-                        routes << rt;
-                        tSystemDebug("route: method:%d path:%s ctrl:%s action:%s params:%d",
-                                     rt.method, qPrintable(rt.path), rt.controller.data(),
-                                     rt.action.data(), rt.params);
-                    }
-                }
-
-            } else {
+            if (!addRouteFromString(line)) {
                 tError("Invalid directive, '%s'  [line : %d]", qPrintable(line), cnt);
             }
         }
@@ -127,38 +150,196 @@ bool TUrlRoute::parseConfigFile()
     return true;
 }
 
+/*!
+  Adds the route of the directive \a line of the routes.cfg, such as
+  'get "/Book/:int" "Book#show"'. Returns false if it's invalid.
+  The routes added first have the higher priority.
+*/
+bool TUrlRoute::addRouteFromString(const QString &line)
+{
+    QStringList items = line.simplified().split(' ');
+    if (items.count() != 3)
+        return false;
+
+    // Trimm quotes
+    items[1] = THttpUtility::trimmedQuotes(items[1]);
+    items[2] = THttpUtility::trimmedQuotes(items[2]);
+
+    TRoute rt;
+
+    // Check method
+    if (items[0].toLower() == "match") {
+        rt.method = TRoute::Match;
+    } else if (items[0].toLower() == "get") {
+        rt.method = TRoute::Get;
+    } else if (items[0].toLower() == "post") {
+        rt.method = TRoute::Post;
+    } else {
+        return false;
+    }
+
+    // parse path
+    if (items[1].endsWith(":params")) {
+        rt.params = true;
+        rt.path = items[1].left(items[1].length() - 7);
+    } else {
+        rt.params = false;
+        rt.path = items[1];
+    }
+
+    // parse controller and action
+    QStringList list = items[2].split('#');
+    if (list.count() == 2) {
+        rt.controller = list[0].toLower().toLatin1() + "controller";
+        rt.action = list[1].toLatin1();
+    } else {
+        return false;
+    }
 
+    // Inserts to the trie; the route added first has the minimum index
+    int id = routes.count();
+    Node *node = root;
+    if (node->minRouteId < 0) {
+        node->minRouteId = id;
+    }
+
+    QStringList segments = splitPath(rt.path);
+    for (QStringListIterator it(segments); it.hasNext(); ) {
+        const QString &seg = it.next();
+        Node **child;
+        if (seg == QLatin1String(":param")) {
+            child = &node->paramChild;
+        } else if (seg == QLatin1String(":int")) {
+            child = &node->intChild;
+        } else {
+            child = &node->children[seg];
+        }
+
+        if (!*child) {
+            *child = new Node;
+            (*child)->minRouteId = id;
+        }
+        node = *child;
+    }
+
+    if (rt.params) {
+        node->restRouteIds << id;
+    } else {
+        node->routeIds << id;
+    }
+    routes << rt;
+
+    tSystemDebug("route: method:%d path:%s ctrl:%s action:%s params:%d",
+                 rt.method, qPrintable(rt.path), rt.controller.data(),
+                 rt.action.data(), rt.params);
+    return true;
+}
+
+/*!
+  Returns the routing of the \a path for the \a method. If a route of
+  the path is found only for the other methods, returns the routing
+  rejected, whose controller is empty.
+*/
 TRouting TUrlRoute::findRouting(Tf::HttpMethod method, const QString &path) const
 {
-    for (QListIterator<TRoute> i(routes); i.hasNext(); ) {
-        const TRoute &rt = i.next();
-        if (!rt.params && rt.path == path) {
-            if (rt.method != TRoute::Match
-                && (rt.method == TRoute::Get && method != Tf::Get)
-                && (rt.method == TRoute::Post && method != Tf::Post)) {
-                return TRouting("", "");  // reject routing
-            }
-            return TRouting(rt.controller, rt.action);
+    QStringList segments = splitPath(path);
+    QStringList params;
+    QStringList foundParams;
+    int found = -1;
+    int rejected = -1;
+
+    findRouting(root, segments, 0, method, params, found, foundParams, rejected);
+
+    if (found >= 0) {
+        const TRoute &rt = routes[found];
+        return TRouting(rt.controller, rt.action, foundParams);
+    }
+    if (rejected >= 0) {
+        return TRouting("", "");  // reject routing
+    }
+    return TRouting();  // Not found routing info
+}
+
+/*
+  Finds the route of the highest priority matching the segments from
+  \a pos under the \a node. The index of the route for the \a method
+  and its parameters are set to \a found and \a foundParams, and the
+  index of a route for another method to \a rejected.
+  The children are searched in the order of the priority of their
+  subtrees, and the subtrees of lower priority than the route found
+  are skipped; each node is visited once at most.
+*/
+void TUrlRoute::findRouting(const Node *node, const QStringList &segments, int pos, Tf::HttpMethod method,
+                            QStringList &params, int &found, QStringList &foundParams, int &rejected) const
+{
+    if (found >= 0 && node->minRouteId > found)
+        return;
+
+    // Routes with ":params", matching the rest
+    for (QListIterator<int> it(node->restRouteIds); it.hasNext(); ) {
+        int id = it.next();
+        if (found >= 0 && id > found)
+            break;
+
+        if (isAcceptable(routes[id].method, method)) {
+            found = id;
+            foundParams = params + segments.mid(pos);
+            break;
+        } else if (rejected < 0) {
+            rejected = id;
         }
+    }
 
-        if (rt.params && path.startsWith(rt.path)) {
-            if (rt.method != TRoute::Match
-                && (rt.method == TRoute::Get && method != Tf::Get)
-                && (rt.method == TRoute::Post && method != Tf::Post)) {
-                return TRouting("", "");  // reject routing
-            }
+    if (pos == segments.count()) {
+        for (QListIterator<int> it(node->routeIds); it.hasNext(); ) {
+            int id = it.next();
+            if (found >= 0 && id > found)
+                break;
 
-            QStringList params;
-            int len = rt.path.endsWith('/') ? rt.path.length() : rt.path.length() + 1;
-            QString paramstr = path.mid(len);
-            if (!paramstr.isEmpty()) {
-                params = paramstr.split('/');
-                if (path.endsWith(QLatin1Char('/')) && !params.isEmpty()) {
-                    params.removeLast();  // unuse last item
-                }
+            if (isAcceptable(routes[id].method, method)) {
+                found = id;
+                foundParams = params;
+                break;
+            } else if (rejected < 0) {
+                rejected = id;
             }
-            return TRouting(rt.controller, rt.action, params);
+        }
+        return;
+    }
+
+    // Children matching the segment; the literal, ":int" and ":param"
+    const QString &seg = segments[pos];
+    const Node *children[3];
+    int count = 0;
+
+    const Node *child = node->children.value(seg);
+    if (child) {
+        children[count++] = child;
+    }
+    if (!seg.isEmpty()) {
+        if (node->intChild && isInteger(seg)) {
+            children[count++] = node->intChild;
+        }
+        if (node->paramChild) {
+            children[count++] = node->paramChild;
+        }
+    }
+
+    // Sorts them by the priority
+    for (int i = 1; i < count; ++i) {
+        for (int j = i; j > 0 && children[j]->minRouteId < children[j - 1]->minRouteId; --j) {
+            qSwap(children[j], children[j - 1]);
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        bool param = (children[i] != child);
+        if (param) {
+            params << seg;
+        }
+        findRouting(children[i], segments, pos + 1, method, params, found, foundParams, rejected);
+        if (param) {
+            params.removeLast();
         }
     }
-    return TRouting();  // Not found routing info
 }
@@ -47,15 +47,26 @@ inline TRouting::TRouting(const QByteArray &ctrl, const QByteArray &act, const Q
 class T_CORE_EXPORT TUrlRoute
 {
 public:
+    TUrlRoute();
+    ~TUrlRoute();
+
+    bool addRouteFromString(const QString &line);
+    TRouting findRouting(Tf::HttpMethod method, const QString &path) const;
+
     static void instantiate();
     static const TUrlRoute &instance();
-    TRouting findRouting(Tf::HttpMethod method, const QString &path) const;
 
 private:
-    TUrlRoute() { }
+    struct Node;
+
     bool parseConfigFile();
+    void findRouting(const Node *node, const QStringList &segments, int pos, Tf::HttpMethod method,
+                     QStringList &params, int &found, QStringList &foundParams, int &rejected) const;
 
     QList<TRoute> routes;
+    Node *root;  // trie of the path segments
+
+    Q_DISABLE_COPY(TUrlRoute)
 };
 
 #endif // TURLROUTE_H
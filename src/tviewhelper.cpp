@@ -9,10 +9,10 @@
 #include <QRegExp>
 #include <TViewHelper>
 #include <TWebApplication>
+#include <TAppConfig>
 #include <TActionView>
 #include <THttpUtility>
 
-#define ENABLE_CSRF_PROTECTION_MODULE "EnableCsrfProtectionModule"
 
 
 /*!
@@ -255,7 +255,7 @@ QString TViewHelper::radioButtonTag(const QString &name, const QString &value, b
 QString TViewHelper::inputAuthenticityTag() const
 {
     QString tag;
-    if (Tf::app()->appSettings().value(ENABLE_CSRF_PROTECTION_MODULE, true).toBool()) {
+    if (Tf::app()->appConfig().enableCsrfProtectionModule()) {
         QString token = actionView()->authenticityToken();
         if (!token.isEmpty())
             tag = inputTag("hidden", "authenticity_token", token);
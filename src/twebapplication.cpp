@@ -9,6 +9,7 @@
 #include <QTextCodec>
 #include <QDateTime>
 #include <TWebApplication>
+#include <TAppConfig>
 #include <TSystemGlobal>
 #include <stdlib.h>
 
@@ -40,6 +41,7 @@ TWebApplication::TWebApplication(int &argc, char **argv)
 #endif
       dbEnvironment(DEFAULT_DATABASE_ENVIRONMENT),
       appSetting(0),
+      appConf(0),
       sqlSettings(0),
       mongoSetting(0),
       loggerSetting(0),
@@ -88,6 +90,7 @@ TWebApplication::TWebApplication(int &argc, char **argv)
     loggerSetting = new QSettings(configPath() + "logger.ini", QSettings::IniFormat, this);
     validationSetting = new QSettings(configPath() + "validation.ini", QSettings::IniFormat, this);
     mediaTypes = new QSettings(configPath() + "initializers" + QDir::separator() + "internet_media_types.ini", QSettings::IniFormat, this);
+    appConf = new TAppConfig(*appSetting);
 
     // Gets codecs
     codecInternal = searchCodec(appSetting->value("InternalEncoding").toByteArray().trimmed().data());
@@ -123,7 +126,9 @@ TWebApplication::TWebApplication(int &argc, char **argv)
 
 
 TWebApplication::~TWebApplication()
-{ }
+{
+    delete appConf;
+}
 
 /*!
   Enters the main event loop and waits until exit() is called. Returns the
@@ -397,6 +402,13 @@ void TWebApplication::timerEvent(QTimerEvent *event)
   web application, which file is the application.ini.
 */
 
+/*!
+  \fn const TAppConfig &TWebApplication::appConfig() const
+  Returns a reference to the TAppConfig object, the settings of the
+  application.ini read on every request. Unlike appSettings(), it's
+  read without locking.
+*/
+
 /*!
   \fn QSettings &TWebApplication::loggerSettings () const
   Returns a reference to the QSettings object for settings of the
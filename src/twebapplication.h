@@ -14,6 +14,7 @@
 #include "qplatformdefs.h"
 
 class QTextCodec;
+class TAppConfig;
 
 
 class T_CORE_EXPORT TWebApplication
@@ -50,6 +51,7 @@ public:
     bool appSettingsFileExists() const;
     QString appSettingsFilePath() const;
     QSettings &appSettings() const { return *appSetting; }
+    const TAppConfig &appConfig() const { return *appConf; }
     QSettings &sqlDatabaseSettings(int databaseId) const;
     int sqlDatabaseSettingsCount() const;
     bool isSqlDatabaseAvailable() const;
@@ -98,6 +100,7 @@ private:
     QString webRootAbsolutePath;
     QString dbEnvironment;
     QSettings *appSetting;
+    TAppConfig *appConf;
     QVector<QSettings *> sqlSettings;
     QSettings *mongoSetting;
     QSettings *loggerSetting;
@@ -457,11 +457,16 @@ int managerMain(int argc, char *argv[])
     for (;;) {
         ServerManager *manager = 0;
         switch ( app.multiProcessingModule() ) {
-        case TWebApplication::Thread: // FALL THROUGH
-        case TWebApplication::Hybrid: {
+        case TWebApplication::Thread: {
             manager = new ServerManager(1, 1, 0, &app);
             break; }
 
+        case TWebApplication::Hybrid: {
+            int max = app.appSettings().value("MPM.hybrid.MaxProcesses", 1).toInt();
+            int min = app.appSettings().value("MPM.hybrid.MinProcesses", 1).toInt();
+            manager = new ServerManager(max, min, 0, &app);
+            break; }
+
         case TWebApplication::Prefork: {
             int max = app.appSettings().value("MPM.prefork.MaxServers").toInt();
             int min = app.appSettings().value("MPM.prefork.MinServers").toInt();
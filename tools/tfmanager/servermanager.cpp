@@ -6,6 +6,14 @@
  */
 
 #include <QtNetwork>
+#ifdef Q_OS_UNIX
+# include <signal.h>
+#endif
+#ifdef Q_OS_LINUX
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+#endif
 #include <TGlobal>
 #include <TWebApplication>
 #include <TSystemGlobal>
@@ -23,14 +31,77 @@ namespace TreeFrog {
 #endif
 
 static QMap<QProcess *, int> serversStatus;
+static QMap<QProcess *, int> serversLoad;  // percentage reported by hybrid servers
+static QMap<QProcess *, QByteArray> stderrBuffers;  // incomplete lines of stderr
+static QMap<qint64, int> childrenStatus;   // servers forked by the zygote, by PID
+static QProcess *zygote = 0;
+static bool zygoteReady = false;
+static int forkingCount = 0;  // fork commands not answered yet
+
+const int SAMPLE_INTERVAL = 1000;  // msecs
+const int SCALE_UP_LOAD = 80;      // percentage
+const int SCALE_DOWN_LOAD = 30;
+const int SCALE_DOWN_SAMPLES = 10;  // consecutive samples of low load
+const int MAX_STDERR_LINE = 4096;  // bytes
+
+
+static void startProcess(QProcess *process, const QStringList &args, QIODevice::OpenMode mode)
+{
+#if defined(Q_OS_UNIX) && !defined(Q_OS_DARWIN)
+    // Sets LD_LIBRARY_PATH environment variable
+    QString ldpath = ".";  // means the lib dir
+    QString sysldpath = QProcess::systemEnvironment().filter("LD_LIBRARY_PATH=", Qt::CaseSensitive).value(0).mid(16);
+    if (!sysldpath.isEmpty()) {
+        ldpath += ":";
+        ldpath += sysldpath;
+    }
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("LD_LIBRARY_PATH", ldpath);
+    process->setProcessEnvironment(env);
+    tSystemDebug("export %s=%s", "LD_LIBRARY_PATH", qPrintable(ldpath));
+#endif
+
+    // Executes treefrog server
+    process->start(TFSERVER_CMD, args, mode);
+}
+
+/*
+  Parses the \a line of a notification of a server; the name and the
+  numbers following with colons, such as "_exited:1234:0".
+*/
+static bool parseNotification(const QByteArray &line, QByteArray &name, QList<qint64> &args)
+{
+    int i = 1;
+    while (i < line.length() && line[i] >= 'a' && line[i] <= 'z')
+        ++i;
+
+    if (!line.startsWith('_') || i == 1)
+        return false;
+
+    name = line.mid(1, i - 1);
+    args.clear();
+    while (i < line.length() && line[i] == ':') {
+        int j = ++i;
+        if (j < line.length() && line[j] == '-')
+            ++j;
+        while (j < line.length() && line[j] >= '0' && line[j] <= '9')
+            ++j;
+        args << line.mid(i, j - i).toLongLong();
+        i = j;
+    }
+    return (i == line.length());
+}
 
 
 ServerManager::ServerManager(int max, int min, int spare, QObject *parent)
-    : QObject(parent), listeningSocket(0), maxServers(max), minServers(min), spareServers(spare), running(false)
+    : QObject(parent), listeningSocket(0), maxServers(max), minServers(min), spareServers(spare),
+      targetServers(0), lowLoadCount(0), sampleTimer(), running(false)
 {
     spareServers = qMax(spareServers, 0);
     minServers = qMax(minServers, 1);
     maxServers = qMax(maxServers, minServers);
+    targetServers = minServers;
 }
 
 
@@ -53,7 +124,8 @@ bool ServerManager::start(const QHostAddress &address, quint16 port)
         return false;
     }
 
-    if (Tf::app()->multiProcessingModule() == TWebApplication::Prefork) {
+    if (Tf::app()->multiProcessingModule() != TWebApplication::Thread) {
+        // Shared by the tfserver processes
         listeningSocket = sd;
     } else {
         // Just tried to open a socket.
@@ -65,7 +137,16 @@ bool ServerManager::start(const QHostAddress &address, quint16 port)
 #endif
 
     running = true;
+#ifdef Q_OS_UNIX
+    if (Tf::app()->multiProcessingModule() == TWebApplication::Prefork
+        && Tf::app()->appSettings().value("MPM.prefork.Zygote", false).toBool()) {
+        startZygote();
+    }
+#endif
     ajustServers();
+    if (maxServers > minServers) {
+        sampleTimer.start(SAMPLE_INTERVAL, this);
+    }
     tSystemInfo("TreeFrog application servers start up.  port:%d", port);
     return true;
 }
@@ -83,7 +164,8 @@ bool ServerManager::start(const QString &fileDomain)
         return false;
     }
 
-    if (Tf::app()->multiProcessingModule() == TWebApplication::Prefork) {
+    if (Tf::app()->multiProcessingModule() != TWebApplication::Thread) {
+        // Shared by the tfserver processes
         listeningSocket = sd;
     } else {
         // Just tried to open a socket.
@@ -92,7 +174,16 @@ bool ServerManager::start(const QString &fileDomain)
     }
 
     running = true;
+#ifdef Q_OS_UNIX
+    if (Tf::app()->multiProcessingModule() == TWebApplication::Prefork
+        && Tf::app()->appSettings().value("MPM.prefork.Zygote", false).toBool()) {
+        startZygote();
+    }
+#endif
     ajustServers();
+    if (maxServers > minServers) {
+        sampleTimer.start(SAMPLE_INTERVAL, this);
+    }
     tSystemInfo("TreeFrog application servers start up.  Domain file name:%s", qPrintable(fileDomain));
     return true;
 }
@@ -104,12 +195,25 @@ void ServerManager::stop()
         return;
 
     running = false;
+    sampleTimer.stop();
 
     if (listeningSocket > 0) {
         TF_CLOSE(listeningSocket);
     }
     listeningSocket = 0;
 
+    if (zygote) {
+        disconnect(zygote, 0, this, 0);
+        zygote->terminate();  // stops the servers forked too
+        zygote->waitForFinished(-1);
+        stderrBuffers.remove(zygote);
+        delete zygote;
+        zygote = 0;
+        zygoteReady = false;
+        forkingCount = 0;
+        childrenStatus.clear();
+    }
+
     if (serverCount() > 0) {
         tSystemInfo("TreeFrog application servers shutting down");
 
@@ -127,6 +231,8 @@ void ServerManager::stop()
             delete tfserver;
         }
         serversStatus.clear();
+        serversLoad.clear();
+        stderrBuffers.clear();
         tSystemInfo("TreeFrog application servers shutdown completed");
     }
 }
@@ -140,7 +246,7 @@ bool ServerManager::isRunning() const
 
 int ServerManager::serverCount() const
 {
-    return serversStatus.count();
+    return serversStatus.count() + childrenStatus.count() + forkingCount;
 }
 
 
@@ -153,6 +259,11 @@ int ServerManager::spareServerCount() const
             ++count;
         }
     }
+    for (QMapIterator<qint64, int> i(childrenStatus); i.hasNext(); ) {
+        if (i.next().value() == Listening) {
+            ++count;
+        }
+    }
     return count;
 }
 
@@ -161,15 +272,147 @@ void ServerManager::ajustServers() const
 {
     if (isRunning()) {
         tSystemDebug("serverCount: %d  spare: %d", serverCount(), spareServerCount());
-        if (serverCount() < maxServers && (serverCount() < minServers || spareServerCount() < spareServers)) {
+        if (serverCount() < maxServers && (serverCount() < minServers || serverCount() < targetServers
+                                           || spareServerCount() < spareServers)) {
             startServer();
         }
     }
 }
 
+/*!
+  Terminates one of the server processes which are not processing
+  any request.
+*/
+void ServerManager::stopIdleServer()
+{
+    bool prefork = (Tf::app()->multiProcessingModule() == TWebApplication::Prefork);
+    if (serverCount() <= minServers || (prefork && spareServerCount() <= spareServers))
+        return;
+
+    for (QMapIterator<QProcess *, int> i(serversStatus); i.hasNext(); ) {
+        i.next();
+        QProcess *server = i.key();
+        if (i.value() == Listening && (prefork || serversLoad.value(server) == 0)) {
+            tSystemDebug("Terminates an idle server  serverCount:%d", serverCount());
+            serversStatus.insert(server, Closing);
+            server->terminate();
+            return;
+        }
+    }
+
+#ifdef Q_OS_UNIX
+    for (QMapIterator<qint64, int> i(childrenStatus); i.hasNext(); ) {
+        i.next();
+        if (i.value() == Listening) {
+            tSystemDebug("Terminates an idle server  pid:%lld", i.key());
+            childrenStatus.insert(i.key(), Closing);
+            ::kill((pid_t)i.key(), SIGTERM);
+            return;
+        }
+    }
+#endif
+}
+
+/*!
+  Returns the number of the connections waiting in the accept queue of
+  the listening socket, or 0 if it's unknown.
+*/
+int ServerManager::listenQueueLength() const
+{
+#ifdef Q_OS_LINUX
+    if (listeningSocket > 0) {
+        struct tcp_info info;
+        socklen_t len = sizeof(info);
+
+        // For a listening socket, tcpi_unacked is the length of the accept queue
+        if (getsockopt(listeningSocket, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+            return info.tcpi_unacked;
+        }
+    }
+#endif
+    return 0;
+}
+
+/*!
+  Returns the average busy ratio of the server processes in percentage.
+  A prefork server is busy while processing a request; a hybrid server
+  reports the ratio of its workers in use.
+*/
+int ServerManager::averageLoad() const
+{
+    int count = serversStatus.count() + childrenStatus.count();
+    if (count == 0)
+        return 0;
+
+    bool prefork = (Tf::app()->multiProcessingModule() == TWebApplication::Prefork);
+    int total = 0;
+    for (QMapIterator<QProcess *, int> i(serversStatus); i.hasNext(); ) {
+        i.next();
+        if (prefork) {
+            total += (i.value() == Running) ? 100 : 0;
+        } else {
+            total += serversLoad.value(i.key());
+        }
+    }
+    for (QMapIterator<qint64, int> i(childrenStatus); i.hasNext(); ) {
+        total += (i.next().value() == Running) ? 100 : 0;
+    }
+    return total / count;
+}
+
+/*!
+  Samples the load periodically, and scales the number of the server
+  processes. It scales up at once if the connections are queued or the
+  load is high, and scales down after the load stays low for a while.
+*/
+void ServerManager::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != sampleTimer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    if (!isRunning())
+        return;
+
+    int queued = listenQueueLength();
+    int load = averageLoad();
+
+    if (queued > 0 || load >= SCALE_UP_LOAD) {
+        lowLoadCount = 0;
+        if (targetServers < maxServers) {
+            targetServers = qMin(qMax(targetServers, serverCount()) + 1, maxServers);
+            tSystemDebug("Scales up  target:%d queued:%d load:%d%%", targetServers, queued, load);
+            ajustServers();
+        }
+    } else if (load < SCALE_DOWN_LOAD) {
+        if (++lowLoadCount >= SCALE_DOWN_SAMPLES) {
+            lowLoadCount = 0;
+            if (targetServers > minServers) {
+                --targetServers;
+                tSystemDebug("Scales down  target:%d load:%d%%", targetServers, load);
+            }
+            if (serverCount() > targetServers) {
+                stopIdleServer();
+            }
+        }
+    } else {
+        lowLoadCount = 0;
+    }
+}
+
 
 void ServerManager::startServer() const
 {
+    if (zygote) {
+        // Forks a server from the zygote
+        if (zygoteReady) {
+            zygote->write("fork\n");
+            ++forkingCount;
+        }
+        return;
+    }
+
     QStringList args = QCoreApplication::arguments();
     args.removeFirst();
 
@@ -187,27 +430,57 @@ void ServerManager::startServer() const
     connect(tfserver, SIGNAL(readyReadStandardOutput()), this, SLOT(readStandardOutput()));
     connect(tfserver, SIGNAL(readyReadStandardError()), this, SLOT(readStandardError()));
 
-#if defined(Q_OS_UNIX) && !defined(Q_OS_DARWIN)
-    // Sets LD_LIBRARY_PATH environment variable
-    QString ldpath = ".";  // means the lib dir
-    QString sysldpath = QProcess::systemEnvironment().filter("LD_LIBRARY_PATH=", Qt::CaseSensitive).value(0).mid(16);
-    if (!sysldpath.isEmpty()) {
-        ldpath += ":";
-        ldpath += sysldpath;
-    }
-
-    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-    env.insert("LD_LIBRARY_PATH", ldpath);
-    tfserver->setProcessEnvironment(env);
-    tSystemDebug("export %s=%s", "LD_LIBRARY_PATH", qPrintable(ldpath));
-#endif
-
-    // Executes treefrog server
-    tfserver->start(TFSERVER_CMD, args, QIODevice::ReadOnly);
+    startProcess(tfserver, args, QIODevice::ReadOnly);
     tfserver->closeWriteChannel();
     tSystemDebug("tfserver started");
 }
 
+/*!
+  Starts the zygote, a tfserver process which has loaded the libraries
+  of the application and forks the servers on the "fork" commands
+  written to its stdin. The servers forked notify their states through
+  the stderr of the zygote.
+*/
+void ServerManager::startZygote()
+{
+    QStringList args = QCoreApplication::arguments();
+    args.removeFirst();
+    args.prepend(QString::number(listeningSocket));
+    args.prepend("-s");
+    args.prepend("-z");
+
+    zygote = new QProcess;
+    zygoteReady = false;
+    forkingCount = 0;
+
+    connect(zygote, SIGNAL(error(QProcess::ProcessError)), this, SLOT(errorDetect(QProcess::ProcessError)));
+    connect(zygote, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(zygoteFinish(int, QProcess::ExitStatus)));
+    connect(zygote, SIGNAL(readyReadStandardOutput()), this, SLOT(readStandardOutput()));
+    connect(zygote, SIGNAL(readyReadStandardError()), this, SLOT(readStandardError()));
+
+    startProcess(zygote, args, QIODevice::ReadWrite);
+    tSystemDebug("zygote started");
+}
+
+/*!
+  Starts the servers without the zygote, which has exited unexpectedly.
+  The servers forked by it are no longer managed.
+*/
+void ServerManager::zygoteFinish(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    if (!zygote)
+        return;
+
+    tSystemError("Zygote exited  exitCode:%d exitStatus:%d", exitCode, (int)exitStatus);
+    stderrBuffers.remove(zygote);
+    zygote->deleteLater();
+    zygote = 0;
+    zygoteReady = false;
+    forkingCount = 0;
+    childrenStatus.clear();
+    ajustServers();
+}
+
 
 void ServerManager::updateServerStatus()
 {
@@ -225,11 +498,18 @@ void ServerManager::updateServerStatus()
 void ServerManager::errorDetect(QProcess::ProcessError error)
 {
     QProcess *server = qobject_cast<QProcess *>(sender());
+    if (server && server == zygote) {
+        zygoteFinish(-1, QProcess::CrashExit);
+        return;
+    }
+
     if (server) {
         tSystemError("tfserver error detected(%d). [%s]", error, TFSERVER_CMD);
         //server->close();  // long blocking..
         server->deleteLater();
         serversStatus.remove(server);
+        serversLoad.remove(server);
+        stderrBuffers.remove(server);
 
         ajustServers();
     }
@@ -243,9 +523,15 @@ void ServerManager::serverFinish(int exitCode, QProcess::ExitStatus exitStatus)
         //server->close();  // long blocking..
         server->deleteLater();
         serversStatus.remove(server);
+        serversLoad.remove(server);
+        stderrBuffers.remove(server);
 
         if (exitStatus == QProcess::CrashExit) {
             ajustServers();
+        } else if (exitCode == 1 && Tf::app()->multiProcessingModule() == TWebApplication::Prefork) {
+            // Recycled after processing the requests
+            tSystemDebug("tfserver recycled");
+            ajustServers();
         } else {
             tSystemInfo("Detected normal exit of server. exitCode:%d", exitCode);
             if (serversStatus.count() == 0) {
@@ -271,15 +557,74 @@ void ServerManager::readStandardError() const
 {
     QProcess *server = qobject_cast<QProcess *>(sender());
     if (server) {
-        QByteArray buf = server->readAllStandardError();
-        if (buf == "_accepted") {
-            if (serversStatus.contains(server)) {
-                serversStatus.insert(server, Running);
-                ajustServers();
+        // Notifications, terminated by newlines; may be joined together
+        // or split across reads, so the incomplete line is kept till the
+        // next read. The servers forked by the zygote append their PIDs
+        // to them.
+        QByteArray &buf = stderrBuffers[server];
+        buf += server->readAllStandardError();
+
+        QByteArray name;
+        QList<qint64> args;
+        bool changed = false;
+        int nl;
+
+        while ((nl = buf.indexOf('\n')) >= 0) {
+            QByteArray line = buf.left(nl);
+            buf.remove(0, nl + 1);
+
+            if (!parseNotification(line, name, args)) {
+                tSystemWarn("treefrog stderr: %s", line.constData());
+                fprintf(stderr, "treefrog stderr: %s\n", line.constData());
+                continue;
             }
-        } else {
+
+            if (name == "accepted" || name == "listening") {
+                int state = (name == "accepted") ? Running : Listening;
+                if (args.isEmpty()) {
+                    if (serversStatus.contains(server) && serversStatus.value(server) != Closing) {
+                        serversStatus.insert(server, state);
+                    }
+                } else if (childrenStatus.value(args[0], NotRunning) != Closing) {
+                    childrenStatus.insert(args[0], state);
+                }
+                changed = true;
+
+            } else if (name == "load") {
+                serversLoad.insert(server, (int)args.value(0));
+
+            } else if (name == "ready") {
+                zygoteReady = true;
+                changed = true;
+
+            } else if (name == "forked") {
+                forkingCount = qMax(forkingCount - 1, 0);
+                if (!childrenStatus.contains(args.value(0))) {
+                    childrenStatus.insert(args.value(0), Listening);
+                }
+                changed = true;
+
+            } else if (name == "exited") {
+                childrenStatus.remove(args.value(0));
+                if (args.value(1) < 0) {
+                    tSystemError("Detected crash of server  pid:%lld", args.value(0));
+                }
+                changed = true;
+
+            } else {
+                tSystemWarn("Unknown notification: %s", name.data());
+            }
+        }
+
+        if (buf.length() > MAX_STDERR_LINE) {
+            // Not a notification
             tSystemWarn("treefrog stderr: %s", buf.constData());
             fprintf(stderr, "treefrog stderr: %s", buf.constData());
+            buf.clear();
+        }
+
+        if (changed) {
+            ajustServers();
         }
     }
 }
@@ -2,6 +2,7 @@
 #define SERVERMANAGER_H
 
 #include <QObject>
+#include <QBasicTimer>
 #include <QHostAddress>
 #include <QProcess>
 
@@ -32,11 +33,17 @@ protected:
 
     void ajustServers() const;
     void startServer() const;
-    
+    void startZygote();
+    void stopIdleServer();
+    int listenQueueLength() const;
+    int averageLoad() const;
+    void timerEvent(QTimerEvent *event);
+
 protected slots:
     void updateServerStatus();
     void errorDetect(QProcess::ProcessError error);
     void serverFinish(int exitCode, QProcess::ExitStatus exitStatus) const;
+    void zygoteFinish(int exitCode, QProcess::ExitStatus exitStatus);
     void readStandardOutput();
     void readStandardError() const;
 
@@ -45,8 +52,11 @@ private:
     int maxServers;
     int minServers;
     int spareServers;
+    int targetServers;
+    int lowLoadCount;
+    QBasicTimer sampleTimer;
     volatile bool running;
-    
+
     Q_DISABLE_COPY(ServerManager)
 };
 
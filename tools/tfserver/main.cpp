@@ -20,6 +20,7 @@ using namespace TreeFrog;
 
 #define CTRL_C_OPTION  "--ctrlc-enable"
 #define SOCKET_OPTION  "-s"
+#define ZYGOTE_OPTION  "-z"
 
 
 #if QT_VERSION >= 0x050000
@@ -159,8 +160,12 @@ int main(int argc, char *argv[])
         if (!sopt.isEmpty()) {
             sd = sopt.toInt();
             if (sd > 0) {
-                // Sets a listening socket descriptor
-                if (svr->setSocketDescriptor(sd)) {
+                if (args.contains(ZYGOTE_OPTION)) {
+                    // Forks the servers with the socket descriptor
+                    svr->setZygoteMode(sd);
+                    tSystemDebug("Zygote mode  socket descriptor: %d", sd);
+                } else if (svr->setSocketDescriptor(sd)) {
+                    // Sets a listening socket descriptor
                     tSystemDebug("Set socket descriptor: %d", sd);
                 } else {
                     tSystemError("Failed to set socket descriptor: %d", sd);
@@ -178,6 +183,17 @@ int main(int argc, char *argv[])
 #ifdef Q_OS_LINUX
         TMultiplexingServer::instantiate();
         server = TMultiplexingServer::instance();
+        if (!sopt.isEmpty()) {
+            sd = sopt.toInt();
+            if (sd > 0) {
+                // Sets a listening socket descriptor
+                TMultiplexingServer::instance()->setSocketDescriptor(sd);
+                tSystemDebug("Set socket descriptor: %d", sd);
+            } else {
+                tSystemError("Invalid socket descriptor: %d", sd);
+                goto finish;
+            }
+        }
 #else
         tFatal("Unsupported MPM: hybrid");
 #endif